@@ -0,0 +1,237 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+
+// First byte of every dump frame
+#define DUMP_SYNC 0xA5
+// Version of dump frame format this program understands
+#define DUMP_VERSION 1
+// Number of seconds to wait for a byte before giving up
+#define READ_TIMEOUT 5
+
+// Kinds of data, same order as dump_kinds in firmware
+enum dump_kinds { DUMP_LOGS, DUMP_USERS, DUMP_SETTINGS };
+
+// Log actions, same order as log_actions in firmware
+static const char *const LOG_ACTIONS[] = {
+    "???", "VMO", "VMZ", "VVO", "VVZ", "PMO", "PMZ", "PVV",
+    "SON", "SOF", "UST", "UNA", "UNE", "UPR", "UVA", "UVT",
+    "SUP"
+};
+// Number of log actions this program knows, newer ones are printed as ???
+static const int LOG_ACTION_COUNT = sizeof(LOG_ACTIONS) / sizeof(LOG_ACTIONS[0]);
+
+// Convert baud rate number to termios speed
+static speed_t baud_speed(unsigned long baud) {
+    switch (baud) {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+    }
+    return 0;
+}
+
+// Set baud rate of serial port and put it to raw mode
+static int set_baud(int port, unsigned long baud) {
+    termios tty;
+
+    if (tcgetattr(port, &tty) != 0)
+        return -1;
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, baud_speed(baud));
+    cfsetospeed(&tty, baud_speed(baud));
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    return tcsetattr(port, TCSADRAIN, &tty);
+}
+
+// Read one byte from serial port
+// Returns: byte value, or -1 on timeout
+static int read_byte(int port) {
+    unsigned char c;
+    fd_set set;
+    timeval timeout = {READ_TIMEOUT, 0};
+
+    FD_ZERO(&set);
+    FD_SET(port, &set);
+    if (select(port + 1, &set, nullptr, nullptr, &timeout) <= 0)
+        return -1;
+    if (read(port, &c, 1) != 1)
+        return -1;
+    return c;
+}
+
+// CRC-16/CCITT, same as crc16() in firmware
+static unsigned int crc16(unsigned int crc, const unsigned char data[], int length) {
+    int i, bit;
+
+    for (i = 0; i < length; i++) {
+        crc ^= (unsigned int)data[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc & 0xFFFF;
+}
+
+// Read little endian numbers from AVR records
+static unsigned long le32(const unsigned char data[]) {
+    return data[0] | (unsigned long)data[1] << 8 | (unsigned long)data[2] << 16 | (unsigned long)data[3] << 24;
+}
+static int le16(const unsigned char data[]) {
+    return static_cast<short>(data[0] | data[1] << 8);
+}
+
+// Print one record as CSV line
+static void print_record(FILE *out, int kind, const unsigned char record[], int size) {
+    if (kind == DUMP_LOGS && size == 7) {
+        // Time is stored as seconds since 1.1.2000. 00:00:00
+        time_t seconds = static_cast<time_t>(le32(record + 3)) + 946684800;
+        tm *t = gmtime(&seconds);
+        int action = record[2];
+
+        fprintf(
+            out, "%02d-%02d-%04d,%02d:%02d:%02d,%u,%s\n",
+            t->tm_mday, t->tm_mon + 1, t->tm_year + 1900, t->tm_hour, t->tm_min, t->tm_sec,
+            record[0] | record[1] << 8, action < LOG_ACTION_COUNT ? LOG_ACTIONS[action] : "???"
+        );
+    } else if (kind == DUMP_USERS && size == 20) {
+        // Skip deleted users and compaction marks
+        if (le16(record) > 0)
+            fprintf(out, "%d,%d,%.16s\n", le16(record), le16(record + 2), record + 4);
+    } else if (kind == DUMP_SETTINGS && size == 34) {
+        fprintf(out, "%d,%d,\"%.30s\"\n", le16(record), le16(record + 2), record + 4);
+    } else {
+        int i;
+        for (i = 0; i < size; i++)
+            fprintf(out, "%02x", record[i]);
+        fprintf(out, "\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int port;                       // Serial port
+    int kind = -1;                  // Kind of data to dump
+    unsigned long baud = 115200;    // Baud rate used for dump
+    char command[40];               // Dump command sent to console
+    unsigned char frame[260];       // Current frame without SYNC
+    unsigned char expected_seq = 0; // Sequence number of next frame
+    int record_size = 0;            // Size of one record
+    unsigned long count = 0;        // Number of records announced in START frame
+    unsigned long received = 0;     // Number of records received
+    int c, i, errors = 0;
+    FILE *out;
+
+    if (argc >= 4) {
+        if (strcmp(argv[2], "logs") == 0)
+            kind = DUMP_LOGS;
+        else if (strcmp(argv[2], "users") == 0)
+            kind = DUMP_USERS;
+        else if (strcmp(argv[2], "settings") == 0)
+            kind = DUMP_SETTINGS;
+        if (argc >= 5)
+            baud = strtoul(argv[4], nullptr, 10);
+    }
+    if (kind == -1 || baud_speed(baud) == 0) {
+        fprintf(stderr, "Usage: %s <port> logs|users|settings <output.csv> [baud]\n", argv[0]);
+        return 1;
+    }
+
+    port = open(argv[1], O_RDWR | O_NOCTTY);
+    if (port < 0 || set_baud(port, 9600) != 0) {
+        perror("Unable to open serial port");
+        return 1;
+    }
+    out = fopen(argv[3], "w");
+    if (out == nullptr) {
+        perror("Unable to open output file");
+        return 1;
+    }
+
+    // Opening port resets the board, wait for it to start and drop welcome message
+    sleep(3);
+    tcflush(port, TCIOFLUSH);
+
+    // Send command and wait until its response line is received
+    sprintf(command, "dump %s %lu\r", argv[2], baud);
+    write(port, command, strlen(command));
+    i = 0;
+    while ((c = read_byte(port)) != -1) {
+        command[i < 39 ? i++ : i] = c;
+        if (c == '\n') {
+            command[i] = '\0';
+            if (strstr(command, "Switching") != nullptr)
+                break;
+            if (strstr(command, "dump:") != nullptr || strstr(command, "DVDCS:") != nullptr) {
+                fprintf(stderr, "Console: %s", command);
+                return 1;
+            }
+            i = 0;
+        }
+    }
+    if (c == -1) {
+        fprintf(stderr, "No response from console\n");
+        return 1;
+    }
+    tcdrain(port);
+    set_baud(port, baud);
+
+    if (kind == DUMP_LOGS)
+        fprintf(out, "date,time,user_id,action\n");
+    else if (kind == DUMP_USERS)
+        fprintf(out, "id,active,number\n");
+    else
+        fprintf(out, "id,int_value,string_value\n");
+
+    while (true) {
+        // Find start of frame
+        while ((c = read_byte(port)) != -1 && c != DUMP_SYNC);
+        if (c == -1) {
+            fprintf(stderr, "Timeout while waiting for frame\n");
+            return 1;
+        }
+        // Read type, sequence, length, payload and CRC
+        for (i = 0; i < 3 || i < 3 + frame[2] + 2; i++) {
+            if ((c = read_byte(port)) == -1) {
+                fprintf(stderr, "Timeout inside frame\n");
+                return 1;
+            }
+            frame[i] = c;
+        }
+        if (crc16(0xFFFF, frame, 3 + frame[2]) != (unsigned int)(frame[3 + frame[2]] | frame[4 + frame[2]] << 8)) {
+            fprintf(stderr, "CRC error in frame %u\n", frame[1]);
+            ++errors;
+            continue;
+        }
+        if (frame[1] != expected_seq) {
+            fprintf(stderr, "Missing frames %u - %u\n", expected_seq, (unsigned char)(frame[1] - 1));
+            ++errors;
+        }
+        expected_seq = frame[1] + 1;
+
+        if (frame[0] == 'S') {
+            record_size = frame[4];
+            count = le32(frame + 5);
+            if (frame[9] != DUMP_VERSION)
+                fprintf(stderr, "Unknown dump version %u\n", frame[9]);
+            printf("Receiving %lu records of %d bytes\n", count, record_size);
+        } else if (frame[0] == 'D' && record_size > 0) {
+            for (i = 0; i + record_size <= frame[2]; i += record_size)
+                print_record(out, kind, frame + 3 + i, record_size);
+            received += frame[2] / record_size;
+        } else if (frame[0] == 'E') {
+            break;
+        }
+    }
+
+    fclose(out);
+    printf("Received %lu / %lu records, %d errors\n", received, count, errors);
+    return errors != 0 || received != count;
+}
@@ -69,4 +69,19 @@ int strlength(const char string[]);
 ********************************************************************/
 int strstartswith(const char string1[], const char string2[]);
 
+/********************************************************************
+ * crc16 -- Function calculates CRC-16/CCITT (polynomial 0x1021)    *
+ *          of given data, start with crc 0xFFFF and pass result    *
+ *          of previous call to continue calculation                *
+ *                                                                  *
+ * Arguments                                                        *
+ *     crc      -- CRC of data before this block                    *
+ *     data     -- block of data                                    *
+ *     length   -- number of bytes in the block                     *
+ *                                                                  *
+ * Returns                                                          *
+ *     CRC of all data including this block                         *
+********************************************************************/
+unsigned int crc16(unsigned int crc, const unsigned char data[], const int length);
+
 #endif
\ No newline at end of file
@@ -3,83 +3,255 @@
 
 // Include general stuff
 #include "helper_functions.hpp"
+#include "sms_pdu.hpp"
+#include "modem_serial.hpp"
 
 // Define MODEM_DEBUG to turn on debug messages on Serial
 #undef MODEM_DEBUG
 
 // Pin which turns on modem
 #define MODEM_POWER_PIN 9
-// How long to wait for command anwser before reporting error (in ms)
+// How long to wait for startup command before reporting error (in ms), other commands have own timeouts
 #define MODEM_RESPONSE_WAIT 90000
-// Max number of characters to fit in input buffer
-#define BUFFER_SIZE 300
 // Interval on which system should check if modem is OK (in ms)
 #define READY_CHECK_INTERVAL 60000
 // How long to wait before first ready check (in ms)
 #define FIRST_READY_CHECK_WAIT 30000
+// How long to wait for "> " prompt after AT+CMGS before message is dropped (in ms)
+#define SMS_PROMPT_WAIT 5000
 // How many messages should fit into SMS buffer before sending
-#define SMS_BUFFER_SIZE 3
-// Max number of commands that can be put in command queue
-#define CMD_BUFFER_SIZE 10
+// only recipient and message source are queued, PDU is calculated when message is sent
+#define SMS_BUFFER_SIZE 16
+// Number of bytes for messages from RAM in SMS buffer, they are stored one after another in a ring
+// only short replies are kept there (status takes up to 100 bytes), log pages are read from SD card when sent
+#define SMS_TEXT_POOL 224
+// Number of bytes for packed recipient number, each byte holds two digits
+#define SMS_NUMBER_BYTES 10
+// Max number of times message is tried to be sent before it's moved to SMS spool on SD card
+#define SMS_MAX_ATTEMPTS 4
+// Wait before message which failed is sent again (in ms), it doubles after each next failure
+#define SMS_RETRY_BACKOFF 5000
+// Longest wait before message which failed is sent again (in ms)
+#define SMS_RETRY_BACKOFF_MAX 60000
+// Max number of characters in prefix of unsolicited response, including terminating zero
+#define UNSOLICITED_PREFIX_SIZE 12
+// Max number of commands that can be put in command queue, each command object is queued
+// at most once, so this is the number of command objects (startup, check, sms, delay, config, inbox)
+#define CMD_BUFFER_SIZE 6
+// Number of command priority classes
+#define CMD_PRIORITY_CLASSES 5
+// How long command waits in queue before it moves one priority class up (in ms)
+#define CMD_AGING_INTERVAL 15000
+// Number of command types in timeout policy table
+#define CMD_TYPE_COUNT 6
+// Max number of messages handled from one AT+CMGL listing, rest are handled by next one
+#define INBOX_BATCH_SIZE 8
 // If set to 1 modem will reply with sms message when executing sms command
 #define SMS_REPLY 1
-// Number of logs on log page send in sms message
-#define SMS_LOG 3
+// Number of commands one sender can send at once, used if SETTING_SMS_RATE_BURST is not set
+#define SMS_RATE_BURST 3
+// Seconds after which sender can send one more command, used if SETTING_SMS_RATE_INTERVAL is not set
+#define SMS_RATE_INTERVAL 20
+// Seconds in which the same command from the same sender gets only one reply, used if SETTING_SMS_DUP_WINDOW is not set
+#define SMS_DUP_WINDOW 30
+// Longest duplicate window in seconds
+#define SMS_DUP_WINDOW_MAX 255
+// Number of senders rate limiter keeps track of, each takes 7 bytes of RAM
+// Sender with full bucket and no duplicate window has nothing to remember, so slots are taken only
+// by senders who sent commands recently, this should cover whole crew answering a call-out
+#define SMS_SENDER_SLOTS 24
+// Number of logs on log page send in sms message, long pages are sent as concatenated SMS
+#define SMS_LOG 10
+// Max number of characters in one line of log page send in sms message, including terminating zero
+// page is made one line at a time while PDU is calculated, so whole page is never in RAM
+#define SMS_LOG_LINE 48
+
+// Message waiting in SMS buffer
+struct sms_queue_record {
+    uint8_t number[SMS_NUMBER_BYTES];       // Recipient number, two digits per byte, 0xF after last digit
+    const __FlashStringHelper *flash_text;  // Message stored in flash, or NULL if message is in text pool
+    int text_offset;                        // Offset of message in text pool, or -1 if message is in flash
+    uint8_t log_page;                       // 1 if text pool holds log_page_request instead of message text
+    uint8_t attempts;                       // Number of times sending of message failed
+    uint8_t part;                           // Part of message sent next, parts before it were already sent
+    uint8_t reference;                      // Reference number shared by all parts, set when first part is sent
+    uint8_t urgent;                         // 1 if message is sent before all messages which are not urgent
+    unsigned long retry_at;                 // millis() after which message can be sent again, if attempts is not 0
+    unsigned long queued_at;                // millis() when message was queued, stays the same when message is retried
+};
+
+// Page of logs waiting in SMS buffer, text is read from SD card each time message part is calculated
+// records logged after request are skipped, so all parts show the same page
+struct log_page_request {
+    unsigned long log_count;    // Number of logs on requested date when page was requested
+    unsigned long page;         // Requested page, counts from 1
+    uint16_t year;              // Date of logs, day and month are 0 for page of all logs
+    uint8_t day;
+    uint8_t month;
+};
+
+// Text of log page, each line is read from SD card when builder gets to it
+class log_page_text : public message_source {
+    private:
+        log_page_request request;   // Page which is made
+        unsigned long position;     // Position of first log on the page, 0 is last log
+        unsigned int count;         // Number of logs on the page
+        unsigned int line;          // Line in buffer, line after last log is page number
+        int line_start;             // Position in text of first character in buffer
+        char buffer[SMS_LOG_LINE];  // Current line
+        // Write given line to buffer, buffer is empty after page number
+        void make_line(unsigned int line_number);
+    public:
+        // Default constructor, text is empty until request is set
+        log_page_text();
+        // Set page of logs which is made
+        void set_request(const log_page_request &page_request);
+        // Get character at given position of text, or '\0' after last character
+        uint8_t read_byte(int text_position);
+};
+
+// Rate limiter state of one sender of SMS commands
+struct sender_record {
+    int user_id;                // User who sent commands, USER_DELETED if slot is free
+    unsigned int command;       // CRC-16 of last executed command
+    uint8_t tokens;             // Number of commands user can send right now
+    uint8_t window;             // Seconds left in which last command is suppressed as duplicate
+    uint8_t suppressing;        // 1 if suppression was logged since last executed command
+};
+
+// Priority classes of modem commands, lower class is executed first
+enum cmd_priorities {
+    PRIORITY_STARTUP,           // Modem startup and configuration, everything else depends on it
+    PRIORITY_EMERGENCY,         // Acknowledgement that siren has started
+    PRIORITY_REPLY,             // Replies to user commands
+    PRIORITY_HEALTH,            // Periodic modem checks
+    PRIORITY_MAINTENANCE        // Delays after errors
+};
+
+// Types of modem commands, each has its own row in timeout policy table
+enum cmd_types {
+    CMD_STARTUP,                // startup_cmd
+    CMD_CHECK,                  // check_cmd
+    CMD_SMS,                    // sms_cmd
+    CMD_DELAY,                  // delay_cmd
+    CMD_CONFIG,                 // config_cmd
+    CMD_INBOX                   // inbox_cmd
+};
+
+// Timeout and retry policy of command type, table of them is stored in PROGMEM
+struct cmd_policy {
+    unsigned long timeout;      // How long command can execute before it times out (in ms), 0 if it ends by itself
+    unsigned long part_timeout; // Time added to timeout of each part command sends (in ms)
+    uint8_t retries;            // How many times command is executed again after timeout
+    unsigned int backoff;       // Wait before first retry (in ms), it doubles for each next retry
+};
 
 // Template for indicators send by modem
 class unsolicited_response {
-    private:
-        // Array to store string with which respons starts
-        char res_starts_with[40];
-    protected:
-        // Set string with which response starts
-        void set_start(const char start[]);
     public:
         // 1 if handler is done, 0 if it's not
         int is_done;
         // Default constructor
         unsolicited_response();
-        // Test if given response belongs to this class
-        int test(const char response[]);
         // Check if this handler is done taking input
         int done();
         // Execute code to handle response
         virtual void execute(const char response[]) {}
 };
 
+// Handler for responses starting with given prefix, table of them is stored in PROGMEM
+struct unsolicited_entry {
+    char prefix[UNSOLICITED_PREFIX_SIZE];   // String with which response starts
+    unsolicited_response *handler;          // Handler which executes response
+};
+
 // Template for commands send to modem to perform an action or request data
 class at_command {
     private:
-        unsigned long execution_start;  // millis() when command execution started
+        unsigned long execution_start;  // millis() when current attempt (or wait before retry) started
+        unsigned long budget;           // How long current attempt can take (in ms), 0 if there is no limit
+        uint8_t attempt;                // Number of retries in current execution
+        uint8_t backing_off;            // 1 if command waits before it's sent again
+        uint8_t resent;                 // 1 if command was sent again and its echo didn't arrive yet
+        unsigned long timeouts;         // Number of attempts which timed out
+        unsigned long retries;          // Number of attempts sent again after timeout
     protected:
         int is_done;                    // 1 if command execution is done 0 if not
+        uint8_t type;                   // Type of command, one of cmd_types
         // Send command to serial
         virtual void send_to_serial() {}
+        // Called when command runs out of budget and it won't be sent again
+        virtual void timeout() {}
+        // Start budget of attempt from policy table, commands which send parts one by one
+        // start it again for each part
+        void restart_budget();
     public:
         // Default constructor
         at_command();
         // Returns 1 if command is done executing, or 0 if not
         int done();
+        // Returns 1 if current attempt ran out of budget
+        int expired();
+        // Handle attempt which ran out of budget, command waits and it's sent again
+        // if policy allows it, else timeout error is set and command is done
+        void expire();
+        // Returns 1 if command waits before it's sent again, responses to timed out attempt are ignored
+        int retry_pending();
+        // Returns 1 if wait before command is sent again is over
+        int backoff_over();
+        // Send command again after wait
+        void resend();
+        // Returns 1 if command was sent again and lines are ignored until its echo arrives,
+        // late responses to timed out attempt would be taken as responses to the new one
+        int echo_pending();
+        // Mark that echo of command sent again arrived
+        void echo_received();
         // Start command execution
         void execute();
+        // Get type of command, one of cmd_types
+        uint8_t get_type();
+        // Get number of attempts which timed out
+        unsigned long get_timeouts();
+        // Get number of attempts sent again after timeout
+        unsigned long get_retries();
         // Push command result to the command so ot can be handled
         virtual void push_line(const char line[]) {}
+        // Push "> " prompt to the command, modem sends it without line end when it waits for data
+        virtual void push_prompt() {}
         // If command needs to update in each cicle update it, else skip update
         virtual void update() {}
 };
 
+// Command waiting in command queue
+struct cmd_queue_record {
+    at_command *cmd;            // Command waiting to be executed
+    uint8_t priority;           // Priority class, one of cmd_priorities
+    unsigned long queued;       // millis() when command was queued
+};
+
 // Main class used for executing commands and manipulationg with modem
 class modem_manipulation {
     private:
-        char buffer[BUFFER_SIZE];                // Array to store characters arrived over serial
-        int current_ch;                          // Current index of buffer array
-        int cmd_getter;                          // Index where next cmd should be taken from cmd_buffer
-        int cmd_setter;                          // Index where next cmd should be stored in cmd_buffer
-        at_command *current_cmd;                 // Pointer to current command
-        at_command *cmd_buffer[CMD_BUFFER_SIZE]; // Pointers to commands waiting to be executed
-        int handler_count;                       // Counts how many handlers has been added
-        unsolicited_response *handlers[10];      // Array of handlers for unsolicited responses
-        unsigned long check_start;               // When was last modem OK check performed
+        int cmd_count;                                  // Number of commands in cmd_buffer
+        at_command *current_cmd;                        // Pointer to current command
+        cmd_queue_record cmd_buffer[CMD_BUFFER_SIZE];   // Commands waiting to be executed, oldest first
+        unsolicited_response *active_handler;           // Handler waiting for more lines, or NULL
+        unsigned long check_start;                      // When was last modem OK check performed
+
+        int cmd_max_depth;                              // Most commands waiting at once
+        unsigned long cmd_coalesced;                    // Number of commands not queued because they were already waiting
+        unsigned long wait_count[CMD_PRIORITY_CLASSES]; // Number of executed commands of each class
+        unsigned long wait_total[CMD_PRIORITY_CLASSES]; // Sum of ms commands of each class waited in queue
+        unsigned long wait_max[CMD_PRIORITY_CLASSES];   // Longest wait in queue of each class
+
+        // Find handler with longest prefix matching line
+        // Returns: pointer to handler, or NULL if there is none
+        unsolicited_response * find_handler(const char line[]);
+        // Get priority class of waiting command, it moves one class up each CMD_AGING_INTERVAL
+        // but never above replies, so emergency and startup commands keep their place
+        uint8_t current_priority(int index);
+        // Remove command from queue and execute it
+        void execute_queued(int index);
     public:
         // Default constructor
         modem_manipulation();
@@ -89,10 +261,22 @@ class modem_manipulation {
         void start();
         // Run dynamic actions
         void update();
-        // Run specific command
-        void run_cmd(at_command &cmd);
-        // Add unsolicited response handler
-        void add_handler(unsolicited_response &handler);
+        // Run specific command, or queue it if other command is executing
+        // command which is already waiting is not queued again, it only gets higher priority if needed
+        //    cmd      -- command to run
+        //    priority -- priority class, one of cmd_priorities
+        void run_cmd(at_command &cmd, uint8_t priority);
+
+        // Get number of commands waiting in queue
+        int get_queue_depth();
+        // Get most commands waiting in queue at once
+        int get_queue_max_depth();
+        // Get number of commands not queued because they were already waiting
+        unsigned long get_queue_coalesced();
+        // Get number of executed commands, average and longest wait in queue in ms, for priority class
+        unsigned long get_wait_count(uint8_t priority);
+        unsigned long get_wait_avg(uint8_t priority);
+        unsigned long get_wait_max(uint8_t priority);
 };
 
 extern modem_manipulation modem;
@@ -147,17 +331,59 @@ class sms_cmd : public at_command {
     private:
         enum responses {
             COMMAND_ECHO,    // Waiting to receive command echo
+            PROMPT,          // Waiting for "> " prompt to send PDU
             PDU_ECHO,        // Waiting to receive PDU echo
             MSG_INFO,        // Information about message send
             FINAL_OK         // Waiting to receive final OK
         } currently_waiting;
 
-        char pdu[SMS_BUFFER_SIZE][BUFFER_SIZE]; // SMS PDU buffer waiting to be send
-        int tpdu_length[SMS_BUFFER_SIZE];       // Size of TPDU for each PDU in the queue
-        int getter;                             // Index where is next pdu to read or -1 if there is nothing to read
-        int setter;                             // Index where next pdu is to be placed
+        sms_queue_record queue[SMS_BUFFER_SIZE];// Messages waiting to be send
+        int getter;                             // Index where is next message to read or -1 if there is nothing to read
+        int setter;                             // Index where next message is to be placed
+        char text_pool[SMS_TEXT_POOL];          // Messages from RAM waiting to be send
+        int text_head;                          // Offset in text pool where next message is placed
+        int part_count;                         // Number of parts of message currently being send
+        uint8_t reference;                      // Reference number of last concatenated message
+        unsigned long overflows;                // Number of messages dropped because SMS buffer was full
+
+        unsigned long submit_start;             // millis() when AT+CMGS was sent
+        unsigned long prompt_time;              // millis() when prompt arrived
+        unsigned long prompt_count;             // Number of prompts received
+        unsigned long prompt_wait_total;        // Sum of ms waited for all prompts
+        unsigned long prompt_wait_max;          // Longest wait for prompt
+        unsigned long prompt_timeouts;          // Number of messages dropped because prompt did not arrive
+        unsigned long sent_count;               // Number of messages sent
+        unsigned long submit_total;             // Sum of ms from AT+CMGS to final OK for all sent messages
+        unsigned long submit_max;               // Longest time from AT+CMGS to final OK
+        int retry_wait;                         // 1 if messages are left in queue after failure or wait for retry
+        unsigned long attempt_histogram[SMS_MAX_ATTEMPTS]; // Number of messages sent on each attempt
+        unsigned long spooled;                  // Number of messages moved to SMS spool
+        unsigned long latency_count;            // Number of messages which latency was measured
+        unsigned long latency_total;            // Sum of ms from queuing message to final OK of its last part
+        unsigned long latency_max;              // Longest time from queuing message to final OK of its last part
+        int queue_peak;                         // Most messages waiting in SMS buffer at once
 
         void send_to_serial();                  // Send command to serial
+        // Set recipient and text of first message in the queue to builder, page is used if it's log page
+        void set_builder(builder &new_pdu, log_page_text &page);
+        void timeout();                         // Handle message which ran out of time
+        void next_message();                    // Remove first message from the queue
+        // Move first message to the end of queue to be sent again after backoff,
+        // or to SMS spool if it failed too many times or there is no space for it
+        void fail_message();
+        // Store first message to SMS spool
+        void spool_message();
+        // Move newest count messages in front of all messages which are not urgent and mark them urgent
+        //    keep_first -- 1 if first message is being sent and must stay first
+        void promote(int count, int keep_first);
+        // Unpack recipient of message in the queue
+        void unpack_number(int index, char number[]);
+        // Reserve place for the message in text pool
+        // Returns: offset of reserved place, or -1 if there is no space
+        int text_alloc(int size);
+        // Add recipient to the message at setter position
+        // Returns: 1 if message can be added, or 0 if buffer is full
+        int add_recipient(const char number[]);
     public:
         // Default constructor
         sms_cmd();
@@ -165,12 +391,52 @@ class sms_cmd : public at_command {
         void add_message(const char number[], const char message[]);
         // Add new message to queue, but message is stored in flash
         void add_message(const char number[], const __FlashStringHelper *message);
+        // Add page of logs to queue, it's read from SD card when message is sent
+        void add_log_page(const char number[], const log_page_request &request);
+        // Send newest count messages before others, after message being sent and earlier urgent messages
+        void make_urgent(int count);
         // Clear message queue
         void clear();
         // Handle response from serial
         void push_line(const char line[]);
+        // Send PDU when modem asks for it
+        void push_prompt();
+        // Send message again later if prompt does not arrive in time
+        void update();
+        // Stop sending when commands are cleared, messages left in queue are sent again by modem update
+        void stop();
+        // Check if messages left in queue after failure can be sent, check is done only once
+        // Returns: 1 if command should be run again, or 0 if it shouldn't
+        int retry_due();
+
+        // Get number of messages sent
+        unsigned long get_sent_count();
+        // Get number of messages waiting in SMS buffer
+        int get_queued_count();
+        // Get number of messages dropped because SMS buffer was full
+        unsigned long get_overflows();
+        // Get number of messages dropped because prompt did not arrive
+        unsigned long get_prompt_timeouts();
+        // Get average and longest wait for prompt in ms
+        unsigned long get_prompt_wait_avg();
+        unsigned long get_prompt_wait_max();
+        // Get average and longest time from AT+CMGS to final OK in ms
+        unsigned long get_submit_avg();
+        unsigned long get_submit_max();
+        // Get number of messages sent on given attempt, first attempt is 0
+        unsigned long get_attempt_count(int attempt);
+        // Get number of messages moved to SMS spool
+        unsigned long get_spooled();
+        // Get average and longest time from queuing message to final OK of its last part in ms,
+        // message is queued while incoming SMS is handled, so this is end-to-end reply latency
+        unsigned long get_latency_avg();
+        unsigned long get_latency_max();
+        // Get most messages waiting in SMS buffer at once
+        int get_queue_peak();
 };
 
+extern startup_cmd startup_modem;
+extern check_cmd check_modem;
 extern sms_cmd sms_modem;
 
 // Modem command used to pause execution of any command executed after it
@@ -192,6 +458,8 @@ class delay_cmd : public at_command {
         void update();
 };
 
+extern delay_cmd delay_modem;
+
 // Modem command used to perform initial configuration
 class config_cmd : public at_command {
     private:
@@ -199,6 +467,7 @@ class config_cmd : public at_command {
             COMMAND_ECHO,          // Waiting to receive command echo
             FINAL_OK               // Waiting to receive final OK
         } currently_waiting;
+        int inbox_mode;            // 1 if messages are stored in SIM inbox, 0 if they are pushed with +CMT
 
         void send_to_serial();     // Send command to serial
     public:
@@ -208,6 +477,81 @@ class config_cmd : public at_command {
         void push_line(const char line[]);
 };
 
+extern config_cmd config_modem;
+
+// Modem command used to read messages stored in SIM inbox, messages are
+// handled in batches and deleted from SIM after their replies are queued
+class inbox_cmd : public at_command {
+    private:
+        enum responses {
+            COMMAND_ECHO,          // Waiting to receive command echo
+            LIST,                  // Waiting to receive +CMGL line or final OK
+            PDU,                   // Waiting to receive PDU of listed message
+            DELETE_ECHO,           // Waiting to receive echo of AT+CMGD
+            DELETE_OK              // Waiting to receive final OK of AT+CMGD
+        } currently_waiting;
+        int indexes[INBOX_BATCH_SIZE]; // SIM indexes of handled messages, they are deleted after list ends
+        int count;                 // Number of handled messages in indexes
+        int deleted;               // Number of handled messages already deleted
+        int current;               // SIM index of message which PDU is expected, -1 if PDU is skipped
+        int listed;                // Number of messages listed by current AT+CMGL
+        int backlog;               // Number of messages waiting in SIM inbox
+        unsigned long read_total;  // Number of messages handled from SIM inbox
+
+        void send_to_serial();     // Send command to serial
+        void delete_next();        // Delete next handled message, or finish if all are deleted
+        void fail();               // Handle ERROR response
+    public:
+        // Default constructor
+        inbox_cmd();
+        // Handle response from serial
+        void push_line(const char line[]);
+        // Count message modem stored in SIM inbox
+        void notify();
+
+        // Get number of messages waiting in SIM inbox
+        int get_backlog();
+        // Get number of messages handled from SIM inbox
+        unsigned long get_read_count();
+};
+
+extern inbox_cmd inbox_modem;
+
+// Token bucket and duplicate filter for commands received by SMS, kept for each sender
+class sender_limiter {
+    private:
+        sender_record senders[SMS_SENDER_SLOTS];    // Senders which sent commands recently
+        unsigned long refill_start;                 // millis() when tokens were last added
+        unsigned long tick_start;                   // millis() when duplicate windows were last shortened
+        unsigned long duplicates;                   // Number of commands suppressed as duplicates
+        unsigned long limited;                      // Number of commands suppressed by token bucket
+        // Get limits from settings, or defaults if they are not set
+        uint8_t burst_setting();
+        unsigned long interval_setting();           // In ms
+        uint8_t window_setting();
+        // Find record of user, or take free one
+        // If all are taken, sender with most tokens is forgotten, so senders which are limited stay
+        sender_record & find_sender(int user_id, uint8_t burst);
+        // Count and log suppressed command
+        void suppress(sender_record &sender);
+    public:
+        // Default constructor
+        sender_limiter();
+        // Check if recognised command sent by user can be executed, suppressed commands get no reply
+        // Returns: 1 if command can be executed, or 0 if it's suppressed
+        int allow(int user_id, const char command[]);
+        // Add tokens earned since last update to all senders, shorten duplicate windows
+        // and free slots of senders which have nothing to remember
+        void update();
+
+        // Get number of commands suppressed because the same command was executed in duplicate window
+        unsigned long get_duplicates();
+        // Get number of commands suppressed because sender ran out of tokens
+        unsigned long get_limited();
+};
+
+extern sender_limiter sms_limiter;
+
 // Unsolicited response handler, activated when new sms message arrives
 class delivery_res : public unsolicited_response {
     public:
@@ -217,6 +561,15 @@ class delivery_res : public unsolicited_response {
         void execute(const char response[]);
 };
 
+// Unsolicited response handler, activated when new sms message is stored in SIM inbox
+class inbox_res : public unsolicited_response {
+    public:
+        // Default constructor
+        inbox_res();
+        // Execute code to handle response
+        void execute(const char response[]);
+};
+
 // Unsolicited response handler, activated when modem rings
 class ring_res : public unsolicited_response {
     public:
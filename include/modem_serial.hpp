@@ -0,0 +1,65 @@
+#ifndef _INCLUDE_MODEM_SERIAL_HPP_
+#define _INCLUDE_MODEM_SERIAL_HPP_
+
+// Include general stuff
+#include "helper_functions.hpp"
+// Include global header files
+#include <Arduino.h>
+
+// Number of bytes in receive ring, each line is kept in one piece so longest line (+CMT PDU) must fit
+#define MODEM_RX_RING_SIZE 512
+// Max number of complete lines waiting in receive ring, must be power of 2
+#define MODEM_RX_LINES 32
+// Number of bytes in transmit ring
+#define MODEM_TX_RING_SIZE 64
+
+// Serial connection to modem on USART3, received characters are framed into lines by interrupt
+// Interrupt writes lines and main loop reads them in place, only one side writes each variable
+class modem_serial_class : public Print {
+    private:
+        char rx_ring[MODEM_RX_RING_SIZE];       // Received lines, each line ends with '\0'
+        uint16_t rx_starts[MODEM_RX_LINES];     // Start of each complete line in ring (interrupt only)
+        uint16_t rx_head;                       // Where next received character is written (interrupt only)
+        uint16_t rx_line_start;                 // Start of line being received (interrupt only)
+        volatile uint8_t rx_lines_in;           // Number of complete lines, wraps around (interrupt only)
+        volatile uint8_t rx_lines_out;          // Number of released lines, wraps around (main loop only)
+        uint8_t rx_dropping;                    // 1 if rest of current line is dropped
+        volatile unsigned long rx_overflows;    // Number of lines dropped because ring was full
+        volatile uint16_t rx_max_used;          // Most bytes of ring used at once
+        uint8_t tx_ring[MODEM_TX_RING_SIZE];    // Characters waiting to be sent
+        volatile uint8_t tx_head;               // Where next character to send is written
+        volatile uint8_t tx_tail;               // Where next character is sent from
+        // Store received character in current line
+        // Returns: 1 if character is stored, or 0 if there is no space
+        uint8_t rx_put(char ch);
+        // Finish current line so main loop can read it
+        void rx_end_line();
+    public:
+        // Default constructor
+        modem_serial_class();
+        // Set baud rate and turn on receiver and transmitter
+        void begin(unsigned long baud);
+        // Get oldest complete line, line stays valid until release_line() is called
+        // Returns: pointer to line, or NULL if there is no complete line
+        const char * read_line();
+        // Release line returned by read_line(), so its space can be used again
+        void release_line();
+        // Drop all received lines and line being received
+        void clear();
+        // Get number of lines dropped because receive ring was full
+        unsigned long get_overflows();
+        // Get most bytes of receive ring used at once
+        uint16_t get_max_used();
+        // Send character, waits if transmit ring is full
+        size_t write(uint8_t ch);
+        using Print::write;
+
+        // Called by USART3 receive interrupt for each received character
+        void receive(uint8_t ch);
+        // Called by USART3 data register empty interrupt to send next character
+        void transmit();
+};
+
+extern modem_serial_class modem_serial;
+
+#endif
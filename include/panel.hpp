@@ -143,6 +143,8 @@ extern panel main_panel;
 
 // Home page
 class home_page_class : public menu_page_class {
+    private:
+        int last_second;    // Second currently on display, -1 if time is not printed yet
     public:
         home_page_class();
         void print();
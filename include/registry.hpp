@@ -0,0 +1,92 @@
+#ifndef _INCLUDE_REGISTRY_HPP_
+#define _INCLUDE_REGISTRY_HPP_
+
+// Include general stuff
+#include "helper_functions.hpp"
+// Include global header files
+#include <Arduino.h>
+
+// How many characters can fit in command keyword, including terminating zero
+#define COMMAND_KEYWORD_SIZE 12
+
+// What can follow command keyword
+enum command_args {
+    COMMAND_NO_ARGS,            // Keyword must be whole command
+    COMMAND_ARGS,               // Keyword must be followed by space and arguments
+    COMMAND_ANY_ARGS            // Arguments are optional
+};
+
+// Who is allowed to run command, higher level can run everything lower level can
+enum command_permissions {
+    PERMISSION_USER,            // Active user sending SMS
+    PERMISSION_ADMIN            // Admin on USB console
+};
+
+struct command_entry;
+
+// Data passed to command handler
+struct command_call {
+    const command_entry *entry; // Matched command (copy in RAM)
+    const char *args;           // Arguments after keyword, empty string if there are none
+    int user_id;                // ID of user who sent command, 0 for console
+    const char *number;         // Number of user who sent command, NULL for console
+};
+
+// Function called when command is matched
+typedef void (*command_handler)(const command_call &call);
+
+// Single row of command table, tables are stored in PROGMEM
+struct command_entry {
+    char keyword[COMMAND_KEYWORD_SIZE]; // Keyword in lower case
+    uint8_t args;                       // What can follow keyword, one of command_args
+    uint8_t permission;                 // Permission needed to run command, one of command_permissions
+    char log[4];                        // Action code handler logs, empty if handler logs nothing or picks it itself
+    command_handler handler;            // Function which runs command
+};
+
+// Check at compile time if keyword a sorts before keyword b
+constexpr int keyword_before(const char *a, const char *b) {
+    return (*a != *b) ? ((uint8_t)*a < (uint8_t)*b) : (*a != '\0' && keyword_before(a + 1, b + 1));
+}
+// Check at compile time if keyword has no upper case letters
+constexpr int keyword_lower(const char *keyword) {
+    return *keyword == '\0' || ((*keyword < 'A' || *keyword > 'Z') && keyword_lower(keyword + 1));
+}
+// Check at compile time if rows from given one to the end are sorted, keywords are unique and in lower case
+// each command table is checked with static_assert, row out of order would never be found
+constexpr int command_table_sorted(const command_entry table[], int count, int row) {
+    return row >= count || (keyword_lower(table[row].keyword) &&
+        (row + 1 >= count || keyword_before(table[row].keyword, table[row + 1].keyword)) &&
+        command_table_sorted(table, count, row + 1));
+}
+
+// Registry used to find and run commands from table of command_entry rows
+// Rows must be sorted by keyword, rows with same first character are searched one by one
+class command_registry {
+    private:
+        const command_entry *table;     // Table of commands in PROGMEM
+        int count;                      // Number of rows in table
+        // Find first row which keyword starts with given character (or with first greater one)
+        int bucket(char first);
+        // Check if text matches keyword and arguments of row
+        // Returns: pointer to arguments if it matches, or NULL if it doesn't
+        const char * match(int row, const char text[]);
+    public:
+        // Create registry for given table
+        command_registry(const command_entry table_rows[], int row_count);
+        // Find command matching text which caller is allowed to run, keyword is matched regardless of case
+        //    text       -- whole command with arguments
+        //    permission -- permission of caller, one of command_permissions
+        //    args       -- set to arguments of matched command
+        // Returns: row of matched command, or -1 if it's not found or caller is not allowed to run it
+        int find(const char text[], uint8_t permission, const char **args);
+        // Find command matching text and run it, keyword is matched regardless of case
+        //    text       -- whole command with arguments
+        //    permission -- permission of caller, one of command_permissions
+        //    user_id    -- ID of user who sent command, 0 for console
+        //    number     -- number of user who sent command, NULL for console
+        // Returns: 1 if command is found and run, or 0 if it's not found
+        int run(const char text[], uint8_t permission, int user_id, const char number[]);
+};
+
+#endif
@@ -5,15 +5,47 @@
 #include "helper_functions.hpp"
 
 // How many characters can fit on builder pdu buffer
-#define BUILDER_BUFFER 300
+#define BUILDER_BUFFER 320
+// Max number of characters in message which is sent as single SMS
+#define SMS_SINGLE_LENGTH 160
+// Max number of characters in each part of concatenated SMS, 7 septets are taken by User Data Header
+#define SMS_PART_LENGTH 153
+// Same limits for messages encoded as UCS-2, 6 octets of each part are taken by User Data Header
+#define SMS_UCS2_SINGLE_LENGTH 70
+#define SMS_UCS2_PART_LENGTH 67
+// Set to 1 to send messages with characters outside ASCII (UTF-8 in RAM or FLASH) as UCS-2
+// if that doesn't take more SMS messages, otherwise such characters are replaced by ASCII base letter
+#define BUILDER_UCS2 1
+
+// Message which is made while builder reads it, used for messages too long to keep whole in RAM
+// builder reads characters from the start to the end, it goes back only to the start of message
+class message_source {
+    public:
+        // Get character at given position of message, or '\0' after last character
+        virtual uint8_t read_byte(int position) = 0;
+};
 
 // Builder class used to calculate SMS pdu for given number and message
 // this pdu can than be send by modem in pdu mode
 class builder {
     private:
-        char number[20];               // Receiver number
-        char message[170];             // Message to be encoded
-        char encoded[BUILDER_BUFFER];  // Calculated PDU
+        char number[20];                          // Receiver number
+        const char *message_ram;                  // Whole message if it's stored in RAM, or NULL
+        const __FlashStringHelper *message_flash; // Whole message if it's stored in FLASH, or NULL
+        message_source *message_made;             // Whole message if it's made while it's read, or NULL
+        int message_length;                       // Number of characters in whole message
+        int ucs2;                                 // 1 if message is encoded as UCS-2, 0 for GSM 7-bit
+        int part;                                 // Part of message to encode, counts from 0
+        uint8_t reference;                        // Reference number shared by all parts of message
+        char message[170];                        // Characters of current part
+        char encoded[BUILDER_BUFFER];             // Calculated PDU
+        // Read one byte of whole message from RAM or FLASH
+        uint8_t read_byte(int position);
+        // Read one character of whole message, UTF-8 sequences are read as single character
+        // Returns: Unicode code of character, position is moved to next character
+        unsigned int read_char(int &position);
+        // Count characters of message and choose encoding
+        void set_message_info();
     public:
         // Default constructor
         builder();
@@ -25,7 +57,14 @@ class builder {
         void set_message(const char msg[]);
         // Set message to be encoded bit message is stored in FLASH
         void set_message(const __FlashStringHelper *msg);
-        // Calculate PDU for given information
+        // Set message to be encoded but message is made while it's read
+        void set_message(message_source &msg);
+        // Get number of SMS messages needed to send whole message
+        int get_part_count();
+        // Set which part of long message is encoded by calculate() and reference number
+        // which tells receiver which parts belong to the same message
+        void set_part(int part_number, uint8_t ref);
+        // Calculate PDU for given information, message must not be changed or freed before that
         void calculate();
         // Return pointer to calculated PDU
         const char * get_pdu();
@@ -52,6 +91,8 @@ class parser {
         const char * get_number();
         // Get message decoded from given PDU
         const char * get_message();
+        // Convert decoded message to lower case, so commands can be matched regardless of case
+        void to_lower();
 };
 
 #endif
\ No newline at end of file
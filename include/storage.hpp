@@ -6,6 +6,7 @@
 
 // Include Global header files needed
 #include <Arduino.h>
+#include <SD.h>
 #include <ThreeWire.h>
 #include <RtcDS1302.h>
 
@@ -13,8 +14,55 @@
 #define DATA_DIR "DATA"
 
 #define SETTINGS_FILE   DATA_DIR "/SETTINGS.BIN"
-#define LOG_FILE        DATA_DIR "/LOGS.BIN"
+#define LOG_FILE        DATA_DIR "/LOGPACK.BIN"
+#define LOG_V1_FILE     DATA_DIR "/LOGRING.BIN"
+#define OLD_LOG_FILE    DATA_DIR "/LOGS.BIN"
+#define LOG_DAYS_FILE   DATA_DIR "/LOGDAYS.BIN"
 #define USERS_FILE      DATA_DIR "/USERS.BIN"
+#define USERS_NEW_FILE  DATA_DIR "/USERS.NEW"
+#define SMS_SPOOL_FILE  DATA_DIR "/SMSDEAD.BIN"
+
+// Max number of records in newly created log file, when log is full oldest records are overwritten
+#define LOG_CAPACITY 10000UL
+// Max number of records printed at once when long list of log records is printed
+#define LOG_PAGE_SIZE 10
+// Version of log file format, version 1 files are converted on boot
+#define LOG_VERSION 2
+// Day number used when day is not known
+#define LOG_NO_DAY 0xFFFFFFFFUL
+// Max number of log records waiting in RAM to be written to SD card
+// Staged records are written when buffer is full, at the end of each loop() pass (storage.update()),
+// and before log is read or cleared, so at most LOG_STAGE_SIZE records logged during
+// last loop() pass can be lost if power is lost
+#define LOG_STAGE_SIZE 8
+
+// Files are kept open, they are synced after each write and every STORAGE_SYNC_INTERVAL ms
+// After SD read or write error files are opened again on the same interval
+#define STORAGE_SYNC_INTERVAL 30000UL
+
+// Time is read from software clock driven by millis(), it is corrected from RTC every
+// SETTING_RTC_SYNC_INTERVAL seconds, this value is used if setting is not set
+#define RTC_SYNC_INTERVAL 60
+// Max number of seconds software clock and RTC can differ at sync, RTC is considered faulty if difference is bigger
+#define RTC_DRIFT_LIMIT 5
+
+// Number of slots in the user number index, each slot takes 2 bytes of RAM
+#define USER_INDEX_SIZE 400
+// Max number of users index can hold, if there are more users lookups fall back to file scan
+#define USER_INDEX_MAX_USERS (USER_INDEX_SIZE / 4 * 3)
+
+// Deleted users are left in users file as tombstones until users file is compacted
+// Compaction starts when there are at least USER_COMPACT_MIN tombstones and they
+// take at least USER_COMPACT_RATIO percent of users file
+#define USER_COMPACT_MIN 4
+#define USER_COMPACT_RATIO 25
+// Number of records compaction copies in one loop() pass
+#define USER_COMPACT_SLICE 8
+
+// Max number of messages in spool of SMS messages which could not be sent, oldest are overwritten
+#define SMS_SPOOL_CAPACITY 32
+// Max number of characters of message stored in spool, longer messages are cut
+#define SMS_SPOOL_TEXT 106
 
 // Definitions of setting IDs
 enum setting_ids {
@@ -23,12 +71,41 @@ enum setting_ids {
     SETTING_SETTINGS_AUTH,    // 2 - boolean, request PIN to access settings
     SETTING_MOTD,             // 3 - string to be displayed as custom MOTD
     SETTING_NEXT_USER_ID,     // 4 - smallest not used user ID
-    SETTING_LAST_LIGHT_STATE  // 5 - Last known state of light
+    SETTING_LAST_LIGHT_STATE, // 5 - Last known state of light
+    SETTING_RTC_SYNC_INTERVAL,// 6 - Seconds between software clock syncs with RTC, 0 for default
+    SETTING_SMS_INBOX,        // 7 - boolean, read SMS messages from SIM inbox instead of having them pushed
+    SETTING_SMS_RATE_BURST,   // 8 - Commands one sender can send at once, 0 for default
+    SETTING_SMS_RATE_INTERVAL,// 9 - Seconds after which sender can send one more command, 0 for default
+    SETTING_SMS_DUP_WINDOW,   // 10 - Seconds (up to 255) in which the same command from the same sender is ignored, 0 for default
+    SETTING_COUNT             // Number of settings, keep this one last
+};
+
+// Actions which can be logged, value is stored in log file so new actions must be added at the end
+enum log_actions {
+    LOG_ACTION_UNKNOWN,       // 0 - Action code not known to this firmware
+    LOG_ACTION_VMO,           // 1 - Open small door
+    LOG_ACTION_VMZ,           // 2 - Close small door
+    LOG_ACTION_VVO,           // 3 - Open big door
+    LOG_ACTION_VVZ,           // 4 - Close big door
+    LOG_ACTION_PMO,           // 5 - Override small door open
+    LOG_ACTION_PMZ,           // 6 - Override small door close
+    LOG_ACTION_PVV,           // 7 - Override big door
+    LOG_ACTION_SON,           // 8 - Light on
+    LOG_ACTION_SOF,           // 9 - Light off
+    LOG_ACTION_UST,           // 10 - Stop siren
+    LOG_ACTION_UNA,           // 11 - Siren nadolazeca opasnost
+    LOG_ACTION_UNE,           // 12 - Siren neposredna opasnost
+    LOG_ACTION_UPR,           // 13 - Siren prestanak opasnosti
+    LOG_ACTION_UVA,           // 14 - Siren vatrogasna uzbuna (SMS)
+    LOG_ACTION_UVT,           // 15 - Siren vatrogasna uzbuna (panel)
+    LOG_ACTION_SUP,           // 16 - Commands from user suppressed by SMS rate limiter
+    LOG_ACTION_COUNT          // Number of actions, keep this one last
 };
 
 // Reserved user IDs
 enum reserved_user_ids {
-    USER_DELETED,             // 0 - User that does not exist
+    USER_COMPACT_MARK = -1,   // -1 - Last record of compacted users file, marks that copy is complete
+    USER_DELETED,             // 0 - User that does not exist, also used for tombstones in users file
     USER_PANEL,               // 1 - Action performed by panel
     USER_SERIAL,              // 2 - Action requested by serial command
     USER_LAST_RESEVED         // 3 - All IDs after this will be used for regular users
@@ -37,6 +114,20 @@ enum reserved_user_ids {
 // Global variable for RTC manipulation
 extern RtcDS1302<ThreeWire> rtc;
 
+// Kinds of data which can be dumped over console
+enum dump_kinds {
+    DUMP_LOGS,                // 0 - Log records from oldest to newest, in format stored in log file
+    DUMP_USERS,               // 1 - Users file, including tombstones
+    DUMP_SETTINGS             // 2 - Settings
+};
+
+// Steps of users file compaction
+enum user_compact_states {
+    USER_COMPACT_IDLE,        // Compaction is not running
+    USER_COMPACT_COPY,        // Users which are not deleted are copied to new file
+    USER_COMPACT_REPLACE      // New file is complete, it's copied over users file
+};
+
 // Data type for storing system settings on SD card
 struct setting_record {
     setting_ids id;
@@ -49,7 +140,7 @@ struct user_record {
     int active;
     char number[16];
 };
-// Data type for storing system logs on SD card
+// Data type for system logs, log files of version 1 store records in this format
 struct log_record {
     int user_id;
     char action[4];
@@ -60,18 +151,204 @@ struct log_record {
     uint8_t month;
     uint16_t year;
 };
-
-// Function returns pointer to string, string will contain formated
-// information about this page of logs, there are 4 logs on each page
-// if there are no logs for that page, string will be empty
-const char * get_log_page(unsigned long page);
+// Data type for storing system logs on SD card, 7 bytes per record
+struct log_packed_record {
+    uint16_t user_id;       // User who performed action
+    uint8_t action;         // Action code, one of log_actions
+    uint32_t time;          // Seconds since 1.1.2000. 00:00:00
+} __attribute__((packed));
+// Log record waiting in RAM to be written to SD card
+struct log_stage_record {
+    int user_id;            // User who performed action
+    uint8_t action;         // Action code, one of log_actions
+    unsigned long time;     // millis() when action was logged
+};
+// Header stored at the start of SMS spool file, records follow right after it
+struct sms_spool_header {
+    char magic[4];          // Always "DVDS"
+    uint32_t total;         // Number of messages ever spooled, next one goes to slot total % SMS_SPOOL_CAPACITY
+};
+// SMS message which could not be sent, stored in SMS spool file, 128 bytes per record
+struct sms_spool_record {
+    uint32_t time;                      // Seconds since 1.1.2000. 00:00:00 when message was given up
+    uint8_t attempts;                   // Number of times sending was tried
+    char number[16];                    // Recipient number
+    char text[SMS_SPOOL_TEXT + 1];      // Start of message
+};
+// Log record together with user who performed action, used for log pages
+struct log_page_record {
+    log_record log;         // Log record
+    user_record user;       // User with ID from log record, or reserved/deleted user
+};
+// Header stored at the start of log file, records follow right after it
+struct log_header {
+    char magic[4];          // Always "DVDL"
+    uint8_t version;        // Version of log file format
+    uint8_t record_size;    // Size of single log record in bytes
+    uint32_t capacity;      // Max number of records in log file
+    uint32_t head;          // Slot where next record will be written
+    uint32_t tail;          // Slot of oldest record
+    uint32_t count;         // Number of records currently in log file
+};
+// Header stored at the start of day index file
+// Each record in log gets sequence number, first record after clearing log has number 0
+struct log_day_header {
+    char magic[4];          // Always "DVDD"
+    uint32_t base_day;      // Day number (days since 1.1.2000.) of first entry, LOG_NO_DAY if index is empty
+    uint32_t total;         // Sequence number of next log record
+};
+// Day index entry, entry for each day since base_day is stored after day index header
+struct log_day_record {
+    uint32_t first;         // Sequence number of first log record on that day
+    uint32_t count;         // Number of log records on that day
+};
 
 class storage_class {
     private:
-        // something
+        // Open files
+        File settings_file;                            // Settings file, open while system is running
+        File user_file;                                // Users file, open while system is running
+        File log_file;                                 // Ring log file, open while system is running
+        File days_file;                                // Day index file, open while system is running
+        unsigned long last_sync;                       // millis() when files were last synced by update()
+        unsigned long sd_opens;                        // Number of files opened on SD card
+        unsigned long sd_syncs;                        // Number of file syncs
+
+        // Software clock
+        uint32_t clock_seconds;                        // Seconds since 1.1.2000. 00:00:00 at clock_millis
+        unsigned long clock_millis;                    // millis() when clock_seconds was current time
+        unsigned long clock_last_sync;                 // millis() when clock was last synced with RTC
+        unsigned long clock_interval;                  // Number of ms between syncs with RTC
+        int clock_ready;                               // 1 if clock was synced with RTC at least once
+        long clock_drift;                              // Seconds RTC was ahead of software clock at last sync
+        long clock_drift_max;                          // Largest drift since boot
+        unsigned long clock_syncs;                     // Number of successful syncs with RTC
+        unsigned long clock_failures;                  // Number of RTC reads which returned invalid time
+
+        // Settings cache
+        setting_record settings_cache[SETTING_COUNT];  // RAM copy of settings file, indexed by setting ID
+        int settings_cache_ready;                      // 1 if settings cache is loaded from SD card
+        unsigned long settings_cache_hits;             // Number of settings reads served from RAM
+        unsigned long settings_cache_misses;           // Number of settings reads served from SD card
+
+        // User number index
+        uint16_t user_index[USER_INDEX_SIZE];          // Hash table of user positions in users file (tag << 12 | position + 1)
+        int user_index_ready;                          // 1 if user index can be used for lookups
+        int user_index_count;                          // Number of users stored in user index
+
+        // Users file compaction
+        File user_new_file;                            // Compacted users file, open while compaction is running
+        user_compact_states user_compact_state;        // Current step of compaction
+        unsigned int user_compact_pos;                 // Next record to copy in current step
+        int user_tombstones;                           // Number of deleted users still in users file
+        int user_pos_logical;                          // Position of last user found by get_user_by_pos, -1 if unknown
+        int user_pos_physical;                         // Position of that user in users file
+
+        // Log
+        log_header log_info;                           // RAM copy of log file header
+        log_day_header log_days_info;                  // RAM copy of day index header
+        uint32_t log_days_current;                     // Day number of entry in log_days_last or LOG_NO_DAY
+        log_day_record log_days_last;                  // RAM copy of day index entry for last logged day
+        log_stage_record log_stage[LOG_STAGE_SIZE];    // Log records not yet written to SD card
+        int log_stage_count;                           // Number of records in log_stage
+        unsigned long log_flushes;                     // Number of times staged records were written to SD card
+        unsigned long log_flushed_records;             // Number of records written by all flushes
+
+        // Read time from RTC and correct software clock
+        void clock_sync();
+        // Open file with given path if it's not open yet
+        void open_file(File &file, const char path[]);
+        // Write data of file from SD library cache to SD card, on error file is closed
+        void sync_file(File &file);
+        // Close all open files and open them again, RAM copies of files are loaded again
+        void reopen();
+        // Read whole settings file into settings cache
+        void load_settings_cache();
+        // Calculate hash of the number, only digits are used so number is normalized
+        uint16_t user_index_hash(const char number[]);
+        // Read whole users file and build user index
+        void user_index_build();
+        // Add user at given position in users file to user index
+        void user_index_insert(const char number[], unsigned int position);
+        // Remove user at given position in users file from user index
+        void user_index_remove(const char number[], unsigned int position);
+        // Find user with given number using user index
+        // Returns: position of user in users file, or -1 if user is not found
+        long user_index_find(File &user_file, const char number[], user_record &user);
+        // Do one slice of users file compaction, compaction is started if there are too many tombstones
+        void user_compact_step();
+        // If new users file is complete, finish copying it over users file
+        void user_compact_finish();
+        // Stop compaction which is still copying users, should be called before users file is changed
+        void user_compact_abort();
+        // Continue or discard compaction interrupted by reset
+        void user_compact_recover();
+        // Check if log header in RAM describes valid log file
+        int log_header_valid();
+        // Write log header from RAM to log file
+        void log_write_header(File &log_file);
+        // Write record to the next slot of log file, header is only updated in RAM
+        void log_append(File &log_file, const log_record &log);
+        // Read record which is position records before the last one
+        // Returns: 1 if record exists, or 0 if it does not
+        int log_read(File &log_file, unsigned long position, log_record &log);
+        // Read count records starting with one which is position records before the last one,
+        // records are stored from newest to oldest
+        // Returns: number of records read
+        unsigned int log_read_page(File &log_file, unsigned long position, unsigned int count, log_page_record page[]);
+        // Find users for all records on log page in one pass over users file
+        void log_page_users(unsigned int count, log_page_record page[]);
+        // Create new empty log file with space for LOG_CAPACITY records
+        int log_create();
+        // Copy records from log file used by older firmware to ring log
+        void log_migrate();
+        // Copy records from version 1 ring log to ring log
+        void log_convert();
+        // Load log header, create or migrate log file if needed
+        void log_init();
+        // Write all staged log records to SD card
+        void log_flush();
+        // Write day index header from RAM to day index file
+        void log_days_write_header(File &days_file);
+        // Add log record with given sequence number to day index, header is only updated in RAM
+        void log_days_add(File &days_file, const log_record &log, uint32_t sequence);
+        // Create day index for all records currently in log file
+        void log_days_build();
+        // Load day index header, build day index if it's missing or out of sync with log file
+        void log_days_init();
+        // Find day index entry for given date, only records still in log file are counted
+        // Returns: 1 if there are records for that date, or 0 if there are none
+        int log_days_find(File &days_file, uint8_t day, uint8_t month, uint16_t year, log_day_record &entry);
     public:
+        // Default constructor
+        storage_class();
         // Init storage class
         void init();
+        // Run periodic stuff, should be called at the end of each loop()
+        void update();
+        // Write everything to SD card, should be called before reset and after settings are changed
+        void sync();
+        // Get number of files opened on SD card
+        unsigned long get_sd_opens();
+        // Get number of file syncs
+        unsigned long get_sd_syncs();
+
+        // Get current date and time from software clock, RTC is not read
+        RtcDateTime now();
+        // Set date and time of RTC and software clock
+        void set_time(const RtcDateTime &time);
+        // Set number of seconds between software clock syncs with RTC, 0 for default
+        void set_clock_interval(int seconds);
+        // Get number of seconds between software clock syncs with RTC
+        int get_clock_interval();
+        // Get number of seconds RTC was ahead of software clock at last sync
+        long get_clock_drift();
+        // Get largest drift since boot
+        long get_clock_drift_max();
+        // Get number of successful syncs with RTC
+        unsigned long get_clock_syncs();
+        // Get number of RTC reads which returned invalid time
+        unsigned long get_clock_failures();
 
         // Get setting structure for given setting ID
         struct setting_record get_setting(setting_ids setting_id);
@@ -79,9 +356,17 @@ class storage_class {
         void set_setting(setting_ids setting_id, const char setting_str[]);
         // Set int part for setting of given ID
         void set_setting(setting_ids setting_id, const int setting_int);
+        // Get number of settings reads served from RAM
+        unsigned long get_settings_cache_hits();
+        // Get number of settings reads served from SD card
+        unsigned long get_settings_cache_misses();
 
-        // Log string for given user ID
+        // Log string for given user ID, record is staged in RAM and written to SD card later
         void log_this(int user_id, const char * log_string);
+        // Get number of times staged log records were written to SD card
+        unsigned long get_log_flushes();
+        // Get number of log records written by all flushes
+        unsigned long get_log_flushed_records();
         // Clear all log records
         void clear_log();
         // Get number of log records
@@ -94,6 +379,13 @@ class storage_class {
         // Get log record for specific date
         // position -- number of records to go into past, where 0 is last record
         struct log_record get_log(unsigned long position, uint8_t day, uint8_t month, uint16_t year);
+        // Get page of log records together with users who performed actions
+        // position -- number of records to go into past for first record on page, where 0 is last record
+        // count -- number of records to get, page must have space for that many records
+        // Returns: number of records stored to page, records are stored from newest to oldest
+        unsigned int get_log_page(unsigned long position, unsigned int count, log_page_record page[]);
+        // Get page of log records for specific date together with users who performed actions
+        unsigned int get_log_page(unsigned long position, unsigned int count, uint8_t day, uint8_t month, uint16_t year, log_page_record page[]);
 
         // Add user to user file
         int add_user(const char number[]);
@@ -113,8 +405,26 @@ class storage_class {
         struct user_record get_user_by_num(const char number[]);
         // Get user by position in the file, where 0 is first user
         struct user_record get_user_by_pos(const int position);
-        // Delete user from file permanently
+        // Delete user, user is left in file as tombstone until file is compacted
         void delete_user(int id);
+
+        // Store message which could not be sent to SMS spool file
+        void spool_sms(sms_spool_record &record);
+        // Get number of messages ever stored to SMS spool, only last SMS_SPOOL_CAPACITY are kept
+        unsigned long get_sms_spool_count();
+
+        // Get number of records which can be dumped
+        unsigned long dump_count(dump_kinds kind);
+        // Get position of first record which can be dumped, log records are counted since log was cleared
+        // so their positions don't change when new records are logged
+        unsigned long dump_first(dump_kinds kind);
+        // Get size of single record in bytes
+        uint8_t dump_record_size(dump_kinds kind);
+        // Read records without decoding them, reading stops at the end of data or end of log ring
+        // position -- position of first record, first record has position returned by dump_first()
+        // count -- max number of records to read, buffer must have space for that many records
+        // Returns: number of records read, or 0 if there are no records at that position
+        unsigned int dump_read(dump_kinds kind, unsigned long position, unsigned int count, byte buffer[]);
 };
 
 extern storage_class storage;
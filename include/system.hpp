@@ -13,8 +13,36 @@
 #define BUZZER_PIN 7
 // Pin where Ready indicator is connected
 #define READY_LED_PIN 8
+// Number of ms over which loop() passes are counted to get loop frequency
+#define LOOP_FREQUENCY_WINDOW 1000
 // Size of console buffer, how many characters can fit in console buffer
 #define CONSOLE_BUFFER_SIZE 50
+// Baud rate of console
+#define CONSOLE_BAUD 9600
+// Baud rate used by dump command if it's not given
+#define DUMP_BAUD 115200UL
+// Max number of record bytes in one dump frame, one frame is sent in each update()
+#define DUMP_CHUNK_SIZE 112
+// Number of ms to wait after baud rate is changed so receiver can change it too
+#define DUMP_SWITCH_DELAY 500
+// First byte of every dump frame
+#define DUMP_SYNC 0xA5
+// Version of dump frame format
+#define DUMP_VERSION 1
+
+// Types of dump frames
+enum dump_frames {
+    DUMP_FRAME_START = 'S',     // Kind, record size and number of records
+    DUMP_FRAME_DATA  = 'D',     // Whole records
+    DUMP_FRAME_END   = 'E'      // Number of records sent
+};
+
+// States of dump over console
+enum dump_states {
+    DUMP_IDLE,                  // Console is used for commands
+    DUMP_SWITCH,                // Waiting for receiver to switch baud rate
+    DUMP_SEND                   // Sending data frames
+};
 
 // Specific Modem error masks (used for setting)
 const int ERROR_MODEM_TURN_ON    = 1 << 0;
@@ -79,8 +107,24 @@ class system_class {
         unsigned int beep_waiting_time; // Number of ms to wait before first beep
         int beep_counter;               // How many beeps should be done
         int beep_after_wait_counter;    // How many beeps should be done after delay
+        // Loop frequency
+        unsigned long loop_count;       // Number of loop() passes in current window
+        unsigned long loop_window_start;// millis() when current window started
+        unsigned long loop_frequency;   // Number of loop() passes per second in last window
         // Console
         commands command;
+        // Dump
+        dump_states dump_state;         // Current state of dump
+        int dump_kind;                  // Kind of data being dumped (dump_kinds)
+        unsigned long dump_position;    // Position of next record to send
+        unsigned long dump_end;         // Position after last record to send
+        unsigned long dump_sent;        // Number of records sent
+        unsigned long dump_switch_time; // millis() when baud rate was changed
+        unsigned char dump_seq;         // Sequence number of next frame
+        // Send one frame of dump
+        void dump_update();
+        // Send frame with SYNC, type, sequence, length, payload and CRC
+        void dump_frame(unsigned char type, const unsigned char payload[], unsigned char length);
     public:
         // Default constructor
         system_class();
@@ -103,6 +147,10 @@ class system_class {
 
         // Run periodic stuff
         void update();
+        // Start dump of given kind at given baud rate
+        void dump_begin(int kind, unsigned long baud);
+        // Get number of loop() passes per second, measured over last LOOP_FREQUENCY_WINDOW ms
+        unsigned long get_loop_frequency();
 
         // Set state of Ready indicator
         // state -- 1 to turn on indicator, or 0 to turn it off
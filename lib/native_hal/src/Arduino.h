@@ -0,0 +1,163 @@
+#ifndef _NATIVE_HAL_ARDUINO_H_
+#define _NATIVE_HAL_ARDUINO_H_
+
+// Arduino core for native builds, only parts used by the firmware are provided
+// time, pins and serial ports are controlled by tests through native_hal.h
+
+// Include global header files, C++ headers used by tests come before min() and max() macros
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/********************************************************************
+ * Program memory, on host flash is ordinary memory                 *
+ ********************************************************************/
+class __FlashStringHelper;
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_byte_near(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address) (*(const void * const *)(address))
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strncmp_P strncmp
+#define memcpy_P memcpy
+
+/********************************************************************
+ * Time and pins                                                    *
+ ********************************************************************/
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void noInterrupts();
+void interrupts();
+
+/********************************************************************
+ * Print and serial ports                                           *
+ ********************************************************************/
+class Print {
+    private:
+        int write_error;
+    protected:
+        void setWriteError(int error = 1) { write_error = error; }
+    public:
+        Print() : write_error(0) {}
+        virtual ~Print() {}
+        int getWriteError() { return write_error; }
+        void clearWriteError() { setWriteError(0); }
+        virtual size_t write(uint8_t ch) = 0;
+        size_t write(const uint8_t *buffer, size_t size);
+        size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+
+        size_t print(const __FlashStringHelper *str);
+        size_t print(const char str[]);
+        size_t print(char ch);
+        size_t print(unsigned char value, int base = DEC);
+        size_t print(int value, int base = DEC);
+        size_t print(unsigned int value, int base = DEC);
+        size_t print(long value, int base = DEC);
+        size_t print(unsigned long value, int base = DEC);
+        size_t print(double value, int digits = 2);
+
+        size_t println(const __FlashStringHelper *str);
+        size_t println(const char str[]);
+        size_t println(char ch);
+        size_t println(unsigned char value, int base = DEC);
+        size_t println(int value, int base = DEC);
+        size_t println(unsigned int value, int base = DEC);
+        size_t println(long value, int base = DEC);
+        size_t println(unsigned long value, int base = DEC);
+        size_t println(double value, int digits = 2);
+        size_t println();
+};
+
+// Serial port backed by strings, see hal_serial_in and hal_serial_out
+class HardwareSerial : public Print {
+    public:
+        void begin(unsigned long baud);
+        void end();
+        int available();
+        int peek();
+        int read();
+        void flush();
+        size_t write(uint8_t ch);
+        using Print::write;
+        operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+/********************************************************************
+ * AVR registers and interrupts used by USART3 driver               *
+ ********************************************************************/
+#define F_CPU 16000000UL
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(reg, bit) ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!((reg) & _BV(bit)))
+
+#define SREG_I 7
+#define RXCIE3 7
+#define UDRIE3 5
+#define RXEN3 4
+#define TXEN3 3
+#define UCSZ31 2
+#define UCSZ30 1
+#define UDRE3 5
+#define FE3 4
+#define DOR3 3
+#define UPE3 2
+#define U2X3 1
+
+// Interrupt vectors are plain functions called by native_hal.cpp
+#define ISR(vector) extern "C" void vector(void)
+#define USART3_RX_vect hal_usart3_rx_vect
+#define USART3_UDRE_vect hal_usart3_udre_vect
+
+// Status register, data register empty flag is always set since characters are sent right away
+struct hal_status_register {
+    uint8_t value;
+    operator uint8_t() const { return value | _BV(UDRE3); }
+    hal_status_register &operator=(uint8_t new_value) { value = new_value; return *this; }
+};
+
+// Data register, written characters go to hal_modem_tx and reads return last received character
+struct hal_data_register {
+    uint8_t received;
+    operator uint8_t() const { return received; }
+    hal_data_register &operator=(uint8_t ch);
+};
+
+// Interrupts are never enabled on host, so SREG_I is always clear
+extern volatile uint8_t SREG;
+extern volatile uint8_t UCSR3B, UCSR3C, UBRR3H, UBRR3L;
+extern hal_status_register UCSR3A;
+extern hal_data_register UDR3;
+
+#endif
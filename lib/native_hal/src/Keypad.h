@@ -0,0 +1,16 @@
+#ifndef _NATIVE_HAL_KEYPAD_H_
+#define _NATIVE_HAL_KEYPAD_H_
+
+// Include global header files
+#include <Arduino.h>
+
+#define makeKeymap(x) ((char *)x)
+
+// Keypad for native builds, getKey() returns hal_key once
+class Keypad {
+    public:
+        Keypad(char *keymap, byte *row_pins, byte *col_pins, byte rows, byte cols) {}
+        char getKey();
+};
+
+#endif
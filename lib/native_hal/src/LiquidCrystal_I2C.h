@@ -0,0 +1,20 @@
+#ifndef _NATIVE_HAL_LIQUIDCRYSTAL_I2C_H_
+#define _NATIVE_HAL_LIQUIDCRYSTAL_I2C_H_
+
+// Include global header files
+#include <Arduino.h>
+
+// LCD for native builds, printed characters are dropped
+class LiquidCrystal_I2C : public Print {
+    public:
+        LiquidCrystal_I2C(uint8_t address, uint8_t columns, uint8_t rows) {}
+        void init() {}
+        void backlight() {}
+        void noBacklight() {}
+        void clear() {}
+        void createChar(uint8_t location, uint8_t charmap[]) {}
+        void setCursor(uint8_t column, uint8_t row) {}
+        size_t write(uint8_t ch) { return 1; }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _NATIVE_HAL_RTCDS1302_H_
+#define _NATIVE_HAL_RTCDS1302_H_
+
+// RTC for native builds, time is hal_rtc_seconds (seconds since 1.1.2000.)
+
+// Include global header files
+#include <Arduino.h>
+
+// Date and time kept as seconds since 1.1.2000., same as RTC library
+class RtcDateTime {
+    private:
+        uint32_t seconds;
+    public:
+        RtcDateTime(uint32_t seconds_from_2000 = 0);
+        RtcDateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+        uint16_t Year() const;
+        uint8_t Month() const;
+        uint8_t Day() const;
+        uint8_t Hour() const;
+        uint8_t Minute() const;
+        uint8_t Second() const;
+        uint8_t DayOfWeek() const;
+        uint32_t TotalSeconds() const;
+        bool IsValid() const;
+        operator uint32_t() const { return seconds; }
+};
+
+// RTC module state shared with tests, defined in native_hal.cpp
+extern uint32_t hal_rtc_seconds;
+extern bool hal_rtc_valid;
+extern unsigned long hal_rtc_reads;
+
+template <class T_WIRE> class RtcDS1302 {
+    public:
+        RtcDS1302(T_WIRE &wire) {}
+        void Begin() {}
+        bool IsDateTimeValid() { return hal_rtc_valid; }
+        bool GetIsWriteProtected() { return false; }
+        void SetIsWriteProtected(bool protect) {}
+        bool GetIsRunning() { return true; }
+        void SetIsRunning(bool run) {}
+        RtcDateTime GetDateTime() { ++hal_rtc_reads; return RtcDateTime(hal_rtc_seconds); }
+        void SetDateTime(const RtcDateTime &time) { hal_rtc_seconds = time.TotalSeconds(); hal_rtc_valid = true; }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _NATIVE_HAL_SD_H_
+#define _NATIVE_HAL_SD_H_
+
+// SD card for native builds, card is a directory on host (hal_sd_root)
+// each operation is counted in hal_sd so tests can measure SD traffic
+
+// Include global header files
+#include <Arduino.h>
+
+#define O_READ 0x01
+#define O_WRITE 0x02
+#define O_RDWR (O_READ | O_WRITE)
+#define O_APPEND 0x04
+#define O_CREAT 0x10
+#define O_TRUNC 0x40
+#define FILE_READ O_READ
+#define FILE_WRITE (O_RDWR | O_CREAT | O_APPEND)
+
+class File : public Print {
+    private:
+        FILE *handle;   // Host file, or NULL if file is not open
+        uint8_t append; // 1 if each write goes to the end of file
+    public:
+        // Default constructor, file is not open
+        File();
+        // Open host file, used by SDClass::open()
+        File(FILE *host_file, uint8_t append_mode);
+        int read();
+        int read(void *buffer, uint16_t size);
+        int peek();
+        int available();
+        size_t write(uint8_t ch);
+        size_t write(const uint8_t *buffer, size_t size);
+        using Print::write;
+        void flush();
+        bool seek(uint32_t position);
+        uint32_t position();
+        uint32_t size();
+        void close();
+        operator bool();
+};
+
+class SDClass {
+    public:
+        bool begin(uint8_t cs_pin = 53);
+        File open(const char path[], uint8_t mode = FILE_READ);
+        bool exists(const char path[]);
+        bool mkdir(const char path[]);
+        bool remove(const char path[]);
+        bool rmdir(const char path[]);
+};
+
+extern SDClass SD;
+
+#endif
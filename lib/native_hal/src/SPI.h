@@ -0,0 +1,6 @@
+#ifndef _NATIVE_HAL_SPI_H_
+#define _NATIVE_HAL_SPI_H_
+
+// SPI is used only by SD library, which is replaced on host
+
+#endif
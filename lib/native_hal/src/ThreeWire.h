@@ -0,0 +1,13 @@
+#ifndef _NATIVE_HAL_THREEWIRE_H_
+#define _NATIVE_HAL_THREEWIRE_H_
+
+// Include global header files
+#include <Arduino.h>
+
+// Wires of RTC module, not used on host
+class ThreeWire {
+    public:
+        ThreeWire(uint8_t io_pin, uint8_t sclk_pin, uint8_t ce_pin) {}
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _NATIVE_HAL_WIRE_H_
+#define _NATIVE_HAL_WIRE_H_
+
+// I2C is used only by LCD library, which is replaced on host
+
+#endif
@@ -0,0 +1,251 @@
+// Include global header files
+#include <Arduino.h>
+#include <SD.h>
+#include <RtcDS1302.h>
+#include <Keypad.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// Include local header files
+#include "native_hal.h"
+
+// USART3 interrupts of modem_serial.cpp
+extern "C" void hal_usart3_rx_vect(void);
+extern "C" void hal_usart3_udre_vect(void);
+
+unsigned long hal_millis = 0;
+uint8_t hal_pins[HAL_PIN_COUNT];
+unsigned long hal_pin_changed[HAL_PIN_COUNT];
+void (*hal_pin_written)(uint8_t pin, uint8_t value) = NULL;
+std::string hal_serial_in;
+std::string hal_serial_out;
+std::string hal_modem_tx;
+std::string hal_sd_root = HAL_SD_ROOT;
+hal_sd_counters hal_sd;
+char hal_key = 0;
+
+uint32_t hal_rtc_seconds = 0;
+bool hal_rtc_valid = true;
+unsigned long hal_rtc_reads = 0;
+
+volatile uint8_t SREG = 0;
+volatile uint8_t UCSR3B = 0, UCSR3C = 0, UBRR3H = 0, UBRR3L = 0;
+hal_status_register UCSR3A = { 0 };
+hal_data_register UDR3 = { 0 };
+
+HardwareSerial Serial;
+SDClass SD;
+
+/********************************************************************
+ * Test control                                                     *
+ ********************************************************************/
+void hal_reset() {
+    int i;  // Pin counter
+
+    hal_millis = 0;
+    for (i = 0; i < HAL_PIN_COUNT; i++) {
+        hal_pins[i] = LOW;
+        hal_pin_changed[i] = 0;
+    }
+    hal_pin_written = NULL;
+    hal_serial_in.clear();
+    hal_serial_out.clear();
+    hal_modem_tx.clear();
+    memset(&hal_sd, 0, sizeof(hal_sd));
+    hal_key = 0;
+    hal_rtc_reads = 0;
+    hal_rtc_valid = true;
+}
+
+// Remove directory and everything in it
+static void remove_tree(const std::string &path) {
+    DIR *dir = opendir(path.c_str());
+    struct dirent *entry;
+
+    if (dir == NULL) {
+        unlink(path.c_str());
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        remove_tree(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+    rmdir(path.c_str());
+}
+
+void hal_sd_format() {
+    remove_tree(hal_sd_root);
+}
+
+void hal_modem_receive(uint8_t ch) {
+    UDR3.received = ch;
+    hal_usart3_rx_vect();
+}
+
+void hal_modem_receive(const std::string &text) {
+    size_t i;   // Character counter
+
+    for (i = 0; i < text.size(); i++)
+        hal_modem_receive((uint8_t)text[i]);
+}
+
+void hal_modem_transmit() {
+    while (UCSR3B & _BV(UDRIE3))
+        hal_usart3_udre_vect();
+}
+
+hal_data_register &hal_data_register::operator=(uint8_t ch) {
+    hal_modem_tx.push_back((char)ch);
+    return *this;
+}
+
+/********************************************************************
+ * Time and pins                                                    *
+ ********************************************************************/
+unsigned long millis() {
+    return hal_millis;
+}
+
+unsigned long micros() {
+    return hal_millis * 1000UL;
+}
+
+void delay(unsigned long ms) {
+    hal_millis += ms;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < HAL_PIN_COUNT ? hal_pins[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= HAL_PIN_COUNT)
+        return;
+    value = value ? HIGH : LOW;
+    if (hal_pins[pin] != value)
+        hal_pin_changed[pin] = hal_millis;
+    hal_pins[pin] = value;
+    if (hal_pin_written != NULL)
+        hal_pin_written(pin, value);
+}
+
+void noInterrupts() {
+}
+
+void interrupts() {
+}
+
+char Keypad::getKey() {
+    char key = hal_key;
+
+    hal_key = 0;
+    return key;
+}
+
+/********************************************************************
+ * Print and console                                                *
+ ********************************************************************/
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t i;   // Character counter
+
+    for (i = 0; i < size; i++)
+        write(buffer[i]);
+    return size;
+}
+
+size_t Print::print(const __FlashStringHelper *str) {
+    return print((const char *)str);
+}
+
+size_t Print::print(const char str[]) {
+    return write((const uint8_t *)str, strlen(str));
+}
+
+size_t Print::print(char ch) {
+    return write((uint8_t)ch);
+}
+
+size_t Print::print(unsigned char value, int base) {
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(int value, int base) {
+    return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base) {
+    char text[24];
+
+    if (base == DEC)
+        snprintf(text, sizeof(text), "%ld", value);
+    else
+        snprintf(text, sizeof(text), "%lX", value);
+    return print(text);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    char text[24];
+
+    snprintf(text, sizeof(text), base == DEC ? "%lu" : "%lX", value);
+    return print(text);
+}
+
+size_t Print::print(double value, int digits) {
+    char text[32];
+
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return print(text);
+}
+
+size_t Print::println() {
+    return print("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper *str) { return print(str) + println(); }
+size_t Print::println(const char str[]) { return print(str) + println(); }
+size_t Print::println(char ch) { return print(ch) + println(); }
+size_t Print::println(unsigned char value, int base) { return print(value, base) + println(); }
+size_t Print::println(int value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned int value, int base) { return print(value, base) + println(); }
+size_t Print::println(long value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned long value, int base) { return print(value, base) + println(); }
+size_t Print::println(double value, int digits) { return print(value, digits) + println(); }
+
+void HardwareSerial::begin(unsigned long baud) {
+}
+
+void HardwareSerial::end() {
+}
+
+int HardwareSerial::available() {
+    return hal_serial_in.size();
+}
+
+int HardwareSerial::peek() {
+    return hal_serial_in.empty() ? -1 : (uint8_t)hal_serial_in[0];
+}
+
+int HardwareSerial::read() {
+    int ch = peek();
+
+    if (ch != -1)
+        hal_serial_in.erase(0, 1);
+    return ch;
+}
+
+void HardwareSerial::flush() {
+}
+
+size_t HardwareSerial::write(uint8_t ch) {
+    hal_serial_out.push_back((char)ch);
+    return 1;
+}
@@ -0,0 +1,49 @@
+#ifndef _NATIVE_HAL_H_
+#define _NATIVE_HAL_H_
+
+// Control of native hardware replacement, used by tests to move time,
+// talk to firmware over USART3 and inspect pins, console and SD card
+
+// Include global header files
+#include <Arduino.h>
+#include <string>
+
+// Number of pins tracked by digitalRead() and digitalWrite()
+#define HAL_PIN_COUNT 70
+// Directory used as SD card if test doesn't set other one
+#define HAL_SD_ROOT ".pio/sdcard"
+
+// Number of SD card operations since last hal_reset()
+struct hal_sd_counters {
+    unsigned long opens;    // Files opened
+    unsigned long closes;   // Files closed
+    unsigned long reads;    // Block reads, single character reads are not counted
+    unsigned long writes;   // Block and single character writes
+    unsigned long seeks;    // Seeks
+    unsigned long flushes;  // Flushes, each one is a sector write on real card
+};
+
+extern unsigned long hal_millis;                // Time returned by millis(), delay() moves it forward
+extern uint8_t hal_pins[HAL_PIN_COUNT];         // State of each pin
+extern unsigned long hal_pin_changed[HAL_PIN_COUNT];    // millis() when pin last changed state
+// Called after firmware writes pin, tests use it to connect sensors to relays
+extern void (*hal_pin_written)(uint8_t pin, uint8_t value);
+extern std::string hal_serial_in;               // Characters waiting to be read from console
+extern std::string hal_serial_out;              // Characters printed to console
+extern std::string hal_modem_tx;                // Characters sent to modem over USART3
+extern std::string hal_sd_root;                 // Directory used as SD card
+extern hal_sd_counters hal_sd;                  // SD card operations
+extern char hal_key;                            // Key returned by next keypad read, or 0
+
+// Reset time, pins, serial ports and counters, SD card content is kept
+void hal_reset();
+// Delete everything on SD card
+void hal_sd_format();
+// Pass character to USART3 receive interrupt
+void hal_modem_receive(uint8_t ch);
+// Pass each character of text to USART3 receive interrupt
+void hal_modem_receive(const std::string &text);
+// Run USART3 data register empty interrupt until transmit ring is empty
+void hal_modem_transmit();
+
+#endif
@@ -0,0 +1,257 @@
+// Include global header files
+#include <Arduino.h>
+#include <SD.h>
+#include <RtcDS1302.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// Include local header files
+#include "native_hal.h"
+
+// Number of days in each month of non leap year
+static const uint8_t month_days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+// Get path of file on host
+static std::string host_path(const char path[]) {
+    return hal_sd_root + "/" + path;
+}
+
+/********************************************************************
+ * SD card                                                          *
+ ********************************************************************/
+bool SDClass::begin(uint8_t cs_pin) {
+    size_t slash;   // End of parent directory
+
+    // Create all directories on the way to SD card root
+    for (slash = hal_sd_root.find('/', 1); slash != std::string::npos; slash = hal_sd_root.find('/', slash + 1))
+        ::mkdir(hal_sd_root.substr(0, slash).c_str(), 0755);
+    ::mkdir(hal_sd_root.c_str(), 0755);
+    return true;
+}
+
+File SDClass::open(const char path[], uint8_t mode) {
+    std::string full = host_path(path);
+    struct stat info;
+    bool exists = stat(full.c_str(), &info) == 0;
+    FILE *handle;
+
+    if (exists && S_ISDIR(info.st_mode))
+        return File();
+    if (!exists && !(mode & O_CREAT))
+        return File();
+    // Files are always opened for update, so reads and writes can be mixed like on SD card
+    if (!exists || (mode & O_TRUNC))
+        handle = fopen(full.c_str(), (mode & O_WRITE) ? "w+b" : "rb");
+    else
+        handle = fopen(full.c_str(), (mode & O_WRITE) ? "r+b" : "rb");
+    if (handle == NULL)
+        return File();
+    ++hal_sd.opens;
+    return File(handle, (mode & O_APPEND) ? 1 : 0);
+}
+
+bool SDClass::exists(const char path[]) {
+    struct stat info;
+
+    return stat(host_path(path).c_str(), &info) == 0;
+}
+
+bool SDClass::mkdir(const char path[]) {
+    return ::mkdir(host_path(path).c_str(), 0755) == 0;
+}
+
+bool SDClass::remove(const char path[]) {
+    return ::remove(host_path(path).c_str()) == 0;
+}
+
+bool SDClass::rmdir(const char path[]) {
+    return ::rmdir(host_path(path).c_str()) == 0;
+}
+
+File::File() {
+    handle = NULL;
+    append = 0;
+}
+
+File::File(FILE *host_file, uint8_t append_mode) {
+    handle = host_file;
+    append = append_mode;
+}
+
+int File::read() {
+    uint8_t ch;
+
+    if (handle == NULL || fread(&ch, 1, 1, handle) != 1)
+        return -1;
+    return ch;
+}
+
+int File::read(void *buffer, uint16_t size) {
+    if (handle == NULL)
+        return -1;
+    ++hal_sd.reads;
+    return fread(buffer, 1, size, handle);
+}
+
+int File::peek() {
+    int ch = read();
+
+    if (ch != -1)
+        fseek(handle, -1, SEEK_CUR);
+    return ch;
+}
+
+int File::available() {
+    return size() - position();
+}
+
+size_t File::write(uint8_t ch) {
+    return write(&ch, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+    size_t written;
+
+    if (handle == NULL)
+        return 0;
+    ++hal_sd.writes;
+    // Switching between reads and writes needs seek on host
+    if (append)
+        fseek(handle, 0, SEEK_END);
+    else
+        fseek(handle, 0, SEEK_CUR);
+    written = fwrite(buffer, 1, size, handle);
+    fseek(handle, 0, SEEK_CUR);
+    if (written != size)
+        setWriteError();
+    return written;
+}
+
+void File::flush() {
+    if (handle == NULL)
+        return;
+    ++hal_sd.flushes;
+    fflush(handle);
+}
+
+bool File::seek(uint32_t position) {
+    if (handle == NULL)
+        return false;
+    ++hal_sd.seeks;
+    return fseek(handle, position, SEEK_SET) == 0;
+}
+
+uint32_t File::position() {
+    return handle != NULL ? ftell(handle) : 0;
+}
+
+uint32_t File::size() {
+    struct stat info;
+
+    if (handle == NULL)
+        return 0;
+    fflush(handle);
+    fstat(fileno(handle), &info);
+    return info.st_size;
+}
+
+void File::close() {
+    if (handle == NULL)
+        return;
+    ++hal_sd.closes;
+    fclose(handle);
+    handle = NULL;
+}
+
+File::operator bool() {
+    return handle != NULL;
+}
+
+/********************************************************************
+ * RTC date and time                                                *
+ ********************************************************************/
+// Get number of days in given year, RTC works only from 2000. to 2099.
+static uint16_t year_days(uint16_t year) {
+    return (year % 4 == 0) ? 366 : 365;
+}
+
+// Get number of days in given month
+static uint8_t days_in_month(uint16_t year, uint8_t month) {
+    return month_days[month - 1] + ((month == 2 && year % 4 == 0) ? 1 : 0);
+}
+
+RtcDateTime::RtcDateTime(uint32_t seconds_from_2000) {
+    seconds = seconds_from_2000;
+}
+
+RtcDateTime::RtcDateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+    uint32_t days = 0;  // Days since 1.1.2000.
+    uint16_t y;         // Year counter
+    uint8_t m;          // Month counter
+
+    if (year >= 2000)
+        year -= 2000;
+    for (y = 0; y < year; y++)
+        days += year_days(y);
+    for (m = 1; m < month; m++)
+        days += days_in_month(year, m);
+    days += day - 1;
+    seconds = ((days * 24 + hour) * 60 + minute) * 60 + second;
+}
+
+uint16_t RtcDateTime::Year() const {
+    uint32_t days = seconds / 86400;
+    uint16_t year = 0;
+
+    while (days >= year_days(year))
+        days -= year_days(year++);
+    return year + 2000;
+}
+
+uint8_t RtcDateTime::Month() const {
+    uint32_t days = seconds / 86400;
+    uint16_t year = 0;
+    uint8_t month = 1;
+
+    while (days >= year_days(year))
+        days -= year_days(year++);
+    while (days >= days_in_month(year, month))
+        days -= days_in_month(year, month++);
+    return month;
+}
+
+uint8_t RtcDateTime::Day() const {
+    uint32_t days = seconds / 86400;
+    uint16_t year = 0;
+    uint8_t month = 1;
+
+    while (days >= year_days(year))
+        days -= year_days(year++);
+    while (days >= days_in_month(year, month))
+        days -= days_in_month(year, month++);
+    return days + 1;
+}
+
+uint8_t RtcDateTime::Hour() const {
+    return seconds / 3600 % 24;
+}
+
+uint8_t RtcDateTime::Minute() const {
+    return seconds / 60 % 60;
+}
+
+uint8_t RtcDateTime::Second() const {
+    return seconds % 60;
+}
+
+uint8_t RtcDateTime::DayOfWeek() const {
+    // 1.1.2000. was Saturday, Sunday is 0
+    return (seconds / 86400 + 6) % 7;
+}
+
+uint32_t RtcDateTime::TotalSeconds() const {
+    return seconds;
+}
+
+bool RtcDateTime::IsValid() const {
+    return true;
+}
@@ -0,0 +1,8 @@
+#ifndef _NATIVE_HAL_UTIL_ATOMIC_H_
+#define _NATIVE_HAL_UTIL_ATOMIC_H_
+
+// Interrupts are called only from test code on host, so every block is already atomic
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for (uint8_t hal_atomic_once = 1; hal_atomic_once; hal_atomic_once = 0)
+
+#endif
@@ -14,7 +14,7 @@ void strcopy( const char from_this[], char to_this[], const int to_size) {
 
 // Function to compare two zero terminated strings
 int strcompare(const char string1[], const char string2[]) {
-    int i;  // Index counter
+    int i = 0;  // Index counter
 
     while(1) {
         if (string1[i] == '\0')
@@ -44,7 +44,7 @@ int strlength(const char string[]) {
 
 // Function checks if string1 starts with string2
 int strstartswith(const char string1[], const char string2[]) {
-    int i;  // Index counter
+    int i = 0;  // Index counter
 
     while(1) {
         if (string2[i] == '\0')
@@ -55,4 +55,20 @@ int strstartswith(const char string1[], const char string2[]) {
             return 0;
         ++i;
     }
-}
\ No newline at end of file
+}
+
+// Function calculates CRC-16/CCITT of given data
+unsigned int crc16(unsigned int crc, const unsigned char data[], const int length) {
+    int i, bit;  // Byte and bit counters
+
+    for (i = 0; i < length; i++) {
+        crc ^= (unsigned int)data[i] << 8;
+        for (bit = 0; bit < 8; bit++) {
+            if (crc & 0x8000)
+                crc = (crc << 1) ^ 0x1021;
+            else
+                crc <<= 1;
+        }
+    }
+    return crc & 0xFFFF;
+}
@@ -57,4 +57,6 @@ void loop() {
     modem.update();
     // Run dynamic actions for relays
     relay.update();
+    // Write logs staged during this loop, keep this one last
+    storage.update();
 }
\ No newline at end of file
@@ -2,11 +2,11 @@
 #include <Arduino.h>
 // Include local header files
 #include "modem.hpp"
-#include "sms_pdu.hpp"
 #include "system.hpp"
 #include "storage.hpp"
 #include "relays.hpp"
 #include "panel.hpp"
+#include "registry.hpp"
 
 // Create modem variable
 modem_manipulation modem;
@@ -17,28 +17,57 @@ check_cmd check_modem;
 sms_cmd sms_modem;
 delay_cmd delay_modem;
 config_cmd config_modem;
+inbox_cmd inbox_modem;
+
+// Create rate limiter of SMS commands variable
+sender_limiter sms_limiter;
 
 // Create response handler variables
 delivery_res delivery_modem;
+inbox_res notify_modem;
 ring_res ring_modem;
 ring_end_res ring_end_modem;
 
+// Timeout and retry policy of each command type, in order of cmd_types
+static const cmd_policy cmd_policies[CMD_TYPE_COUNT] PROGMEM = {
+    // timeout            per part  retries  backoff
+    { MODEM_RESPONSE_WAIT,     0,      0,       0 },  // Startup handles power cycles itself
+    { 2000,                    0,      2,    1000 },  // Check answers in less than a second
+    { 10000,               20000,      0,       0 },  // SMS is not sent again, next attempt would skip message
+    { 0,                       0,      0,       0 },  // Delay ends by itself
+    { 2000,                    0,      2,    1000 },  // Config answers in less than a second
+    { 30000,                   0,      1,    2000 }   // Inbox lists whole SIM and handles batch of messages
+};
+
+// Handlers of unsolicited responses, sorted by prefix so they can be found by binary search
+static constexpr unsolicited_entry unsolicited_table[] PROGMEM = {
+    { "+CMT",       &delivery_modem },
+    { "+CMTI",      &notify_modem   },
+    { "NO CARRIER", &ring_end_modem },
+    { "RING",       &ring_modem     }
+};
+// Number of rows in unsolicited_table
+#define UNSOLICITED_COUNT ((int)(sizeof(unsolicited_table) / sizeof(unsolicited_entry)))
+
+// Check at compile time if prefix a sorts before prefix b
+constexpr int prefix_before(const char *a, const char *b) {
+    return (*a != *b) ? ((uint8_t)*a < (uint8_t)*b) : (*a != '\0' && prefix_before(a + 1, b + 1));
+}
+// Check at compile time if rows from given one to the end are sorted and prefixes are unique
+constexpr int unsolicited_sorted(int row) {
+    return row + 1 >= UNSOLICITED_COUNT ||
+        (prefix_before(unsolicited_table[row].prefix, unsolicited_table[row + 1].prefix) && unsolicited_sorted(row + 1));
+}
+// Prefixes longer than UNSOLICITED_PREFIX_SIZE don't compile, order is checked here
+static_assert(unsolicited_sorted(0), "unsolicited_table must be sorted by prefix and prefixes must be unique");
+
 /********************************************************************
  * Template class for creating unsolitited resposes functions       *
  ********************************************************************/
 unsolicited_response::unsolicited_response() {
-    res_starts_with[0] = '\0';
     is_done = 1;
 }
 
-void unsolicited_response::set_start(const char start[]) {
-    strcopy(start, res_starts_with, 40);
-}
-
-int unsolicited_response::test(const char response[]) {
-    return strstartswith(response, res_starts_with);
-}
-
 int unsolicited_response::done() {
     return is_done;
 }
@@ -48,35 +77,108 @@ int unsolicited_response::done() {
  ********************************************************************/
 at_command::at_command() {
     is_done = 1;
+    type = CMD_DELAY;
     execution_start = 0UL;
+    budget = 0;
+    attempt = 0;
+    backing_off = 0;
+    resent = 0;
+    timeouts = 0;
+    retries = 0;
+}
+
+void at_command::restart_budget() {
+    execution_start = millis();
+    budget = pgm_read_dword(&cmd_policies[type].timeout);
+    // Budget covers one part, so silent modem is noticed no matter how many parts are queued
+    if (budget != 0)
+        budget += pgm_read_dword(&cmd_policies[type].part_timeout);
 }
 
 int at_command::done() {
+    return is_done;
+}
+
+int at_command::expired() {
+    if (is_done || backing_off) return 0;
+
     if (execution_start > millis())
         execution_start = millis();
-    if (millis() - execution_start > MODEM_RESPONSE_WAIT) {
+    // Command without budget ends by itself
+    return budget != 0 && millis() - execution_start > budget;
+}
+
+void at_command::expire() {
+    ++timeouts;
+    // Send command again if policy allows it, else report timeout
+    if (attempt < pgm_read_byte(&cmd_policies[type].retries)) {
+        ++attempt;
+        ++retries;
+        backing_off = 1;
+        execution_start = millis();
+    } else {
         system_control.set_error(ERROR_MODEM_TIMEOUT);
         is_done = 1;
+        timeout();
     }
+}
 
-    return is_done;
+int at_command::retry_pending() {
+    return backing_off;
+}
+
+int at_command::backoff_over() {
+    if (execution_start > millis())
+        execution_start = millis();
+    return backing_off && millis() - execution_start > ((unsigned long)pgm_read_word(&cmd_policies[type].backoff) << (attempt - 1));
+}
+
+void at_command::resend() {
+    backing_off = 0;
+    resent = 1;
+    restart_budget();
+    send_to_serial();
+}
+
+int at_command::echo_pending() {
+    return resent;
+}
+
+void at_command::echo_received() {
+    resent = 0;
 }
 
 void at_command::execute() {
     is_done = 0;
-    execution_start = millis();
+    attempt = 0;
+    backing_off = 0;
+    resent = 0;
+    restart_budget();
     send_to_serial();
 }
 
+uint8_t at_command::get_type() {
+    return type;
+}
+
+unsigned long at_command::get_timeouts() {
+    return timeouts;
+}
+
+unsigned long at_command::get_retries() {
+    return retries;
+}
+
 /********************************************************************
  * Command to initiate modem on startup                             *
  ********************************************************************/
 startup_cmd::startup_cmd() {
+    type = CMD_STARTUP;
     start_counter = 0;
 }
 
 void startup_cmd::send_to_serial() {
-    Serial3.println("AT");
+    modem_serial.println("AT");
     res_wait = millis();
     current_stage = WAITING_FOR_CMD_RES;
 }
@@ -142,27 +244,28 @@ void startup_cmd::update() {
  * Modem manipulation functions                                     *
  ********************************************************************/
 modem_manipulation::modem_manipulation() {
-    buffer[0] = '\0';
-    current_ch = 0;
-    cmd_getter = -1;
-    cmd_setter = 0;
-    handler_count = 0;
+    int i;  // Index counter
+
+    cmd_count = 0;
+    current_cmd = NULL;
+    active_handler = NULL;
     check_start = 0;
-    // Add handlers
-    add_handler(delivery_modem);
-    add_handler(ring_modem);
-    add_handler(ring_end_modem);
+    cmd_max_depth = 0;
+    cmd_coalesced = 0;
+    for (i = 0; i < CMD_PRIORITY_CLASSES; i++) {
+        wait_count[i] = 0;
+        wait_total[i] = 0;
+        wait_max[i] = 0;
+    }
 }
 
 void modem_manipulation::init() {
-    Serial3.begin(9600);
+    modem_serial.begin(9600);
     pinMode(MODEM_POWER_PIN, OUTPUT);
     digitalWrite(MODEM_POWER_PIN, LOW);
 }
 
 void modem_manipulation::update() {
-    int i;  // Index counter
-
     // If there was SD error turn off ready indicator and do nothing
     if (system_control.test_error(ERROR_SD)) {
         system_control.ready(OFF);
@@ -179,29 +282,28 @@ void modem_manipulation::update() {
             Serial.println(F("## MODEM loop: TIMEOUT error found"));
             Serial.flush();
         #endif
-        int i;    // Handler counter
-
         // Unset TIMEOUT error
         system_control.unset_error(ERROR_MODEM_TIMEOUT);
 
         // Set ready indicator to OFF
         system_control.ready(OFF);
+        // Cancel AT+CMGS which may wait for PDU, modem would take next commands as message text
+        modem_serial.write(0x1B);
+        // Messages left in SMS queue are sent again after pause
+        sms_modem.stop();
         // Clear command buffer
         current_cmd = NULL;
-        cmd_getter = -1;
-        cmd_setter = 0;
-        // Clear active unsilicited responses
-        for (i = 0; i < handler_count; i++) {
-            if (!handlers[i]->done()) {
-                handlers[i]->is_done = 1;
-            }
+        cmd_count = 0;
+        // Clear active unsilicited response
+        if (active_handler != NULL) {
+            active_handler->is_done = 1;
+            active_handler = NULL;
         }
-        // Clear character buffer
-        current_ch = 0;
-        buffer[current_ch] = '\0';
+        // Drop received lines
+        modem_serial.clear();
         // Delay all commands for 5 seconds
         delay_modem.set_delay(5000);
-        run_cmd(delay_modem);
+        run_cmd(delay_modem, PRIORITY_MAINTENANCE);
     }
 
     // Test if modem is OK in interval of READY_CHECK_INTERVAL
@@ -211,87 +313,91 @@ void modem_manipulation::update() {
             Serial.flush();
         #endif
         check_start = millis();
-        run_cmd(check_modem);
+        run_cmd(check_modem, PRIORITY_HEALTH);
     }
 
+    // Refill token buckets of SMS senders
+    sms_limiter.update();
+
+    // Send messages left in SMS queue after failure, once first of them can be sent
+    if (sms_modem.retry_due())
+        run_cmd(sms_modem, PRIORITY_REPLY);
+
     // Run dynamic actions of command if needed
     if (current_cmd != NULL) {
         current_cmd->update();
     }
+
+    // Command which ran out of time waits and it's sent again, or it ends with timeout error
+    if (current_cmd != NULL) {
+        if (current_cmd->backoff_over()) {
+            #ifdef MODEM_DEBUG
+                Serial.println(F("## MODEM loop: Sending timed out cmd again"));
+                Serial.flush();
+            #endif
+            current_cmd->resend();
+        } else if (current_cmd->expired()) {
+            current_cmd->expire();
+        }
+    }
     
-    // If there is data waiting on Serial3 (modem serial)
-    while (Serial3.available()) {
-        // Read character from Serial3
-        char ch = Serial3.read();
-        // If character is \n skip it
-        // Also if character value is less than zero there is somthing
-        // very wrong, so skip that character
-        if (ch == '\n' || ch < 0) continue;
-        // If character is return pass buffer to commands
-        if (ch == '\r') {
-            // If buffer is empty skip it
-            if (buffer[0] == '\0' && current_ch == 0) continue;
+    // Handle each complete line received from modem, line is read in place in receive ring
+    const char *line;
+    while ((line = modem_serial.read_line()) != NULL) {
+        #ifdef MODEM_DEBUG
+            // Print to serial for testing
+            Serial.print(F("## MODEM loop SERIAL3: "));
+            Serial.println(line);
+            Serial.flush();
+        #endif
+        // Prompt is passed as line as soon as it arrives, since it's not followed by \r
+        if (strcompare(line, "> ")) {
+            if (current_cmd != NULL && !current_cmd->done() && !current_cmd->retry_pending() && !current_cmd->echo_pending())
+                current_cmd->push_prompt();
+            modem_serial.release_line();
+            continue;
+        }
+        // Handler waiting for more lines takes this one too, else search handler by prefix
+        unsolicited_response *handler = (active_handler != NULL) ? active_handler : find_handler(line);
+        if (handler != NULL) {
             #ifdef MODEM_DEBUG
-                // Print to serial for testing
-                Serial.print(F("## MODEM loop SERIAL3: "));
-                Serial.println(buffer);
+                Serial.println(F("## MODEM loop: handler found !"));
                 Serial.flush();
             #endif
-            // Search if there is handler for this modem output
-            for (i = 0; i < handler_count; i++) {
-                if (handlers[i]->test(buffer) || !handlers[i]->done()) {
-                    #ifdef MODEM_DEBUG
-                        Serial.println(F("## MODEM loop: handler found !"));
-                        Serial.flush();
-                    #endif
-                    // If handler is found execute it
-                    handlers[i]->execute(buffer);
-                    // And empty buffer
-                    current_ch = 0;
-                    buffer[current_ch] = '\0';
-                    break;
-                }
-            }
-
-            // If handler was found skip following part
-            if (buffer[0] == '\0' && current_ch == 0) continue;
-            // If there is command listening for response pass string to
-            // command, then empty buffer
-            if (current_cmd != NULL && !current_cmd->done())
-                current_cmd->push_line(buffer);
-            current_ch = 0;
-            buffer[current_ch] = '\0';
+            // If handler is found execute it
+            handler->execute(line);
+            active_handler = handler->done() ? NULL : handler;
         }
-        // If character is anything else store it in buffer array
-        else {
-            // Check for the buffer overflow
-            if (current_ch < BUFFER_SIZE - 1) {
-                buffer[current_ch] = ch;
-                ++current_ch;
-                buffer[current_ch] = '\0';
-            }
+        // If there is command listening for response pass line to command
+        else if (current_cmd != NULL && !current_cmd->done() && !current_cmd->retry_pending()) {
+            // Command sent again ignores late responses to timed out attempt until its own echo arrives,
+            // every command starts with AT so its echo does too
+            if (current_cmd->echo_pending() && strstartswith(line, "AT"))
+                current_cmd->echo_received();
+            if (!current_cmd->echo_pending())
+                current_cmd->push_line(line);
         }
+        modem_serial.release_line();
     }
 
     // If command is done move to next command from buffer
     // or set pointer to NULL
     if (current_cmd != NULL && current_cmd->done()) {
         // If queue is not empty
-        if (cmd_getter != -1) {
+        if (cmd_count > 0) {
             #ifdef MODEM_DEBUG
                 Serial.println(F("## MODEM loop: Current cmd DONE, executing next !"));
                 Serial.flush();
             #endif
-            // Take next command from queue
-            current_cmd = cmd_buffer[cmd_getter];
-            // If this was last command set getter to -1
-            if ((cmd_getter + 1) % CMD_BUFFER_SIZE == cmd_setter)
-                cmd_getter = -1;
-            // Else set getter to index of next command
-            else 
-                cmd_getter = (cmd_getter + 1) % CMD_BUFFER_SIZE;
-            // Finally execute new command
-            current_cmd->execute();
+            int next = 0;   // Index of command with highest priority
+            int i;          // Index counter
+
+            // Take command with highest priority, oldest one if more of them have the same
+            for (i = 1; i < cmd_count; i++) {
+                if (current_priority(i) < current_priority(next))
+                    next = i;
+            }
+            execute_queued(next);
         } else {
             #ifdef MODEM_DEBUG
                 Serial.println(F("## MODEM loop: Current cmd DONE, all done !"));
@@ -302,50 +408,142 @@ void modem_manipulation::update() {
     }
 }
 
-void modem_manipulation::run_cmd(at_command &cmd) {
+void modem_manipulation::run_cmd(at_command &cmd, uint8_t priority) {
+    int i;  // Index counter
+
     // If there is not command currently executing execute command now
     if (current_cmd == NULL) {
+        ++wait_count[priority];
         current_cmd = &cmd;
         current_cmd->execute();
-    // Else add command to queue
-    } else {
-        // If queue is full discard command
-        if (cmd_setter == cmd_getter) return;
-        // If queue is empty set getter to setter value
-        if (cmd_getter == -1)
-            cmd_getter = cmd_setter;
-        // Add command to queue and go to next index
-        cmd_buffer[cmd_setter] = &cmd;
-        cmd_setter = (cmd_setter + 1) % CMD_BUFFER_SIZE;
+        return;
     }
+    // If command is already waiting it will handle this request too
+    for (i = 0; i < cmd_count; i++) {
+        if (cmd_buffer[i].cmd == &cmd) {
+            if (priority < cmd_buffer[i].priority)
+                cmd_buffer[i].priority = priority;
+            ++cmd_coalesced;
+            return;
+        }
+    }
+    // Add command to the end of queue, there is always place since each command is queued only once
+    cmd_buffer[cmd_count].cmd = &cmd;
+    cmd_buffer[cmd_count].priority = priority;
+    cmd_buffer[cmd_count].queued = millis();
+    ++cmd_count;
+    if (cmd_count > cmd_max_depth)
+        cmd_max_depth = cmd_count;
+}
+
+uint8_t modem_manipulation::current_priority(int index) {
+    uint8_t priority = cmd_buffer[index].priority;  // Priority class when command was queued
+    unsigned long steps;                            // Number of classes command moved up
+
+    if (priority <= PRIORITY_REPLY)
+        return priority;
+    steps = (millis() - cmd_buffer[index].queued) / CMD_AGING_INTERVAL;
+    if (steps >= (unsigned long)(priority - PRIORITY_REPLY))
+        return PRIORITY_REPLY;
+    return priority - steps;
+}
+
+void modem_manipulation::execute_queued(int index) {
+    uint8_t priority = cmd_buffer[index].priority;              // Priority class of command
+    unsigned long wait = millis() - cmd_buffer[index].queued;   // How long command waited in ms
+    int i;                                                      // Index counter
+
+    ++wait_count[priority];
+    wait_total[priority] += wait;
+    if (wait > wait_max[priority])
+        wait_max[priority] = wait;
+
+    current_cmd = cmd_buffer[index].cmd;
+    // Keep queue ordered from oldest to newest
+    for (i = index; i < cmd_count - 1; i++)
+        cmd_buffer[i] = cmd_buffer[i + 1];
+    --cmd_count;
+    current_cmd->execute();
+}
+
+int modem_manipulation::get_queue_depth() {
+    return cmd_count;
+}
+
+int modem_manipulation::get_queue_max_depth() {
+    return cmd_max_depth;
+}
+
+unsigned long modem_manipulation::get_queue_coalesced() {
+    return cmd_coalesced;
+}
+
+unsigned long modem_manipulation::get_wait_count(uint8_t priority) {
+    return wait_count[priority];
+}
+
+unsigned long modem_manipulation::get_wait_avg(uint8_t priority) {
+    return wait_count[priority] > 0 ? wait_total[priority] / wait_count[priority] : 0;
+}
+
+unsigned long modem_manipulation::get_wait_max(uint8_t priority) {
+    return wait_max[priority];
 }
 
 void modem_manipulation::start() {
     // Start modem
-    run_cmd(startup_modem);
+    run_cmd(startup_modem, PRIORITY_STARTUP);
     // Set delay to 4s
     delay_modem.set_delay(4000);
     // Run delay and then configure modem
-    run_cmd(delay_modem);
-    run_cmd(config_modem);
+    run_cmd(delay_modem, PRIORITY_STARTUP);
+    run_cmd(config_modem, PRIORITY_STARTUP);
 }
 
-void modem_manipulation::add_handler(unsolicited_response &handler) {
-    // Add handler to handlers array
-    handlers[handler_count] = &handler;
-    // Increase handlers count
-    ++handler_count;
+// Find first row in range which prefix has character at position greater or equal to ch
+static int prefix_bound(int low, int high, int position, int ch) {
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (pgm_read_byte(&unsolicited_table[middle].prefix[position]) < ch)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+unsolicited_response * modem_manipulation::find_handler(const char line[]) {
+    int low = 0;                            // First row which prefix matches line so far
+    int high = UNSOLICITED_COUNT;           // Row after last row which prefix matches line so far
+    unsolicited_response *found = NULL;     // Handler with longest prefix matched so far
+    int i;                                  // Index of line character
+
+    // Each character of line narrows range of rows, so line is read only once
+    for (i = 0; low < high; i++) {
+        // Prefix ending here matches line, it's first in range since '\0' sorts first
+        if (pgm_read_byte(&unsolicited_table[low].prefix[i]) == '\0') {
+            found = (unsolicited_response *)pgm_read_ptr(&unsolicited_table[low].handler);
+            ++low;
+        }
+        if (line[i] == '\0')
+            break;
+        low = prefix_bound(low, high, i, (uint8_t)line[i]);
+        high = prefix_bound(low, high, i, (uint8_t)line[i] + 1);
+    }
+    return found;
 }
 
 /********************************************************************
  * Command to check if modem is ready                               *
  ********************************************************************/
 check_cmd::check_cmd() {
+    type = CMD_CHECK;
     currently_waiting = COMMAND_ECHO;
 }
 
 void check_cmd::send_to_serial() {
-    Serial3.println("AT+CCID;+CPIN?;+CSQ;+CREG?");
+    modem_serial.println("AT+CCID;+CPIN?;+CSQ;+CREG?");
     currently_waiting = COMMAND_ECHO;
 }
 
@@ -440,9 +638,137 @@ void check_cmd::push_line(const char line[]) {
 /********************************************************************
  * Command to send sms messages                                     *
  ********************************************************************/
+log_page_text::log_page_text() {
+    position = 0;
+    count = 0;
+    line = 0;
+    line_start = 0;
+    buffer[0] = '\0';
+}
+
+void log_page_text::set_request(const log_page_request &page_request) {
+    unsigned long log_count;    // Number of logs on requested date now
+
+    request = page_request;
+    if (request.day == 0)
+        log_count = storage.get_log_count();
+    else
+        log_count = storage.get_log_count(request.day, request.month, request.year);
+    // Skip logs added after page was requested so each part of message is from the same page
+    position = (request.page - 1u) * SMS_LOG;
+    if (log_count > request.log_count)
+        position += log_count - request.log_count;
+    count = (log_count > position) ? log_count - position : 0;
+    if (count > SMS_LOG)
+        count = SMS_LOG;
+    line = 0;
+    line_start = 0;
+    make_line(0);
+}
+
+void log_page_text::make_line(unsigned int line_number) {
+    log_page_record record; // Log on this line together with user
+
+    line = line_number;
+    buffer[0] = '\0';
+    if (line < count) {
+        log_record &logr = record.log;
+        unsigned int read;  // Number of logs read, 0 or 1
+
+        if (request.day == 0)
+            read = storage.get_log_page(position + line, 1, &record);
+        else
+            read = storage.get_log_page(position + line, 1, request.day, request.month, request.year, &record);
+        if (read == 1) {
+            snprintf(
+                buffer, sizeof(buffer), "%02u-%02u-%04u %02u:%02u:%02u %s %s\n",
+                logr.day, logr.month, logr.year, logr.hour, logr.minute, logr.second, logr.action, record.user.number
+            );
+            return;
+        }
+        // Log which can't be read ends the page
+        count = line;
+    }
+    if (line == count) {
+        snprintf(
+            buffer, sizeof(buffer), "\nStr %lu/%lu",
+            request.page, (request.log_count / SMS_LOG) + !!(request.log_count % SMS_LOG)
+        );
+    }
+}
+
+uint8_t log_page_text::read_byte(int text_position) {
+    // Builder goes back only to the start, then page is made again from first line
+    if (text_position < line_start) {
+        line_start = 0;
+        make_line(0);
+    }
+    // Move to line with requested character, line which can't be read ends the text
+    while (text_position >= line_start + strlength(buffer)) {
+        if (buffer[0] == '\0')
+            return '\0';
+        line_start += strlength(buffer);
+        make_line(line + 1);
+    }
+    return buffer[text_position - line_start];
+}
+
 sms_cmd::sms_cmd() {
+    int i;  // Index counter
+
+    type = CMD_SMS;
     getter = -1;
     setter = 0;
+    text_head = 0;
+    part_count = 1;
+    reference = 0;
+    overflows = 0;
+    submit_start = 0;
+    prompt_time = 0;
+    prompt_count = 0;
+    prompt_wait_total = 0;
+    prompt_wait_max = 0;
+    prompt_timeouts = 0;
+    sent_count = 0;
+    submit_total = 0;
+    submit_max = 0;
+    retry_wait = 0;
+    for (i = 0; i < SMS_MAX_ATTEMPTS; i++)
+        attempt_histogram[i] = 0;
+    spooled = 0;
+    latency_count = 0;
+    latency_total = 0;
+    latency_max = 0;
+    queue_peak = 0;
+}
+
+void sms_cmd::unpack_number(int index, char number[]) {
+    int i;  // Digit counter
+
+    for (i = 0; i < SMS_NUMBER_BYTES * 2; i++) {
+        uint8_t digit = (i % 2 == 0) ? queue[index].number[i / 2] >> 4 : queue[index].number[i / 2] & 0x0F;
+        if (digit > 9) break;
+        number[i] = '0' + digit;
+    }
+    number[i] = '\0';
+}
+
+void sms_cmd::set_builder(builder &new_pdu, log_page_text &page) {
+    char number[SMS_NUMBER_BYTES * 2 + 1];  // Unpacked recipient number
+
+    unpack_number(getter, number);
+    new_pdu.set_number(number);
+    if (queue[getter].text_offset == -1) {
+        new_pdu.set_message(queue[getter].flash_text);
+    } else if (queue[getter].log_page) {
+        log_page_request request;   // Copy of request, text pool is not aligned
+
+        memcpy(&request, text_pool + queue[getter].text_offset, sizeof(request));
+        page.set_request(request);
+        new_pdu.set_message(page);
+    } else {
+        new_pdu.set_message(text_pool + queue[getter].text_offset);
+    }
 }
 
 void sms_cmd::send_to_serial() {
@@ -451,22 +777,312 @@ void sms_cmd::send_to_serial() {
         is_done = 1;
         return;
     }
-    // Send sms message
-    Serial3.print("AT+CMGS=");
-    Serial3.println(tpdu_length[getter]);
-    // Modem needs 120ms to start listening for PDU start
-    delay(150);
-    // Send PDU
-    Serial3.print(pdu[getter]);
-    Serial3.println("\x1A");
+    // If first message failed before wait until it can be sent again
+    if (queue[getter].attempts > 0 && (long)(millis() - queue[getter].retry_at) < 0) {
+        retry_wait = 1;
+        is_done = 1;
+        return;
+    }
+    log_page_text page;         // Text of log page
+    builder new_pdu;            // Builder for PDU of message
+
+    // Only length of PDU is needed now, PDU is calculated again when modem asks for it
+    set_builder(new_pdu, page);
+    // Long message is sent in parts, all parts have the same reference number,
+    // message sent again after failure keeps it and continues from part which failed
+    part_count = new_pdu.get_part_count();
+    if (queue[getter].part == 0 && part_count > 1)
+        queue[getter].reference = ++reference;
+    new_pdu.set_part(queue[getter].part, queue[getter].reference);
+    new_pdu.calculate();
+    // Each part gets its own budget
+    restart_budget();
+
+    // Send sms message, PDU is sent once modem asks for it
+    modem_serial.print("AT+CMGS=");
+    modem_serial.println(new_pdu.get_tpdu_length());
+    submit_start = millis();
     // Start listening for modem response
     currently_waiting = COMMAND_ECHO;
 }
 
+void sms_cmd::timeout() {
+    fail_message();
+}
+
+void sms_cmd::fail_message() {
+    sms_queue_record failed = queue[getter];    // Copy of message, it's removed from queue after it's queued again
+    int offset = -1;                            // Offset of message text in text pool
+
+    // There are messages left in queue, or failed one waits for retry
+    // Failed message is removed before it's queued again, so there is always a free slot for it
+    retry_wait = 1;
+    if (failed.attempts + 1 >= SMS_MAX_ATTEMPTS) {
+        spool_message();
+        next_message();
+        return;
+    }
+    // Wait before next attempt doubles after each failure
+    unsigned long backoff = (unsigned long)SMS_RETRY_BACKOFF << failed.attempts;
+    if (backoff > SMS_RETRY_BACKOFF_MAX)
+        backoff = SMS_RETRY_BACKOFF_MAX;
+
+    ++failed.attempts;
+    failed.retry_at = millis() + backoff;
+    // Text from RAM is copied after the newest message, old copy is freed when message is removed
+    if (failed.text_offset != -1) {
+        // Size of message with \0, or size of log page request
+        int size = failed.log_page ? (int)sizeof(log_page_request) : strlength(text_pool + failed.text_offset) + 1;
+
+        offset = text_alloc(size);
+        // If there is no space for copy message stays first in queue and others wait for it
+        if (offset == -1) {
+            queue[getter] = failed;
+            return;
+        }
+        memmove(text_pool + offset, text_pool + failed.text_offset, size);
+        text_head = offset + size;
+    }
+    next_message();
+
+    failed.text_offset = offset;
+    queue[setter] = failed;
+    // If getter is -1 (queue is empty) set it to current field
+    if (getter == -1)
+        getter = setter;
+    setter = (setter + 1) % SMS_BUFFER_SIZE;
+    // Urgent message stays in front of others while it waits for retry
+    if (failed.urgent)
+        promote(1, 0);
+}
+
+void sms_cmd::promote(int count, int keep_first) {
+    int queued = get_queued_count();    // Number of messages in queue
+    int first = keep_first;             // Position in queue where urgent messages are placed
+    int i, j;                           // Position counters
+
+    if (count > queued)
+        count = queued;
+    if (first > queued - count)
+        first = queued - count;
+    // Urgent messages are sent in the order they were made urgent
+    while (first < queued - count && queue[(getter + first) % SMS_BUFFER_SIZE].urgent)
+        ++first;
+    // Each message is moved to its place, messages between are shifted one place back
+    for (i = 0; i < count; i++) {
+        int from = queued - count + i;                              // Position of message which is moved
+        sms_queue_record message = queue[(getter + from) % SMS_BUFFER_SIZE];
+
+        for (j = from; j > first + i; j--)
+            queue[(getter + j) % SMS_BUFFER_SIZE] = queue[(getter + j - 1) % SMS_BUFFER_SIZE];
+        message.urgent = 1;
+        queue[(getter + first + i) % SMS_BUFFER_SIZE] = message;
+    }
+}
+
+void sms_cmd::make_urgent(int count) {
+    // While command runs first message is being sent, it's first until modem confirms it
+    promote(count, !is_done);
+}
+
+void sms_cmd::spool_message() {
+    sms_spool_record record;                // Message stored to SMS spool
+    char number[SMS_NUMBER_BYTES * 2 + 1];   // Unpacked recipient number
+
+    record.attempts = queue[getter].attempts + 1;
+    unpack_number(getter, number);
+    strcopy(number, record.number, sizeof(record.number) - 1);
+    if (queue[getter].text_offset == -1) {
+        strncpy_P(record.text, (const char *)queue[getter].flash_text, SMS_SPOOL_TEXT);
+    } else if (queue[getter].log_page) {
+        log_page_text page;         // Text of log page
+        log_page_request request;   // Copy of request, text pool is not aligned
+        int i;                      // Character counter
+
+        memcpy(&request, text_pool + queue[getter].text_offset, sizeof(request));
+        page.set_request(request);
+        for (i = 0; i < SMS_SPOOL_TEXT && (record.text[i] = page.read_byte(i)) != '\0'; i++);
+    } else {
+        strncpy(record.text, text_pool + queue[getter].text_offset, SMS_SPOOL_TEXT);
+    }
+    record.text[SMS_SPOOL_TEXT] = '\0';
+    storage.spool_sms(record);
+    ++spooled;
+}
+
+int sms_cmd::retry_due() {
+    // If command is running or nothing is left in queue there is nothing to do
+    if (!retry_wait || !is_done || getter == -1)
+        return 0;
+    // First message waits for retry
+    if (queue[getter].attempts > 0 && (long)(millis() - queue[getter].retry_at) < 0)
+        return 0;
+    retry_wait = 0;
+    return 1;
+}
+
+void sms_cmd::next_message() {
+    // Move to next message in the queue
+    if ((getter + 1) % SMS_BUFFER_SIZE == setter) {
+        getter = -1;
+    } else {
+        getter = (getter + 1) % SMS_BUFFER_SIZE;
+    }
+}
+
+void sms_cmd::push_prompt() {
+    // Prompt can arrive before command echo if echo is off
+    if (currently_waiting != COMMAND_ECHO && currently_waiting != PROMPT) return;
+
+    log_page_text page;         // Text of log page
+    builder new_pdu;            // Builder for PDU of message
+
+    // PDU is not kept after AT+CMGS, it's calculated again from the same message, part and reference
+    set_builder(new_pdu, page);
+    new_pdu.set_part(queue[getter].part, queue[getter].reference);
+    new_pdu.calculate();
+    modem_serial.print(new_pdu.get_pdu());
+    modem_serial.println("\x1A");
+
+    prompt_time = millis();
+    ++prompt_count;
+    prompt_wait_total += prompt_time - submit_start;
+    if (prompt_time - submit_start > prompt_wait_max)
+        prompt_wait_max = prompt_time - submit_start;
+
+    // Message stays first in queue until modem confirms it's sent
+    currently_waiting = PDU_ECHO;
+}
+
+void sms_cmd::update() {
+    if (currently_waiting != COMMAND_ECHO && currently_waiting != PROMPT) return;
+    if (millis() - submit_start <= SMS_PROMPT_WAIT) return;
+
+    // Cancel AT+CMGS with ESC and send message again later
+    modem_serial.write(0x1B);
+    ++prompt_timeouts;
+    fail_message();
+    system_control.ready(OFF);
+    system_control.set_error(ERROR_MODEM_SMS_SEND);
+    is_done = 1;
+}
+
+void sms_cmd::stop() {
+    // Message which was being sent stays first in queue and it's not counted as failed
+    is_done = 1;
+    retry_wait = 1;
+}
+
+unsigned long sms_cmd::get_attempt_count(int attempt) {
+    return attempt_histogram[attempt];
+}
+
+unsigned long sms_cmd::get_spooled() {
+    return spooled;
+}
+
+unsigned long sms_cmd::get_latency_avg() {
+    return latency_count > 0 ? latency_total / latency_count : 0;
+}
+
+unsigned long sms_cmd::get_latency_max() {
+    return latency_max;
+}
+
+int sms_cmd::get_queue_peak() {
+    return queue_peak;
+}
+
+unsigned long sms_cmd::get_sent_count() {
+    return sent_count;
+}
+
+unsigned long sms_cmd::get_prompt_timeouts() {
+    return prompt_timeouts;
+}
+
+unsigned long sms_cmd::get_prompt_wait_avg() {
+    return prompt_count > 0 ? prompt_wait_total / prompt_count : 0;
+}
+
+unsigned long sms_cmd::get_prompt_wait_max() {
+    return prompt_wait_max;
+}
+
+unsigned long sms_cmd::get_submit_avg() {
+    return sent_count > 0 ? submit_total / sent_count : 0;
+}
+
+unsigned long sms_cmd::get_submit_max() {
+    return submit_max;
+}
+
 void sms_cmd::clear() {
     // Set getter and setter like there is nothing in the queue
     getter = -1;
     setter = 0;
+    text_head = 0;
+    retry_wait = 0;
+}
+
+int sms_cmd::text_alloc(int size) {
+    int i;          // Queue index
+    int tail = -1;  // Offset of oldest message in text pool
+
+    // Find oldest message in text pool, it's the first one after the newest since urgent
+    // messages are moved in queue, order of messages in queue and in text pool can differ
+    for (i = getter; i != -1; i = ((i + 1) % SMS_BUFFER_SIZE == setter) ? -1 : (i + 1) % SMS_BUFFER_SIZE) {
+        if (queue[i].text_offset == -1) continue;
+        if (tail == -1 || (queue[i].text_offset - text_head + SMS_TEXT_POOL) % SMS_TEXT_POOL <
+            (tail - text_head + SMS_TEXT_POOL) % SMS_TEXT_POOL)
+            tail = queue[i].text_offset;
+    }
+    // Text pool is empty
+    if (tail == -1)
+        text_head = 0;
+    // Message longer than whole pool never fits
+    if (size > SMS_TEXT_POOL)
+        return -1;
+
+    // Messages are placed after the newest one, or at the start if they don't fit at the end
+    if (tail == -1 || text_head > tail) {
+        if (SMS_TEXT_POOL - text_head >= size)
+            return text_head;
+        if (tail == -1 || tail >= size)
+            return 0;
+    } else if (tail - text_head >= size) {
+        return text_head;
+    }
+    return -1;
+}
+
+int sms_cmd::add_recipient(const char number[]) {
+    int i, digits;  // Character and digit counters
+
+    // If queue is full discard message
+    if (setter == getter) {
+        ++overflows;
+        return 0;
+    }
+    queue[setter].log_page = 0;
+    queue[setter].attempts = 0;
+    queue[setter].part = 0;
+    queue[setter].reference = 0;
+    queue[setter].urgent = 0;
+    queue[setter].retry_at = 0;
+    queue[setter].queued_at = millis();
+    // Pack digits of number, rest of the bytes is filled with 0xF
+    for (i = 0; i < SMS_NUMBER_BYTES; i++)
+        queue[setter].number[i] = 0xFF;
+    for (i = 0, digits = 0; number[i] != '\0' && digits < SMS_NUMBER_BYTES * 2; i++) {
+        if (number[i] < '0' || number[i] > '9') continue;
+        if (digits % 2 == 0)
+            queue[setter].number[digits / 2] = (number[i] - '0') << 4 | 0x0F;
+        else
+            queue[setter].number[digits / 2] = (queue[setter].number[digits / 2] & 0xF0) | (number[i] - '0');
+        ++digits;
+    }
+    return 1;
 }
 
 void sms_cmd::add_message(const char number[], const char message[]) {
@@ -474,22 +1090,28 @@ void sms_cmd::add_message(const char number[], const char message[]) {
         Serial.println(F("MODEM sms: Adding new message to queue (from RAM)"));
         Serial.flush();
     #endif
-    // If queue is full discard message
-    if (setter == getter) return;
+    int size = strlength(message) + 1;  // Size of message with \0
+    int offset;                         // Offset of message in text pool
+
+    if (!add_recipient(number)) return;
+    // If there is no space for message text discard message
+    offset = text_alloc(size);
+    if (offset == -1) {
+        ++overflows;
+        return;
+    }
+    // Store message to text pool
+    strcopy(message, text_pool + offset, size);
+    text_head = offset + size;
+    queue[setter].flash_text = NULL;
+    queue[setter].text_offset = offset;
     // If getter is -1 (queue is empty) set it to current field
     if (getter == -1)
         getter = setter;
-    // Initiate builder and calculate PDU
-    builder new_pdu;
-    new_pdu.set_number(number);
-    new_pdu.set_message(message);
-    new_pdu.calculate();
-    // Store calculated PDU to the queue
-    strcopy(new_pdu.get_pdu(), pdu[setter], BUFFER_SIZE);
-    // Store TPDU length to the queue
-    tpdu_length[setter] = new_pdu.get_tpdu_length();
     // Go to next field in the queue
     setter = (setter + 1) % SMS_BUFFER_SIZE;
+    if (get_queued_count() > queue_peak)
+        queue_peak = get_queued_count();
 }
 
 void sms_cmd::add_message(const char number[], const __FlashStringHelper *message) {
@@ -497,54 +1119,94 @@ void sms_cmd::add_message(const char number[], const __FlashStringHelper *messag
         Serial.println(F("MODEM sms: Adding new message to queue (from FLASH)"));
         Serial.flush();
     #endif
-    // If queue is full discard message
-    if (setter == getter) return;
+    if (!add_recipient(number)) return;
+    // Message stays in flash until it's sent
+    queue[setter].flash_text = message;
+    queue[setter].text_offset = -1;
+    // If getter is -1 (queue is empty) set it to current field
+    if (getter == -1)
+        getter = setter;
+    // Go to next field in the queue
+    setter = (setter + 1) % SMS_BUFFER_SIZE;
+    if (get_queued_count() > queue_peak)
+        queue_peak = get_queued_count();
+}
+
+void sms_cmd::add_log_page(const char number[], const log_page_request &request) {
+    #ifdef MODEM_DEBUG
+        Serial.println(F("MODEM sms: Adding new log page to queue"));
+        Serial.flush();
+    #endif
+    int offset;     // Offset of request in text pool
+
+    if (!add_recipient(number)) return;
+    // If there is no space for request discard message
+    offset = text_alloc(sizeof(request));
+    if (offset == -1) {
+        ++overflows;
+        return;
+    }
+    // Only request is stored, text is read from SD card when message is sent
+    memcpy(text_pool + offset, &request, sizeof(request));
+    text_head = offset + sizeof(request);
+    queue[setter].flash_text = NULL;
+    queue[setter].text_offset = offset;
+    queue[setter].log_page = 1;
     // If getter is -1 (queue is empty) set it to current field
     if (getter == -1)
         getter = setter;
-    // Initiate builder and calculate PDU
-    builder new_pdu;
-    new_pdu.set_number(number);
-    new_pdu.set_message(message);
-    new_pdu.calculate();
-    // Store calculated PDU to the queue
-    strcopy(new_pdu.get_pdu(), pdu[setter], BUFFER_SIZE);
-    // Store TPDU length to the queue
-    tpdu_length[setter] = new_pdu.get_tpdu_length();
     // Go to next field in the queue
     setter = (setter + 1) % SMS_BUFFER_SIZE;
+    if (get_queued_count() > queue_peak)
+        queue_peak = get_queued_count();
+}
+
+int sms_cmd::get_queued_count() {
+    if (getter == -1)
+        return 0;
+    return (setter - getter + SMS_BUFFER_SIZE - 1) % SMS_BUFFER_SIZE + 1;
+}
+
+unsigned long sms_cmd::get_overflows() {
+    return overflows;
 }
 
 void sms_cmd::push_line(const char line[]) {
     switch (currently_waiting) {
         case COMMAND_ECHO:
-            // Once command echo arrived
+            // Once command echo arrived wait for prompt
             if (strstartswith(line, "AT+CMGS=")) {
-                // Move to waiting for PDU echo
-                currently_waiting = PDU_ECHO;
-                // Move to next message in the queue
-                if ((getter + 1) % SMS_BUFFER_SIZE == setter) {
-                    getter = -1;
-                } else {
-                    getter = (getter + 1) % SMS_BUFFER_SIZE;
-                }
+                currently_waiting = PROMPT;
+            }
+            break;
+        case PROMPT:
+            // Modem refused command, message is sent again later
+            if (strcompare(line, "ERROR") || strstartswith(line, "+CMS ERROR")) {
+                fail_message();
+                system_control.ready(OFF);
+                system_control.set_error(ERROR_MODEM_SMS_SEND);
+                is_done = 1;
             }
             break;
         case PDU_ECHO:
-            // On PDU echo continue waiting for message reference
-            if (strstartswith(line, ">")) {
-                currently_waiting = MSG_INFO;
-            } else if (strcompare(line, "ERROR")) {
+            // On PDU echo continue waiting for message reference, without echo reference arrives first
+            if (strstartswith(line, "+CMGS: ")) {
+                currently_waiting = FINAL_OK;
+            } else if (strcompare(line, "ERROR") || strstartswith(line, "+CMS ERROR")) {
+                fail_message();
                 system_control.ready(OFF);
                 system_control.set_error(ERROR_MODEM_SMS_SEND);
                 is_done = 1;
+            } else {
+                currently_waiting = MSG_INFO;
             }
             break;
         case MSG_INFO:
             // And finally after message reference wait for final OK
             if (strstartswith(line, "+CMGS: ")) {
                 currently_waiting = FINAL_OK;
-            } else if (strcompare(line, "ERROR")) {
+            } else if (strcompare(line, "ERROR") || strstartswith(line, "+CMS ERROR")) {
+                fail_message();
                 system_control.ready(OFF);
                 system_control.set_error(ERROR_MODEM_SMS_SEND);
                 is_done = 1;
@@ -553,12 +1215,34 @@ void sms_cmd::push_line(const char line[]) {
         case FINAL_OK:
             // Then move to next message or finish
             if (strcompare(line, "OK")) {
+                ++sent_count;
+                submit_total += millis() - submit_start;
+                if (millis() - submit_start > submit_max)
+                    submit_max = millis() - submit_start;
+                // Sending works again
+                if (system_control.test_error(ERROR_MODEM_SMS_SEND))
+                    system_control.unset_error(ERROR_MODEM_SMS_SEND);
+
+                // Send next part of the same message, or move to next message
+                if (queue[getter].part + 1 < part_count) {
+                    ++queue[getter].part;
+                } else {
+                    unsigned long latency = millis() - queue[getter].queued_at;    // Time since message was queued
+
+                    ++latency_count;
+                    latency_total += latency;
+                    if (latency > latency_max)
+                        latency_max = latency;
+                    ++attempt_histogram[queue[getter].attempts];
+                    next_message();
+                }
                 if (getter == -1) {
                     is_done = 1;
                 } else {
                     send_to_serial();
                 }
-            } else if (strcompare(line, "ERROR")) {
+            } else if (strcompare(line, "ERROR") || strstartswith(line, "+CMS ERROR")) {
+                fail_message();
                 system_control.ready(OFF);
                 system_control.set_error(ERROR_MODEM_SMS_SEND);
                 is_done = 1;
@@ -571,6 +1255,7 @@ void sms_cmd::push_line(const char line[]) {
  * Command to pause execution of commands                           *
  ********************************************************************/
 delay_cmd::delay_cmd() {
+    type = CMD_DELAY;
     delay_start = 0;
     delay_duritation = 0;
 }
@@ -611,7 +1296,9 @@ void delay_cmd::update() {
  * Command to configure modem                                       *
  ********************************************************************/
 config_cmd::config_cmd() {
+    type = CMD_CONFIG;
     currently_waiting = COMMAND_ECHO;
+    inbox_mode = 0;
 }
 
 void config_cmd::send_to_serial() {
@@ -619,7 +1306,12 @@ void config_cmd::send_to_serial() {
         Serial.println(F("## MODEM config: config started"));
         Serial.flush();
     #endif
-    Serial3.println("AT+CMGF=0;+CNMI=2,2,0,0,0");
+    // In inbox mode modem stores messages to SIM and sends only +CMTI with index
+    inbox_mode = !system_control.test_error(ERROR_SD) && storage.get_setting(SETTING_SMS_INBOX).int_value;
+    if (inbox_mode)
+        modem_serial.println("AT+CMGF=0;+CNMI=2,1,0,0,0");
+    else
+        modem_serial.println("AT+CMGF=0;+CNMI=2,2,0,0,0");
     currently_waiting = COMMAND_ECHO;
     is_done = 0;
 }
@@ -627,7 +1319,7 @@ void config_cmd::send_to_serial() {
 void config_cmd::push_line(const char line[]) {
     switch (currently_waiting) {
         case COMMAND_ECHO:
-            if (strcompare(line, "AT+CMGF=0;+CNMI=2,2,0,0,0")) {
+            if (strcompare(line, inbox_mode ? "AT+CMGF=0;+CNMI=2,1,0,0,0" : "AT+CMGF=0;+CNMI=2,2,0,0,0")) {
                 currently_waiting = FINAL_OK;
             }
             break;
@@ -638,16 +1330,523 @@ void config_cmd::push_line(const char line[]) {
                     Serial.flush();
                 #endif
                 is_done = 1;
+                // Messages stored before modem was configured don't get +CMTI
+                if (inbox_mode)
+                    modem.run_cmd(inbox_modem, PRIORITY_REPLY);
             }
             break;
     }
 }
 
+/********************************************************************
+ * Commands which can be sent by SMS                                *
+ ********************************************************************/
+
+// Open or close small door (vmo, vmz)
+static void sms_door_small(const command_call &call) {
+    // Get current door state
+    int state = relay.get_door_small();
+    // If door is in unknown position send error message
+    if (state == DOOR_MIDDLE || state == DOOR_ERROR) {
+        sms_modem.add_message(call.number, F("Greska, mala vrata su u nepoznatom polozaju"));
+    }
+    // If door opening is requested
+    else if (call.entry->log[2] == 'O') {
+        // Open the door if door is closed
+        if (state == DOOR_CLOSED) {
+            sms_modem.add_message(call.number, F("Pokrecem postupak otvaranja malih vrata"));
+            storage.log_this(call.user_id, call.entry->log);
+            relay.door_small(DOPEN);
+        }
+        else if (state == DOOR_OPENED) {
+            sms_modem.add_message(call.number, F("Nemoguce otvoriti mala vrata, vrata su vec otvorena"));
+        }
+    }
+    // If door closing is requested
+    else {
+        // Close the door if door is opened
+        if (state == DOOR_OPENED) {
+            sms_modem.add_message(call.number, F("Pokrecem postupak zatvaranja malih vrata"));
+            storage.log_this(call.user_id, call.entry->log);
+            relay.door_small(DCLOSE);
+        }
+        else if (state == DOOR_CLOSED) {
+            sms_modem.add_message(call.number, F("Nemoguce zatvoriti mala vrata, vrata su vec zatvorena"));
+        }
+    }
+}
+
+// Open or close big door (vvo, vvz)
+static void sms_door_big(const command_call &call) {
+    // Get current door state
+    int state = relay.get_door_big();
+    // If door is in unknown position send error message
+    if (state == DOOR_MIDDLE || state == DOOR_ERROR) {
+        sms_modem.add_message(call.number, F("Greska, velika vrata su u nepoznatom polozaju"));
+    }
+    // If door opening is requested
+    else if (call.entry->log[2] == 'O') {
+        if (state == DOOR_CLOSED) {
+            sms_modem.add_message(call.number, F("Pokrecem postupak otvaranja velikih vrata"));
+            storage.log_this(call.user_id, call.entry->log);
+            relay.door_big(DOPEN);
+        }
+        else if (state == DOOR_OPENED) {
+            sms_modem.add_message(call.number, F("Nemoguce otvoriti velika vrata, vrata su vec otvorena"));
+        }
+    }
+    // If door closing is requested
+    else {
+        if (state == DOOR_OPENED) {
+            sms_modem.add_message(call.number, F("Pokrecem postupak zatvaranja velikih vrata"));
+            storage.log_this(call.user_id, call.entry->log);
+            relay.door_big(DCLOSE);
+        }
+        else if (state == DOOR_CLOSED) {
+            sms_modem.add_message(call.number, F("Nemoguce zatvoriti velika vrata, vrata su vec zatvorena"));
+        }
+    }
+}
+
+// Stop siren (ust)
+static void sms_siren_stop(const command_call &call) {
+    sms_modem.add_message(call.number, F("Pokrecem postupak zaustavljanja sirene ukoliko je aktivna"));
+    storage.log_this(call.user_id, call.entry->log);
+    relay.siren_stop();
+}
+
+// Start siren (una, une, upr, uva)
+static void sms_siren(const command_call &call) {
+    const char *log = call.entry->log;
+
+    // If siren is running and other siren is requested send error
+    if (relay.get_siren() != SIREN_OFF) {
+        sms_modem.add_message(call.number, F("Sirena je trenutno aktivna, kako biste pokrenuli sirenu zaustavite je, te ponovo pokrenite"));
+        return;
+    }
+    // Start siren nadolazeca opasnost
+    if (strcompare(log, "UNA")) {
+        sms_modem.add_message(call.number, F("Pokrecem uzbunu Nadolazeca opasnost"));
+        storage.log_this(call.user_id, log);
+        relay.siren_nadolazeca();
+    }
+    // Start siren neposredna opasnost
+    else if (strcompare(log, "UNE")) {
+        sms_modem.add_message(call.number, F("Pokrecem uzbunu Neposredna opasnost"));
+        storage.log_this(call.user_id, log);
+        relay.siren_neposredna();
+    }
+    // Start siren prestanak opasnosti
+    else if (strcompare(log, "UPR")) {
+        sms_modem.add_message(call.number, F("Pokrecem uzbunu Prestanak opasnosti"));
+        storage.log_this(call.user_id, log);
+        relay.siren_prestanak();
+    }
+    // Start siren vatrogasna uzbuna
+    else if (strcompare(log, "UVA")) {
+        sms_modem.add_message(call.number, F("Pokrecem uzbunu Vatrogasna uzbuna"));
+        storage.log_this(call.user_id, log);
+        relay.siren_vatrogasna();
+    }
+}
+
+// Turn light on or off (son, sof)
+static void sms_light(const command_call &call) {
+    // Get current state of light
+    int state = relay.get_light();
+    // If light on is requested
+    if (call.entry->log[2] == 'N') {
+        if (state == OFF) {
+            sms_modem.add_message(call.number, F("Pokrecem postupak paljenja svjetla"));
+            storage.log_this(call.user_id, call.entry->log);
+            relay.light(ON);
+        }
+        else if (state == ON) {
+            sms_modem.add_message(call.number, F("Nemoguce upaliti svjetlo, svjetlo je vec upaljeno"));
+        }
+    }
+    // If light off is requested
+    else {
+        if (state == ON) {
+            sms_modem.add_message(call.number, F("Pokrecem postupak gasenja svjetla"));
+            storage.log_this(call.user_id, call.entry->log);
+            relay.light(OFF);
+        }
+        else if (state == OFF) {
+            sms_modem.add_message(call.number, F("Nemoguce ugasiti svjetlo, svjetlo je vec ugaseno"));
+        }
+    }
+}
+
+// Send state of doors, light and siren (status)
+static void sms_status(const command_call &call) {
+    char anwser[100];
+    int big = relay.get_door_big();      // Get state of big door
+    int small = relay.get_door_small();  // Get state of small door
+    int light = relay.get_light();       // Get state of light
+    int siren = relay.get_siren();       // Get state of siren
+
+    // Create anwser message
+    sprintf(anwser, "%s\n\nMala Vrata: %s\nVelika Vrata: %s\nSvjetlo: %s\nSirena: %s",
+        // Get current motd and set it as title
+        main_panel.get_motd(),
+        // Print current state of small door
+        (small == DOOR_ERROR) ? "ERR" :                                    // If door state is error print ERR
+            (small == DOOR_MIDDLE) ? "NEP" :                               // If door state is unknown print NEP
+                (small == DOOR_OPENED) ? "OTV" :                           // If door state is opened print OTV
+                    "ZAT",                                                 // Else door must be in closed state so print ZAT
+        // Print current state of big door
+        (big == DOOR_ERROR) ? "ERR" :                                      // If door state is error print ERR
+            (big == DOOR_MIDDLE) ? "NEP" :                                 // If door state is unknown print NEP
+                (big == DOOR_OPENED) ? "OTV" :                             // If door state is opened print OTV
+                    "ZAT",                                                 // Else door must be in closed state so print ZAT
+        // Print current state of light
+        (light == ON) ? "ON" :                                             // If light is on print ON
+            "OFF",                                                         // If light is off print OFF
+        // Get siren currently running
+        (siren == SIREN_OFF) ? "OFF" :                                     // If no siren is running print OFF
+            (siren == SIREN_NADOLAZECA) ? "Nadolazeca opasnost" :          // If siren is Nadolazeca opasnost
+                (siren == SIREN_NEPOSREDNA) ? "Neposredna opasnost" :      // If siren is Neposredna opasnost
+                    (siren == SIREN_PRESTANAK) ? "Prestanak opasnosti" :   // If siren is Prestanak opasnosti
+                        "Vatrogasna uzbuna"                                // Else it must be Vatrogasna uzbuna
+    );
+
+    sms_modem.add_message(call.number, anwser);
+}
+
+// Send page of log records, all or for given date (log <page>, log DD.MM. [page])
+static void sms_log(const command_call &call) {
+    log_page_request request;   // Page queued for sending, text is read from SD card when it's sent
+    uint8_t day, month;
+    // Check if logs for specific date are requested (log DD.MM. [page])
+    int args = sscanf(call.args, "%hhu.%hhu. %lu", &day, &month, &request.page);
+
+    if (args == 2 || args == 3) {
+        // If page is not given send first page
+        if (args == 2)
+            request.page = 1;
+        // Date is always in current year
+        request.year = storage.now().Year();
+        request.day = day;
+        request.month = month;
+        request.log_count = storage.get_log_count(day, month, request.year);
+
+        if (request.page > 0 && request.log_count > (request.page - 1u) * SMS_LOG) {
+            sms_modem.add_log_page(call.number, request);
+        } else {
+            sms_modem.add_message(call.number, F("Nema zapisa loga za trazeni datum"));
+        }
+    }
+    else if (sscanf(call.args, "%lu", &request.page) == 1) {
+        request.year = 0;
+        request.day = 0;
+        request.month = 0;
+        request.log_count = storage.get_log_count();
+
+        if (request.log_count > (request.page - 1u) * SMS_LOG) {
+            sms_modem.add_log_page(call.number, request);
+        } else {
+            sms_modem.add_message(call.number, F("Trazena stranica loga ne postoji"));
+        }
+    } else {
+        sms_modem.add_message(call.number, F("Sintaksa naredbe log je:\nlog <stranica>\nlog DD.MM. [stranica]"));
+    }
+}
+
+// Change state of door without checking sensors (premosti <vvo/vvz/vmo/vmz>)
+static void sms_override(const command_call &call) {
+    // If override of big door is requested
+    if (strcompare(call.args, "vvo") || strcompare(call.args, "vvz")) {
+        storage.log_this(call.user_id, "PVV");
+        relay.override_door_big(DOPEN);
+        sms_modem.add_message(call.number, F("Zaobilazim sigurnosne provjere magnetskih senzora i pokrecem promjenu stanja velikih vrata bez obzira na trenutno stanje"));
+    }
+    // If override of small door opening is requested
+    else if (strcompare(call.args, "vmo")) {
+        storage.log_this(call.user_id, "PMO");
+        relay.override_door_small(DOPEN);
+        sms_modem.add_message(call.number, F("Zaobilazim sigurnosne provjere magnetskih senzora i pokrecem otvaranje malih vrata bez obzira na trenutno stanje"));
+    }
+    // If override of small door closing is requested
+    else if (strcompare(call.args, "vmz")) {
+        storage.log_this(call.user_id, "PMZ");
+        relay.override_door_small(DCLOSE);
+        sms_modem.add_message(call.number, F("Zaobilazim sigurnosne provjere magnetskih senzora i pokrecem zatvaranje malih vrata bez obzira na trenutno stanje"));
+    }
+    // If command syntax is incorrect send error and help
+    else {
+        sms_modem.add_message(call.number, F("Sintaksa naredbe premosti je:\npremosti <vvo/vvz/vmo/vmz>"));
+    }
+}
+
+// Open both doors and turn light on (1)
+static void sms_group_1(const command_call &call) {
+    // Perform requested actions
+    relay.door_big(DOPEN);
+    relay.door_small(DOPEN);
+    relay.light(ON);
+    // Log requested actions after they are started
+    storage.log_this(call.user_id, "VVO");
+    storage.log_this(call.user_id, "VMO");
+    storage.log_this(call.user_id, "SON");
+    // Send report
+    sms_modem.add_message(call.number, F("Pokrecem grupno izvrsavanje naredbi:\n- Otvori mala vrata\n- Otvori velika vrata\n- Upali svjetlo"));
+}
+
+// Open big door (2)
+static void sms_group_2(const command_call &call) {
+    // Perform requested actions
+    relay.door_big(DOPEN);
+    // Log requested actions after they are started
+    storage.log_this(call.user_id, "VVO");
+    // Send report
+    sms_modem.add_message(call.number, F("Pokrecem pokusaj otvaranja velikih vrata"));
+}
+
+// Open small door (3)
+static void sms_group_3(const command_call &call) {
+    // Perform requested actions
+    relay.door_small(DOPEN);
+    // Log requested actions after they are started
+    storage.log_this(call.user_id, "VMO");
+    // Send report
+    sms_modem.add_message(call.number, F("Pokrecem pokusaj otvaranja malih vrata"));
+}
+
+// Open both doors, turn light on and start fire siren (4)
+static void sms_group_4(const command_call &call) {
+    // Perform requested actions
+    relay.door_big(DOPEN);
+    relay.door_small(DOPEN);
+    relay.light(ON);
+    relay.siren_vatrogasna();
+    // Log requested actions after they are started
+    storage.log_this(call.user_id, "VVO");
+    storage.log_this(call.user_id, "VMO");
+    storage.log_this(call.user_id, "SON");
+    storage.log_this(call.user_id, "UVA");
+    // Send report
+    sms_modem.add_message(call.number, F("Pokrecem grupno izvrsavanje naredbi:\n- Otvori mala vrata\n- Otvori velika vrata\n- Upali svjetlo\n- Pokreni Vatrogasnu uzbunu"));
+}
+
+// Close both doors and turn light off (5)
+static void sms_group_5(const command_call &call) {
+    // Perform requested actions
+    relay.door_big(DCLOSE);
+    relay.door_small(DCLOSE);
+    relay.light(OFF);
+    // Log requested actions after they are started
+    storage.log_this(call.user_id, "VVZ");
+    storage.log_this(call.user_id, "VMZ");
+    storage.log_this(call.user_id, "SOF");
+    // Send report
+    sms_modem.add_message(call.number, F("Pokrecem grupno izvrsavanje naredbi:\n- Zatvori mala vrata\n- Zatvori velika vrata\n- Ugasi svjetlo"));
+}
+
+// Commands which can be sent by SMS, sorted by keyword
+static constexpr command_entry sms_command_table[] PROGMEM = {
+    { "1",        COMMAND_NO_ARGS,  PERMISSION_USER, "",    sms_group_1    },
+    { "2",        COMMAND_NO_ARGS,  PERMISSION_USER, "",    sms_group_2    },
+    { "3",        COMMAND_NO_ARGS,  PERMISSION_USER, "",    sms_group_3    },
+    { "4",        COMMAND_NO_ARGS,  PERMISSION_USER, "",    sms_group_4    },
+    { "5",        COMMAND_NO_ARGS,  PERMISSION_USER, "",    sms_group_5    },
+    { "log",      COMMAND_ANY_ARGS, PERMISSION_USER, "",    sms_log        },
+    { "premosti", COMMAND_ANY_ARGS, PERMISSION_USER, "",    sms_override   },
+    { "sof",      COMMAND_NO_ARGS,  PERMISSION_USER, "SOF", sms_light      },
+    { "son",      COMMAND_NO_ARGS,  PERMISSION_USER, "SON", sms_light      },
+    { "status",   COMMAND_NO_ARGS,  PERMISSION_USER, "",    sms_status     },
+    { "una",      COMMAND_NO_ARGS,  PERMISSION_USER, "UNA", sms_siren      },
+    { "une",      COMMAND_NO_ARGS,  PERMISSION_USER, "UNE", sms_siren      },
+    { "upr",      COMMAND_NO_ARGS,  PERMISSION_USER, "UPR", sms_siren      },
+    { "ust",      COMMAND_NO_ARGS,  PERMISSION_USER, "UST", sms_siren_stop },
+    { "uva",      COMMAND_NO_ARGS,  PERMISSION_USER, "UVA", sms_siren      },
+    { "vmo",      COMMAND_NO_ARGS,  PERMISSION_USER, "VMO", sms_door_small },
+    { "vmz",      COMMAND_NO_ARGS,  PERMISSION_USER, "VMZ", sms_door_small },
+    { "vvo",      COMMAND_NO_ARGS,  PERMISSION_USER, "VVO", sms_door_big   },
+    { "vvz",      COMMAND_NO_ARGS,  PERMISSION_USER, "VVZ", sms_door_big   }
+};
+static_assert(command_table_sorted(sms_command_table, sizeof(sms_command_table) / sizeof(command_entry), 0),
+    "sms_command_table must be sorted by keyword and keywords must be unique and in lower case");
+// Registry used to find commands received by SMS
+static command_registry sms_commands(sms_command_table, sizeof(sms_command_table) / sizeof(command_entry));
+
+/********************************************************************
+ * Rate limiter of commands received by SMS                         *
+ ********************************************************************/
+sender_limiter::sender_limiter() {
+    int i;  // Index counter
+
+    for (i = 0; i < SMS_SENDER_SLOTS; i++)
+        senders[i].user_id = USER_DELETED;
+    refill_start = 0;
+    tick_start = 0;
+    duplicates = 0;
+    limited = 0;
+}
+
+uint8_t sender_limiter::burst_setting() {
+    int burst = storage.get_setting(SETTING_SMS_RATE_BURST).int_value;
+
+    return (burst > 0 && burst < 256) ? burst : SMS_RATE_BURST;
+}
+
+unsigned long sender_limiter::interval_setting() {
+    int interval = storage.get_setting(SETTING_SMS_RATE_INTERVAL).int_value;
+
+    return (interval > 0 ? interval : SMS_RATE_INTERVAL) * 1000UL;
+}
+
+uint8_t sender_limiter::window_setting() {
+    int window = storage.get_setting(SETTING_SMS_DUP_WINDOW).int_value;
+
+    if (window <= 0)
+        return SMS_DUP_WINDOW;
+    return (window < SMS_DUP_WINDOW_MAX) ? window : SMS_DUP_WINDOW_MAX;
+}
+
+sender_record & sender_limiter::find_sender(int user_id, uint8_t burst) {
+    int found = -1;     // Slot of user, or slot which is taken
+    int i;              // Index counter
+
+    for (i = 0; i < SMS_SENDER_SLOTS; i++) {
+        if (senders[i].user_id == user_id)
+            return senders[i];
+        if (found == -1 || (senders[found].user_id != USER_DELETED &&
+            (senders[i].user_id == USER_DELETED || senders[i].tokens > senders[found].tokens)))
+            found = i;
+    }
+    // New sender starts with full bucket
+    senders[found].user_id = user_id;
+    senders[found].command = 0;
+    senders[found].tokens = burst;
+    senders[found].window = 0;
+    senders[found].suppressing = 0;
+    return senders[found];
+}
+
+void sender_limiter::suppress(sender_record &sender) {
+    // Only first suppressed command of each burst is logged, so looping phone can't fill log
+    if (!sender.suppressing) {
+        storage.log_this(sender.user_id, "SUP");
+        sender.suppressing = 1;
+    }
+}
+
+int sender_limiter::allow(int user_id, const char command[]) {
+    uint8_t burst = burst_setting();                                                    // Size of token bucket
+    unsigned int crc = crc16(0xFFFF, (const unsigned char *)command, strlength(command)); // CRC-16 of command
+    sender_record &sender = find_sender(user_id, burst);
+
+    if (sender.tokens > burst)
+        sender.tokens = burst;
+    // The same command in duplicate window is answered by reply to the first one
+    if (sender.window > 0 && crc == sender.command) {
+        ++duplicates;
+        suppress(sender);
+        return 0;
+    }
+    if (sender.tokens == 0) {
+        ++limited;
+        suppress(sender);
+        return 0;
+    }
+    --sender.tokens;
+    sender.command = crc;
+    sender.window = window_setting();
+    sender.suppressing = 0;
+    return 1;
+}
+
+void sender_limiter::update() {
+    unsigned long seconds = (millis() - tick_start) / 1000;    // Whole seconds since last update
+    unsigned long interval;                                     // ms to add one token
+    unsigned long added;                                        // Number of tokens added to each sender
+    uint8_t burst;                                              // Size of token bucket
+    int i;                                                      // Index counter
+
+    if (seconds == 0) return;
+    tick_start += seconds * 1000;
+
+    // Tokens are added to all senders at once, so first one comes back in at most one interval
+    interval = interval_setting();
+    added = (millis() - refill_start) / interval;
+    refill_start += added * interval;
+    burst = burst_setting();
+
+    for (i = 0; i < SMS_SENDER_SLOTS; i++) {
+        if (senders[i].user_id == USER_DELETED)
+            continue;
+        senders[i].tokens = (senders[i].tokens + added < burst) ? senders[i].tokens + added : burst;
+        senders[i].window = (senders[i].window > seconds) ? senders[i].window - seconds : 0;
+        if (senders[i].tokens == burst && senders[i].window == 0)
+            senders[i].user_id = USER_DELETED;
+    }
+}
+
+unsigned long sender_limiter::get_duplicates() {
+    return duplicates;
+}
+
+unsigned long sender_limiter::get_limited() {
+    return limited;
+}
+
 /********************************************************************
  * Unsolicited response activated when new message arrives          *
  ********************************************************************/
 delivery_res::delivery_res() {
-    set_start("+CMT");
+    /* Prefix is in unsolicited_table */
+}
+
+// Handle received message and queue reply to it
+// Returns: 1 if message is handled, or 0 if it must be kept to be handled later
+static int handle_message(const char pdu[]) {
+    parser message;
+    user_record user;
+    message.set_pdu(pdu);
+    // Commands are matched in lower case, phones often capitalize first letter
+    message.to_lower();
+
+    #ifdef MODEM_DEBUG
+        Serial.print(F("## MODEM new msg: "));
+        Serial.print(message.get_number());
+        Serial.print(F(" -- "));
+        Serial.println(message.get_message());
+        Serial.flush();
+    #endif
+
+    // If SD card is not functional abort
+    if (system_control.test_error(ERROR_SD)) return 0;
+    // Check if user exist in users file
+    user = storage.get_user_by_num(message.get_number());
+    // If user do not exist, or is disabled do nothing
+    if (user.id == USER_DELETED || user.active == 0) return 1;
+    // Unknown commands are ignored, they don't use up tokens of sender
+    const char *args;   // Arguments of command, not used here
+    if (sms_commands.find(message.get_message(), PERMISSION_USER, &args) == -1) return 1;
+    // Repeated and too frequent commands are dropped, so they don't crowd out replies to others
+    if (!sms_limiter.allow(user.id, message.get_message())) return 1;
+
+    Serial.flush();
+
+    enum sirens siren = relay.get_siren();  // Siren state before command
+    int queued = sms_modem.get_queued_count(); // Messages in queue before command
+
+    // Run command
+    sms_commands.run(message.get_message(), PERMISSION_USER, user.id, message.get_number());
+
+    // If replies are disabled clear messages, after SMS ERROR messages are still sent since they are retried
+    if (!SMS_REPLY) {
+        sms_modem.clear();
+    // Else send reply, acknowledgement of started siren goes before everything else,
+    // both before other commands and before replies already waiting in SMS queue
+    } else if (siren == SIREN_OFF && relay.get_siren() != SIREN_OFF) {
+        sms_modem.make_urgent(sms_modem.get_queued_count() - queued);
+        modem.run_cmd(sms_modem, PRIORITY_EMERGENCY);
+    } else {
+        modem.run_cmd(sms_modem, PRIORITY_REPLY);
+    }
+    return 1;
 }
 
 void delivery_res::execute(const char response[]) {
@@ -655,334 +1854,155 @@ void delivery_res::execute(const char response[]) {
         is_done = 0;
     } else {
         is_done = 1;
+        handle_message(response);
+    }
+}
 
-        parser message;
-        user_record user;
-        message.set_pdu(response);
-        
-        #ifdef MODEM_DEBUG
-            Serial.print(F("## MODEM new msg: "));
-            Serial.print(message.get_number());
-            Serial.print(F(" -- "));
-            Serial.println(message.get_message());
-            Serial.flush();
-        #endif
-
-        // If SD card is not functional abort
-        if (system_control.test_error(ERROR_SD)) return;
-        // Check if user exist in users file
-        user = storage.get_user_by_num(message.get_number());
-        // If user do not exist, or is disabled do nothing
-        if (user.id == USER_DELETED || user.active == 0) return;
+/********************************************************************
+ * Command to read messages from SIM inbox                          *
+ ********************************************************************/
+inbox_cmd::inbox_cmd() {
+    type = CMD_INBOX;
+    currently_waiting = COMMAND_ECHO;
+    count = 0;
+    deleted = 0;
+    current = -1;
+    listed = 0;
+    backlog = 0;
+    read_total = 0;
+}
 
-        const char *txt = message.get_message();  // Pointer to message text, just to make things more readable
-        const char *num = message.get_number();   // Pointer to sender number, just to make things more readable
+void inbox_cmd::send_to_serial() {
+    // Messages handled before timeout or error are deleted first, so they are not handled again
+    if (deleted < count) {
+        delete_next();
+        return;
+    }
+    #ifdef MODEM_DEBUG
+        Serial.println(F("## MODEM inbox: listing messages"));
+        Serial.flush();
+    #endif
+    // List all messages, read and unread
+    modem_serial.println("AT+CMGL=4");
+    currently_waiting = COMMAND_ECHO;
+    count = 0;
+    deleted = 0;
+    listed = 0;
+}
 
+void inbox_cmd::delete_next() {
+    if (deleted < count) {
+        modem_serial.print("AT+CMGD=");
+        modem_serial.println(indexes[deleted]);
+        currently_waiting = DELETE_ECHO;
+        return;
+    }
+    #ifdef MODEM_DEBUG
+        Serial.println(F("## MODEM inbox: batch done"));
         Serial.flush();
-        
-        // If it's a door command
-        if (strcompare(txt, "vmo") || strcompare(txt, "vmz") || strcompare(txt, "vvo") || strcompare(txt, "vvz")) {
-            // For small door
-            if (txt[1] == 'm') {
-                // Get current door state
-                int state = relay.get_door_small();
-                // If door is in unknown position send error message
-                if (state == DOOR_MIDDLE || state == DOOR_ERROR) {
-                    sms_modem.add_message(num, F("Greska, mala vrata su u nepoznatom polozaju"));
-                }
-                // If door opening is requested
-                else if (txt[2] == 'o') {
-                    // Open the door if door is closed
-                    if (state == DOOR_CLOSED) {
-                        sms_modem.add_message(num, F("Pokrecem postupak otvaranja malih vrata"));
-                        storage.log_this(user.id, "VMO");
-                        relay.door_small(DOPEN);
-                    }
-                    else if (state == DOOR_OPENED) {
-                        sms_modem.add_message(num, F("Nemoguce otvoriti mala vrata, vrata su vec otvorena"));
-                    }
-                }
-                // If door closing is requested
-                else if (txt[2] == 'z') {
-                    // Close the door if door is opened
-                    if (state == DOOR_OPENED) {
-                        sms_modem.add_message(num, F("Pokrecem postupak zatvaranja malih vrata"));
-                        storage.log_this(user.id, "VMZ");
-                        relay.door_small(DCLOSE);
-                    }
-                    else if (state == DOOR_CLOSED) {
-                        sms_modem.add_message(num, F("Nemoguce zatvoriti mala vrata, vrata su vec zatvorena"));
-                    }
-                }
-            }
-            // For big door
-            else if (txt[1] == 'v') {
-                // Get current door state
-                int state = relay.get_door_big();
-                // If door is in unknown position send error message
-                if (state == DOOR_MIDDLE || state == DOOR_ERROR) {
-                    sms_modem.add_message(num, F("Greska, velika vrata su u nepoznatom polozaju"));
-                }
-                // If door opening is requested
-                else if (txt[2] == 'o') {
-                    if (state == DOOR_CLOSED) {
-                        sms_modem.add_message(num, F("Pokrecem postupak otvaranja velikih vrata"));
-                        storage.log_this(user.id, "VVO");
-                        relay.door_big(DOPEN);
-                    }
-                    else if (state == DOOR_OPENED) {
-                        sms_modem.add_message(num, F("Nemoguce otvoriti velika vrata, vrata su vec otvorena"));
-                    }
-                }
-                // If door closing is requested
-                else if (txt[2] == 'z') {
-                    if (state == DOOR_OPENED) {
-                        sms_modem.add_message(num, F("Pokrecem postupak zatvaranja velikih vrata"));
-                        storage.log_this(user.id, "VVZ");
-                        relay.door_big(DCLOSE);
-                    }
-                    else if (state == DOOR_CLOSED) {
-                        sms_modem.add_message(num, F("Nemoguce zatvoriti velika vrata, vrata su vec zatvorena"));
-                    }
-                }
-            }
-        }
-        // If it's siren command
-        else if (strcompare(txt, "una") || strcompare(txt, "une") || strcompare(txt, "upr") || strcompare(txt, "uva") || strcompare(txt, "ust")) {
-            // Get siren state
-            int state = relay.get_siren();
-            // If siren stop is requested stop siren
-            if (txt[1] == 's' && txt[2] == 't') {
-                sms_modem.add_message(num, F("Pokrecem postupak zaustavljanja sirene ukoliko je aktivna"));
-                storage.log_this(user.id, "UST");
-                relay.siren_stop();
-            }
-            // If siren is running and other siren is requested send error
-            else if (state != SIREN_OFF) {
-                sms_modem.add_message(num, F("Sirena je trenutno aktivna, kako biste pokrenuli sirenu zaustavite je, te ponovo pokrenite"));
-            }
-            // Start siren nadolazeca opasnost
-            else if (txt[1] == 'n' && txt[2] == 'a') {
-                sms_modem.add_message(num, F("Pokrecem uzbunu Nadolazeca opasnost"));
-                storage.log_this(user.id, "UNA");
-                relay.siren_nadolazeca();
-            }
-            // Start siren neposredna opasnost
-            else if (txt[1] == 'n' && txt[2] == 'e') {
-                sms_modem.add_message(num, F("Pokrecem uzbunu Neposredna opasnost"));
-                storage.log_this(user.id, "UNE");
-                relay.siren_neposredna();
-            }
-            // Start siren prestanak opasnosti
-            else if (txt[1] == 'p' && txt[2] == 'r') {
-                sms_modem.add_message(num, F("Pokrecem uzbunu Prestanak opasnosti"));
-                storage.log_this(user.id, "UPR");
-                relay.siren_prestanak();
-            }
-            // Start siren vatrogasna uzbuna
-            else if (txt[1] == 'v' && txt[2] == 'a') {
-                sms_modem.add_message(num, F("Pokrecem uzbunu Vatrogasna uzbuna"));
-                storage.log_this(user.id, "UVA");
-                relay.siren_vatrogasna();
-            }
-        }
-        // If it's light command
-        else if (strcompare(txt, "son") || strcompare(txt, "sof")) {
-            // Get current state of light
-            int state = relay.get_light();
-            // If light on is requested
-            if (txt[2] == 'n') {
-                if (state == OFF) {
-                    sms_modem.add_message(num, F("Pokrecem postupak paljenja svjetla"));
-                    storage.log_this(user.id, "SON");
-                    relay.light(ON);
-                }
-                else if (state == ON) {
-                    sms_modem.add_message(num, F("Nemoguce upaliti svjetlo, svjetlo je vec upaljeno"));
-                }
-            }
-            // If light off is requested
-            else if (txt[2] == 'f') {
-                if (state == ON) {
-                    sms_modem.add_message(num, F("Pokrecem postupak gasenja svjetla"));
-                    storage.log_this(user.id, "SOF");
-                    relay.light(OFF);
-                }
-                else if (state == OFF) {
-                    sms_modem.add_message(num, F("Nemoguce ugasiti svjetlo, svjetlo je vec ugaseno"));
-                }
-            }
-        }
-        // If it's status command
-        else if (strcompare(txt, "status")) {
-            char anwser[100];
-            int big = relay.get_door_big();      // Get state of big door
-            int small = relay.get_door_small();  // Get state of small door
-            int light = relay.get_light();       // Get state of light
-            int siren = relay.get_siren();       // Get state of siren
-
-            // Create anwser message
-            sprintf(anwser, "%s\n\nMala Vrata: %s\nVelika Vrata: %s\nSvjetlo: %s\nSirena: %s",
-                // Get current motd and set it as title
-                main_panel.get_motd(),
-                // Print current state of small door
-                (small == DOOR_ERROR) ? "ERR" :                                    // If door state is error print ERR
-                    (small == DOOR_MIDDLE) ? "NEP" :                               // If door state is unknown print NEP
-                        (small == DOOR_OPENED) ? "OTV" :                           // If door state is opened print OTV
-                            "ZAT",                                                 // Else door must be in closed state so print ZAT
-                // Print current state of big door
-                (big == DOOR_ERROR) ? "ERR" :                                      // If door state is error print ERR
-                    (big == DOOR_MIDDLE) ? "NEP" :                                 // If door state is unknown print NEP
-                        (big == DOOR_OPENED) ? "OTV" :                             // If door state is opened print OTV
-                            "ZAT",                                                 // Else door must be in closed state so print ZAT
-                // Print current state of light
-                (light == ON) ? "ON" :                                             // If light is on print ON
-                    "OFF",                                                         // If light is off print OFF
-                // Get siren currently running
-                (siren == SIREN_OFF) ? "OFF" :                                     // If no siren is running print OFF
-                    (siren == SIREN_NADOLAZECA) ? "Nadolazeca opasnost" :          // If siren is Nadolazeca opasnost
-                        (siren == SIREN_NEPOSREDNA) ? "Neposredna opasnost" :      // If siren is Neposredna opasnost
-                            (siren == SIREN_PRESTANAK) ? "Prestanak opasnosti" :   // If siren is Prestanak opasnosti
-                                "Vatrogasna uzbuna"                                // Else it must be Vatrogasna uzbuna
-            );
+    #endif
+    is_done = 1;
+    // Batch was full, next one is read after replies queued so far are sent
+    if (count > 0 && listed > count)
+        modem.run_cmd(inbox_modem, PRIORITY_REPLY);
+    count = 0;
+    deleted = 0;
+}
 
-            sms_modem.add_message(num, anwser);
-        }
-        // If it's log command
-        else if (strstartswith(txt, "log")) {
-            unsigned long page;
-            if (sscanf(txt, "log %lu", &page) == 1) {
-                if (storage.get_log_count() > (page - 1u) * SMS_LOG) {
-                    unsigned long i;
-                    char log_list[160];
-                    unsigned long log_count = storage.get_log_count();
-
-                    log_list[0] = '\0';
-
-                    for (i = 0; i < SMS_LOG && log_count > (page - 1u) * SMS_LOG + i; i++) {
-                        log_record logr = storage.get_log((page - 1u) * SMS_LOG + i);
-                        user_record userr = storage.get_user_by_id(logr.user_id);
-
-                        sprintf(
-                            log_list + strlength(log_list), "%02u-%02u-%04u %02u:%02u:%02u %s %s\n",
-                            logr.day, logr.month, logr.year, logr.hour, logr.minute, logr.second, logr.action, userr.number
-                        );
-                    }
-                    sprintf(
-                        log_list + strlength(log_list), "\nStr %lu/%lu",
-                        page, (log_count / SMS_LOG) + !!(log_count % SMS_LOG)
-                    );
-
-                    sms_modem.add_message(num, log_list);
-                } else {
-                    sms_modem.add_message(num, F("Trazena stranica loga ne postoji"));
-                }
-            } else {
-                sms_modem.add_message(num, F("Sintaksa naredbe log je:\nlog <stranica>"));
-            }
+void inbox_cmd::fail() {
+    system_control.ready(OFF);
+    system_control.set_error(ERROR_MODEM_UNKNOWN);
+    is_done = 1;
+}
+
+void inbox_cmd::push_line(const char line[]) {
+    // Line after +CMGL is PDU, if it's lost next +CMGL or final response arrives instead
+    if (currently_waiting == PDU && !strstartswith(line, "+CMGL: ") && !strcompare(line, "OK") &&
+        !strcompare(line, "ERROR") && !strstartswith(line, "+CMS ERROR")) {
+        if (current != -1 && handle_message(line)) {
+            indexes[count++] = current;
+            ++read_total;
         }
-        // If it's premosti command
-        else if (strstartswith(txt, "premosti")) {
-            // Get subcommand
-            const char *subcmd = txt + 8;
-            // If override of big door is requested
-            if (strcompare(subcmd, " vvo") || strcompare(subcmd, " vvz")) {
-                storage.log_this(user.id, "PVV");
-                relay.override_door_big(DOPEN);
-                sms_modem.add_message(num, F("Zaobilazim sigurnosne provjere magnetskih senzora i pokrecem promjenu stanja velikih vrata bez obzira na trenutno stanje"));
+        currently_waiting = LIST;
+        return;
+    }
+    switch (currently_waiting) {
+        case COMMAND_ECHO:
+            if (strcompare(line, "AT+CMGL=4")) {
+                currently_waiting = LIST;
             }
-            // If override of small door opening is requested
-            else if (strcompare(subcmd, " vmo")) {
-                storage.log_this(user.id, "PMO");
-                relay.override_door_small(DOPEN);
-                sms_modem.add_message(num, F("Zaobilazim sigurnosne provjere magnetskih senzora i pokrecem otvaranje malih vrata bez obzira na trenutno stanje"));
+            break;
+        case LIST:
+        case PDU:
+            if (strstartswith(line, "+CMGL: ")) {
+                int index;  // Index of message in SIM
+
+                ++listed;
+                current = -1;
+                // Messages after full batch are only counted, they are handled by next listing
+                if (sscanf(line, "+CMGL: %d", &index) == 1 && count < INBOX_BATCH_SIZE)
+                    current = index;
+                currently_waiting = PDU;
+            } else if (strcompare(line, "OK")) {
+                backlog = listed;
+                delete_next();
+            } else if (strcompare(line, "ERROR") || strstartswith(line, "+CMS ERROR")) {
+                fail();
             }
-            // If override of small door closing is requested
-            else if (strcompare(subcmd, " vmz")) {
-                storage.log_this(user.id, "PMZ");
-                relay.override_door_small(DCLOSE);
-                sms_modem.add_message(num, F("Zaobilazim sigurnosne provjere magnetskih senzora i pokrecem zatvaranje malih vrata bez obzira na trenutno stanje"));
+            break;
+        case DELETE_ECHO:
+            if (strstartswith(line, "AT+CMGD=")) {
+                currently_waiting = DELETE_OK;
             }
-            // If command syntax is incorrect send error and help
-            else {
-                sms_modem.add_message(num, F("Sintaksa naredbe premosti je:\npremosti <vvo/vvz/vmo/vmz>"));
+            break;
+        case DELETE_OK:
+            if (strcompare(line, "OK")) {
+                if (backlog > 0)
+                    --backlog;
+                ++deleted;
+                delete_next();
+            } else if (strcompare(line, "ERROR") || strstartswith(line, "+CMS ERROR")) {
+                fail();
             }
-        }
-        // If it's special command 1
-        else if (strcompare(txt, "1")) {
-            // Log requested actions
-            storage.log_this(user.id, "VVO");
-            storage.log_this(user.id, "VMO");
-            storage.log_this(user.id, "SON");
-            // Perform requested actions
-            relay.door_big(DOPEN);
-            relay.door_small(DOPEN);
-            relay.light(ON);
-            // Send report
-            sms_modem.add_message(num, F("Pokrecem grupno izvrsavanje naredbi:\n- Otvori mala vrata\n- Otvori velika vrata\n- Upali svjetlo"));
-        }
-        // If it's special command 2
-        else if (strcompare(txt, "2")) {
-            // Log requested actions
-            storage.log_this(user.id, "VVO");
-            // Perform requested actions
-            relay.door_big(DOPEN);
-            // Send report
-            sms_modem.add_message(num, F("Pokrecem pokusaj otvaranja velikih vrata"));
-        }
-        // If it's special command 3
-        else if (strcompare(txt, "3")) {
-            // Log requested actions
-            storage.log_this(user.id, "VMO");
-            // Perform requested actions
-            relay.door_small(DOPEN);
-            // Send report
-            sms_modem.add_message(num, F("Pokrecem pokusaj otvaranja malih vrata"));
-        }
-        // If it's special command 4
-        else if (strcompare(txt, "4")) {
-            // Log requested actions
-            storage.log_this(user.id, "VVO");
-            storage.log_this(user.id, "VMO");
-            storage.log_this(user.id, "SON");
-            storage.log_this(user.id, "UVA");
-            // Perform requested actions
-            relay.door_big(DOPEN);
-            relay.door_small(DOPEN);
-            relay.light(ON);
-            relay.siren_vatrogasna();
-            // Send report
-            sms_modem.add_message(num, F("Pokrecem grupno izvrsavanje naredbi:\n- Otvori mala vrata\n- Otvori velika vrata\n- Upali svjetlo\n- Pokreni Vatrogasnu uzbunu"));
-        }
-        // If it's spacial command 5
-        else if (strcompare(txt, "5")) {
-            // Log requested actions
-            storage.log_this(user.id, "VVZ");
-            storage.log_this(user.id, "VMZ");
-            storage.log_this(user.id, "SOF");
-            // Perform requested actions
-            relay.door_big(DCLOSE);
-            relay.door_small(DCLOSE);
-            relay.light(OFF);
-            // Send report
-            sms_modem.add_message(num, F("Pokrecem grupno izvrsavanje naredbi:\n- Zatvori mala vrata\n- Zatvori velika vrata\n- Ugasi svjetlo"));
-        }
-
-        // If there is SMS ERROR or replies are disabled clear messages
-        if (!SMS_REPLY || system_control.test_error(ERROR_MODEM_SMS_SEND)) {
-            sms_modem.clear();
-        // Else send reply
-        } else {
-            modem.run_cmd(sms_modem);
-        }
+            break;
     }
 }
 
+void inbox_cmd::notify() {
+    ++backlog;
+}
+
+int inbox_cmd::get_backlog() {
+    return backlog;
+}
+
+unsigned long inbox_cmd::get_read_count() {
+    return read_total;
+}
+
+/********************************************************************
+ * Unsolicited response activated when message is stored in SIM     *
+ ********************************************************************/
+inbox_res::inbox_res() {
+    /* Prefix is in unsolicited_table */
+}
+
+void inbox_res::execute(const char response[]) {
+    #ifdef MODEM_DEBUG
+        Serial.print(F("## MODEM inbox: "));
+        Serial.println(response);
+        Serial.flush();
+    #endif
+    // Messages are read in batches, command started while one is running reads the rest
+    inbox_modem.notify();
+    modem.run_cmd(inbox_modem, PRIORITY_REPLY);
+}
+
 /********************************************************************
  * Unsolicited response activated when modem rings                  *
  ********************************************************************/
 ring_res::ring_res() {
-    set_start("RING");
+    /* Prefix is in unsolicited_table */
 }
 
 void ring_res::execute(const char response[]) {
@@ -997,7 +2017,7 @@ void ring_res::execute(const char response[]) {
  * Unsolicited response activated when modem ended ringing          *
  ********************************************************************/
 ring_end_res::ring_end_res() {
-    set_start("NO CARRIER");
+    /* Prefix is in unsolicited_table */
 }
 
 void ring_end_res::execute(const char response[]) {
@@ -0,0 +1,220 @@
+// Include global header files
+#include <Arduino.h>
+#include <util/atomic.h>
+// Include local header files
+#include "modem_serial.hpp"
+
+// Create modem serial variable
+modem_serial_class modem_serial;
+
+// Compiler must not move ring reads and writes over line counters
+#define MEMORY_BARRIER() asm volatile("" ::: "memory")
+
+/********************************************************************
+ * USART3 interrupts                                                *
+ ********************************************************************/
+ISR(USART3_RX_vect) {
+    uint8_t status = UCSR3A;    // Status must be read before data
+    uint8_t ch = UDR3;          // Received character
+
+    // Skip characters with parity error
+    if (status & _BV(UPE3)) return;
+    modem_serial.receive(ch);
+}
+
+ISR(USART3_UDRE_vect) {
+    modem_serial.transmit();
+}
+
+/********************************************************************
+ * Serial connection to modem                                       *
+ ********************************************************************/
+modem_serial_class::modem_serial_class() {
+    rx_head = 0;
+    rx_line_start = 0;
+    rx_lines_in = 0;
+    rx_lines_out = 0;
+    rx_dropping = 0;
+    rx_overflows = 0;
+    rx_max_used = 0;
+    tx_head = 0;
+    tx_tail = 0;
+}
+
+void modem_serial_class::begin(unsigned long baud) {
+    // Use double speed mode, same as HardwareSerial
+    uint16_t setting = (F_CPU / 4 / baud - 1) / 2;
+
+    UBRR3H = setting >> 8;
+    UBRR3L = setting;
+    UCSR3A = _BV(U2X3);
+    // 8 data bits, no parity, 1 stop bit
+    UCSR3C = _BV(UCSZ31) | _BV(UCSZ30);
+    UCSR3B = _BV(RXEN3) | _BV(TXEN3) | _BV(RXCIE3);
+}
+
+uint8_t modem_serial_class::rx_put(char ch) {
+    uint16_t length = rx_head - rx_line_start;  // Length of line being received
+    uint16_t tail;                              // Start of oldest line main loop is still reading
+    uint16_t i;                                 // Index counter
+
+    // If all lines are released whole ring except current line is free
+    if (rx_lines_in == rx_lines_out) {
+        // Keep space for '\0' after character
+        if (rx_head + 1 < MODEM_RX_RING_SIZE) {
+            rx_ring[rx_head++] = ch;
+            return 1;
+        }
+        // Line is longer than ring
+        if (length + 1 >= MODEM_RX_RING_SIZE)
+            return 0;
+    } else {
+        tail = rx_starts[rx_lines_out % MODEM_RX_LINES];
+        // Ring is wrapped, line continues towards oldest line and at least one byte is left free
+        if (rx_head < tail) {
+            if (rx_head + 2 < tail) {
+                rx_ring[rx_head++] = ch;
+                return 1;
+            }
+            return 0;
+        }
+        // Ring is not wrapped, line continues towards the end of ring
+        if (rx_head + 1 < MODEM_RX_RING_SIZE) {
+            rx_ring[rx_head++] = ch;
+            return 1;
+        }
+        // Line can be moved before oldest line only if free byte is left between them
+        if (length + 2 >= tail)
+            return 0;
+    }
+    // Move line to the start of ring, so it stays in one piece
+    for (i = 0; i < length; i++)
+        rx_ring[i] = rx_ring[rx_line_start + i];
+    rx_line_start = 0;
+    rx_head = length;
+    rx_ring[rx_head++] = ch;
+    return 1;
+}
+
+void modem_serial_class::rx_end_line() {
+    uint16_t tail;              // Start of oldest line which is not released
+    uint16_t used;              // Bytes of ring used
+
+    // If there is no space for start of line drop it
+    if ((uint8_t)(rx_lines_in - rx_lines_out) == MODEM_RX_LINES) {
+        ++rx_overflows;
+        rx_head = rx_line_start;
+        return;
+    }
+    // There is always space for '\0' after line
+    rx_ring[rx_head++] = '\0';
+    rx_starts[rx_lines_in % MODEM_RX_LINES] = rx_line_start;
+    rx_line_start = rx_head;
+
+    tail = rx_starts[rx_lines_out % MODEM_RX_LINES];
+    used = (rx_head >= tail) ? rx_head - tail : MODEM_RX_RING_SIZE - tail + rx_head;
+    if (used > rx_max_used)
+        rx_max_used = used;
+
+    MEMORY_BARRIER();
+    ++rx_lines_in;
+}
+
+void modem_serial_class::receive(uint8_t ch) {
+    // Skip \n, lines end with \r, and skip characters which are not ASCII
+    if (ch == '\n' || ch == '\0' || ch >= 0x80) return;
+
+    if (ch == '\r') {
+        // Dropped line is finished, next one can be received
+        if (rx_dropping) {
+            rx_dropping = 0;
+            return;
+        }
+        // Skip empty lines
+        if (rx_head == rx_line_start) return;
+        rx_end_line();
+        return;
+    }
+
+    if (rx_dropping) return;
+    // If there is no space drop whole line, part of the line would be useless anyway
+    if (!rx_put(ch)) {
+        ++rx_overflows;
+        rx_dropping = 1;
+        rx_head = rx_line_start;
+        return;
+    }
+    // Prompt is not followed by \r, so pass it to main loop as soon as it arrives
+    if (rx_head - rx_line_start == 2 && rx_ring[rx_line_start] == '>' && rx_ring[rx_line_start + 1] == ' ')
+        rx_end_line();
+}
+
+const char * modem_serial_class::read_line() {
+    if (rx_lines_in == rx_lines_out)
+        return NULL;
+    MEMORY_BARRIER();
+    return rx_ring + rx_starts[rx_lines_out % MODEM_RX_LINES];
+}
+
+void modem_serial_class::release_line() {
+    if (rx_lines_in == rx_lines_out)
+        return;
+    // Interrupt can use line space as soon as counter is increased
+    MEMORY_BARRIER();
+    ++rx_lines_out;
+}
+
+void modem_serial_class::clear() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        rx_head = 0;
+        rx_line_start = 0;
+        rx_lines_out = rx_lines_in;
+        rx_dropping = 0;
+    }
+}
+
+unsigned long modem_serial_class::get_overflows() {
+    unsigned long overflows;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        overflows = rx_overflows;
+    }
+    return overflows;
+}
+
+uint16_t modem_serial_class::get_max_used() {
+    uint16_t max_used;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        max_used = rx_max_used;
+    }
+    return max_used;
+}
+
+size_t modem_serial_class::write(uint8_t ch) {
+    uint8_t next = (tx_head + 1) % MODEM_TX_RING_SIZE;  // Where next character will be written
+
+    // Wait for interrupt to make space
+    while (next == tx_tail) {
+        // If interrupts are disabled send character from here
+        if (bit_is_clear(SREG, SREG_I) && bit_is_set(UCSR3A, UDRE3))
+            transmit();
+    }
+    tx_ring[tx_head] = ch;
+    tx_head = next;
+    // Turn on interrupt which sends characters
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        UCSR3B |= _BV(UDRIE3);
+    }
+    return 1;
+}
+
+void modem_serial_class::transmit() {
+    // Nothing to send, turn off interrupt
+    if (tx_head == tx_tail) {
+        UCSR3B &= ~_BV(UDRIE3);
+        return;
+    }
+    UDR3 = tx_ring[tx_tail];
+    tx_tail = (tx_tail + 1) % MODEM_TX_RING_SIZE;
+}
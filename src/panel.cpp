@@ -377,9 +377,12 @@ void input_page_class::key_input(const char key) {
  ********************************************************************/
 home_page_class::home_page_class() {
     set_cursor(-1, -1);
+    last_second = -1;
 }
 
 void home_page_class::print() {
+    // Time is printed again on next update
+    last_second = -1;
     // Print motd in first line
     lcd.setCursor(0,0);
     lcd.print(main_panel.get_motd());
@@ -387,7 +390,11 @@ void home_page_class::print() {
 
 void home_page_class::update() {
     char time_formated[16];               // Formated time string
-    RtcDateTime now = rtc.GetDateTime();  // Current time
+    RtcDateTime now = storage.now();      // Current time
+    // Display is changed only when time changes
+    if (now.Second() == last_second)
+        return;
+    last_second = now.Second();
     // Get time to formated string
     sprintf(
         time_formated, "%02hhu:%02hhu:%02hhu    ",  // Add few extra spaces at the end because piece of shit
@@ -917,6 +924,8 @@ void auth_settings_page_class::key_press(const char key) {
                     } else {
                         storage.set_setting(SETTING_SIRENE_AUTH, 0);
                     }
+                    // Write setting and logs staged before it to SD card
+                    storage.sync();
                     // If there was storage problem abort
                     if (system_control.test_error(ERROR_SD)) return;
 
@@ -928,6 +937,8 @@ void auth_settings_page_class::key_press(const char key) {
                     } else {
                         storage.set_setting(SETTING_SETTINGS_AUTH, 0);
                     }
+                    // Write setting and logs staged before it to SD card
+                    storage.sync();
                     // If there was storage problem abort
                     if (system_control.test_error(ERROR_SD)) return;
 
@@ -970,6 +981,8 @@ void change_pin_page_class::key_press(const char key) {
                 break;
             case OK_KEY:
                 storage.set_setting(SETTING_PASSWORD, get_buffer());
+                // Write new PIN and logs staged before it to SD card
+                storage.sync();
                 // If there was storage problem abort
                 if (system_control.test_error(ERROR_SD)) return;
                 main_panel.set_page(auth_settings_page);
@@ -1180,8 +1193,10 @@ void log_page_class::private_print() {
     // Else print log list
     } else {
         // Get log and user
-        log_record log = storage.get_log(record_num);
-        user_record user = storage.get_user_by_id(log.user_id);
+        log_page_record record;
+        if (storage.get_log_page(record_num, 1, &record) == 0) return;
+        log_record &log = record.log;
+        user_record &user = record.user;
         // If there was storage problem abort
         if (system_control.test_error(ERROR_SD)) return;
         // Print date and time
@@ -0,0 +1,93 @@
+// Include global header files
+#include <Arduino.h>
+// Include local header files
+#include "registry.hpp"
+
+// Convert ASCII letter to lower case, other characters are not changed
+static char lower(const char ch) {
+    if (ch >= 'A' && ch <= 'Z')
+        return ch - 'A' + 'a';
+    return ch;
+}
+
+/********************************************************************
+ * Registry of commands stored in PROGMEM table                     *
+ ********************************************************************/
+command_registry::command_registry(const command_entry table_rows[], int row_count) {
+    table = table_rows;
+    count = row_count;
+}
+
+int command_registry::bucket(char first) {
+    int low = 0;            // First row which can be in bucket
+    int high = count;       // Row after last row which can be in bucket
+
+    // Rows are sorted, so binary search finds start of bucket
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if ((char)pgm_read_byte(&table[middle].keyword[0]) < first)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+const char * command_registry::match(int row, const char text[]) {
+    const char *keyword = table[row].keyword;   // Keyword in PROGMEM
+    uint8_t args = pgm_read_byte(&table[row].args);
+    char ch;                                    // Current keyword character
+    int i;                                      // Index counter
+
+    for (i = 0; (ch = pgm_read_byte(keyword + i)) != '\0'; i++) {
+        if (lower(text[i]) != ch)
+            return NULL;
+    }
+    // Whole command is keyword
+    if (text[i] == '\0')
+        return (args == COMMAND_ARGS) ? NULL : text + i;
+    // Keyword is followed by arguments
+    if (text[i] == ' ')
+        return (args == COMMAND_NO_ARGS) ? NULL : text + i + 1;
+    // Keyword is only start of other word
+    return NULL;
+}
+
+int command_registry::find(const char text[], uint8_t permission, const char **args) {
+    char first = lower(text[0]);    // First character of command
+    int row;                        // Index counter of table
+
+    if (first == '\0')
+        return -1;
+
+    // Only rows with the same first character are checked
+    for (row = bucket(first); row < count && (char)pgm_read_byte(&table[row].keyword[0]) == first; row++) {
+        *args = match(row, text);
+        if (*args == NULL)
+            continue;
+        if (permission < pgm_read_byte(&table[row].permission))
+            return -1;
+        return row;
+    }
+    return -1;
+}
+
+int command_registry::run(const char text[], uint8_t permission, int user_id, const char number[]) {
+    const char *args;               // Arguments of matched command
+    int row = find(text, permission, &args);
+
+    if (row == -1)
+        return 0;
+
+    command_entry entry;    // Matched row copied from PROGMEM
+    command_call call;      // Data passed to handler
+
+    memcpy_P(&entry, &table[row], sizeof(command_entry));
+    call.entry = &entry;
+    call.args = args;
+    call.user_id = user_id;
+    call.number = number;
+    entry.handler(call);
+    return 1;
+}
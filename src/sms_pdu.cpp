@@ -8,10 +8,53 @@
  ********************************************************************/
 int ch_to_int(const char ch);
 char int_to_ch(const char nm);
-void encode(const char ascii[], char encoded[]);
+void encode(const char ascii[], int fill_bits, char encoded[]);
 void decode(const char encoded[], char result[]);
 char ascii_to_gsm(char ascii_ch);
-char gsm_to_ascii(char gsm_ch);
+char gsm_to_ascii_folded(char gsm_ch);
+char unicode_to_ascii(unsigned int code);
+void decode_ucs2(const char encoded[], char result[], const int result_size);
+
+/********************************************************************
+ * Character tables                                                 *
+ ********************************************************************/
+
+// HEX digits indexed by their value
+const char hex_digits[] PROGMEM = "0123456789ABCDEF";
+
+// ASCII character for each GSM 7-bit character, letters with diacritics are
+// converted to their base letter, characters without ASCII counterpart to space
+const char gsm_to_ascii_table[128] PROGMEM = {
+    '@' , ' ' , '$' , ' ' , 'e' , 'e' , 'u' , 'i',  // 0x00 £ ¥ è é ù ì
+    'o' , 'C' , '\n', 'O' , 'o' , '\r', 'A' , 'a',  // 0x08 ò Ç Ø ø Å å
+    ' ' , '_' , ' ' , ' ' , ' ' , ' ' , ' ' , ' ',  // 0x10 Δ Φ Γ Λ Ω Π Ψ
+    ' ' , ' ' , ' ' , '\e', 'A' , 'a' , 's' , 'E',  // 0x18 Σ Θ Ξ Æ æ ß É
+    ' ' , '!' , '"' , '#' , ' ' , '%' , '&' , '\'',  // 0x20 ¤
+    '(' , ')' , '*' , '+' , ',' , '-' , '.' , '/',  // 0x28
+    '0' , '1' , '2' , '3' , '4' , '5' , '6' , '7',  // 0x30
+    '8' , '9' , ':' , ';' , '<' , '=' , '>' , '?',  // 0x38
+    ' ' , 'A' , 'B' , 'C' , 'D' , 'E' , 'F' , 'G',  // 0x40 ¡
+    'H' , 'I' , 'J' , 'K' , 'L' , 'M' , 'N' , 'O',  // 0x48
+    'P' , 'Q' , 'R' , 'S' , 'T' , 'U' , 'V' , 'W',  // 0x50
+    'X' , 'Y' , 'Z' , 'A' , 'O' , 'N' , 'U' , ' ',  // 0x58 Ä Ö Ñ Ü §
+    ' ' , 'a' , 'b' , 'c' , 'd' , 'e' , 'f' , 'g',  // 0x60 ¿
+    'h' , 'i' , 'j' , 'k' , 'l' , 'm' , 'n' , 'o',  // 0x68
+    'p' , 'q' , 'r' , 's' , 't' , 'u' , 'v' , 'w',  // 0x70
+    'x' , 'y' , 'z' , 'a' , 'o' , 'n' , 'u' , 'a'   // 0x78 ä ö ñ ü à
+};
+
+// GSM 7-bit character for each ASCII character, characters which can't be
+// encoded are converted to 0 (@)
+const uint8_t ascii_to_gsm_table[128] PROGMEM = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x0D, 0x00, 0x00,  // 0x00
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1B, 0x00, 0x00, 0x00, 0x00,  // 0x10
+    0x20, 0x21, 0x22, 0x23, 0x02, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,  // 0x20
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,  // 0x30
+    0x00, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,  // 0x40
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x00, 0x00, 0x11,  // 0x50
+    0x00, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,  // 0x60
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x00, 0x00, 0x00, 0x00, 0x00   // 0x70
+};
 
 /********************************************************************
  * Functions for number/character conversion                        *
@@ -29,11 +72,8 @@ int ch_to_int(const char ch) {
 }
 // Convert value in range of HEX digit to character
 char int_to_ch(const char nm) {
-    if (nm < 10) {
-        return nm + '0';
-    }
-    if (nm < 16) {
-        return (nm - 10) + 'A';
+    if ((unsigned char)nm < 16) {
+        return pgm_read_byte(hex_digits + nm);
     }
     return '0';
 }
@@ -43,35 +83,52 @@ char int_to_ch(const char nm) {
  ********************************************************************/
 
 // Encode ASCII zero terminated string to GSM 7-bit
-//    ascii   -- string to be encoded
-//    encoded -- array where to place result
-void encode(const char ascii[], char encoded[]) {
-    int ordinal;   // Ordinal number of GSM character, counts form 0 to 6
-    int ch;        // encoded[] array index
-    int current;   // Current octet
-    int i;         // ascii[] array index
-
-    ordinal = 0;   // Set ordinal to 0
-    ch = 0;        // Start from first element of encoded array
-
-    // For each ASCII character
-    for (i = 0; i == 0 || ascii[i] != '\0'; i++) {
-        // If ordinal is equal to 7 skip character and set ordinal to 0
-        if (ordinal == 7) {
-            ordinal = 0;
-            continue;
+//    ascii     -- string to be encoded
+//    fill_bits -- number of zero bits before first character, used after User Data Header
+//    encoded   -- array where to place result
+void encode(const char ascii[], int fill_bits, char encoded[]) {
+    unsigned int current;   // Bits waiting to be written, lowest bits are written first
+    int bits;               // Number of bits in current
+    int ch;                 // encoded[] array index
+    int i;                  // ascii[] array index
+    int n;                  // Index in block
+    uint8_t septets[8];     // Block of GSM characters
+    uint8_t octet;          // Octet packed from block
+
+    current = 0;
+    bits = fill_bits;
+    ch = 0;
+
+    // Characters are packed from the lowest bit of each octet up
+    for (i = 0; ascii[i] != '\0'; ) {
+        // When there are no bits waiting, 8 characters fit exactly into 7 octets
+        if (bits == 0) {
+            for (n = 0; n < 8 && ascii[i + n] != '\0'; n++)
+                septets[n] = ascii_to_gsm(ascii[i + n]);
+            if (n == 8) {
+                for (n = 0; n < 7; n++) {
+                    octet = (septets[n] >> n) | (septets[n + 1] << (7 - n));
+                    encoded[ch++] = int_to_ch(octet >> 4);
+                    encoded[ch++] = int_to_ch(octet & 0x0F);
+                }
+                i += 8;
+                continue;
+            }
         }
-
-        // Convert ASCII character to GSM character
-        // Take first (7 - ordinal) bin digits from left, and put them in current
-        current = ascii_to_gsm(ascii[i]) >> ordinal;
-        // Take first (ordinal + 1) digits from the right of next character and add them ti the left of current
-        current = current | ( ascii_to_gsm(ascii[i + 1]) & ~(~0 << (ordinal + 1)) ) << (7 - ordinal);
-        // Convert current octet to ASCII characters and save them to encoded array
-        encoded[ch++] = int_to_ch(current >> 4);
-        encoded[ch++] = int_to_ch(current & ~(~0 << 4));
-
-        ++ordinal;  // Increase ordinal
+        current |= (unsigned int)ascii_to_gsm(ascii[i++]) << bits;
+        bits += 7;
+        // Write each complete octet
+        while (bits >= 8) {
+            encoded[ch++] = int_to_ch((current >> 4) & 0x0F);
+            encoded[ch++] = int_to_ch(current & 0x0F);
+            current >>= 8;
+            bits -= 8;
+        }
+    }
+    // Write rest of the bits
+    if (bits > 0) {
+        encoded[ch++] = int_to_ch((current >> 4) & 0x0F);
+        encoded[ch++] = int_to_ch(current & 0x0F);
     }
     // End encoded character array
     encoded[ch] = '\0';
@@ -111,7 +168,7 @@ void decode(const char encoded[], char result[]) {
             // Take removed digits from previous octet and add it to the right of new one
             result[cr_ch] = result[cr_ch] | (previous >> (9 - ordinal));
             // Convert GSM character to ASCII
-            result[cr_ch] = gsm_to_ascii(result[cr_ch]);
+            result[cr_ch] = gsm_to_ascii_folded(result[cr_ch]);
 
             ++cr_ch;    // Increase Index
             ++ordinal;  // Increase ordinal
@@ -121,7 +178,7 @@ void decode(const char encoded[], char result[]) {
                 // Set new character to digits removed from current octet
                 result[cr_ch] = current >> 1;
                 // Convert character to ASCII
-                result[cr_ch] = gsm_to_ascii(result[cr_ch]);
+                result[cr_ch] = gsm_to_ascii_folded(result[cr_ch]);
                 ordinal = 1;   // Start from 1 again
                 ++cr_ch;       // Go to next position in result array
             }
@@ -131,159 +188,78 @@ void decode(const char encoded[], char result[]) {
     result[cr_ch] = '\0';
 }
 
-// Convert ASCII character value to GSM character
+// Convert ASCII character value to GSM character, characters which can't be
+// encoded are converted to 0 (@)
 char ascii_to_gsm(char ascii_ch) {
-    int i;
-    char ch;
+    if ((unsigned char)ascii_ch > 0x7F)
+        return 0x00;
+    return pgm_read_byte(ascii_to_gsm_table + (unsigned char)ascii_ch);
+}
 
-    if (ascii_ch == ' ')   // If it's space return space
-        return 0x20;
+// Convert GSM character value to ASCII, letters with diacritics are
+// converted to their base letter so they can be matched as commands
+char gsm_to_ascii_folded(char gsm_ch) {
+    return pgm_read_byte(gsm_to_ascii_table + (gsm_ch & 0x7F));
+}
 
-    // Else search for right character
-    for (i = 0; i <= 0x7F; i++) {
-        ch = gsm_to_ascii(i);
-        // If this is the one return it
-        if (ch == ascii_ch)
-            return i;
-    }
+/********************************************************************
+ * UCS-2 character encoding functions                               *
+ ********************************************************************/
 
-    return 0x00;  // If character is not found return 0 (@)
+// Convert Unicode character to ASCII, letters with diacritics are converted to
+// their base letter (š -> s), characters without ASCII counterpart are converted to ?
+char unicode_to_ascii(unsigned int code) {
+    // Latin-1 letters from 0xC0 to 0xFF
+    const char latin1[] = "AAAAAAACEEEEIIIIDNOOOOOxOUUUUYTsaaaaaaaceeeeiiiidnooooo/ouuuuyty";
+
+    if (code < 0x80)
+        return code;
+    if (code >= 0xC0 && code <= 0xFF)
+        return latin1[code - 0xC0];
+
+    switch (code) {
+        case 0x0106 : return 'C'; // Ć
+        case 0x0107 : return 'c'; // ć
+        case 0x010C : return 'C'; // Č
+        case 0x010D : return 'c'; // č
+        case 0x0110 : return 'D'; // Đ
+        case 0x0111 : return 'd'; // đ
+        case 0x0160 : return 'S'; // Š
+        case 0x0161 : return 's'; // š
+        case 0x017D : return 'Z'; // Ž
+        case 0x017E : return 'z'; // ž
+        case 0x00A0 : return ' '; // No-break space
+        case 0x2018 :             // Left single quotation mark
+        case 0x2019 : return '\''; // Right single quotation mark
+        case 0x201C :             // Left double quotation mark
+        case 0x201D : return '"'; // Right double quotation mark
+        case 0x2013 :             // En dash
+        case 0x2014 : return '-'; // Em dash
+
+        default     : return '?';
+    }
 }
 
-// Convert GSM character value to ASCII
-char gsm_to_ascii(char gsm_ch) {
-    switch (gsm_ch) {
-        case 0x00 : return '@'  ;
-        case 0x01 : return ' '  ; // £
-        case 0x02 : return '$'  ;
-        case 0x03 : return ' '  ; // ¥
-        case 0x04 : return ' '  ; // è
-        case 0x05 : return ' '  ; // é
-        case 0x06 : return ' '  ; // ù
-        case 0x07 : return ' '  ; // ì
-        case 0x08 : return ' '  ; // ò
-        case 0x09 : return ' '  ; // Ç
-        case 0x0A : return '\n' ;
-        case 0x0B : return ' '  ; // Ø
-        case 0x0C : return ' '  ; // ø
-        case 0x0D : return '\r' ;
-        case 0x0E : return ' '  ; // Å
-        case 0x0F : return ' '  ; // å
-        case 0x10 : return ' '  ; // Δ
-        case 0x11 : return '_'  ;
-        case 0x12 : return ' '  ; // Φ
-        case 0x13 : return ' '  ; // Γ
-        case 0x14 : return ' '  ; // Λ
-        case 0x15 : return ' '  ; // Ω
-        case 0x16 : return ' '  ; // Π
-        case 0x17 : return ' '  ; // Ψ
-        case 0x18 : return ' '  ; // Σ
-        case 0x19 : return ' '  ; // Θ
-        case 0x1A : return ' '  ; // Ξ
-        case 0x1B : return '\e' ;
-        case 0x1C : return ' '  ; // Æ
-        case 0x1D : return ' '  ; // æ
-        case 0x1E : return ' '  ; // ß
-        case 0x1F : return ' '  ; // É
-        case 0x20 : return ' '  ;
-        case 0x21 : return '!'  ;
-        case 0x22 : return '"'  ;
-        case 0x23 : return '#'  ;
-        case 0x24 : return ' '  ; // ¤
-        case 0x25 : return '%'  ;
-        case 0x26 : return '&'  ;
-        case 0x27 : return '\'' ;
-        case 0x28 : return '('  ;
-        case 0x29 : return ')'  ;
-        case 0x2A : return '*'  ;
-        case 0x2B : return '+'  ;
-        case 0x2C : return ','  ;
-        case 0x2D : return '-'  ;
-        case 0x2E : return '.'  ;
-        case 0x2F : return '/'  ;
-        case 0x30 : return '0'  ;
-        case 0x31 : return '1'  ;
-        case 0x32 : return '2'  ;
-        case 0x33 : return '3'  ;
-        case 0x34 : return '4'  ;
-        case 0x35 : return '5'  ;
-        case 0x36 : return '6'  ;
-        case 0x37 : return '7'  ;
-        case 0x38 : return '8'  ;
-        case 0x39 : return '9'  ;
-        case 0x3A : return ':'  ;
-        case 0x3B : return ';'  ;
-        case 0x3C : return '<'  ;
-        case 0x3D : return '='  ;
-        case 0x3E : return '>'  ;
-        case 0x3F : return '?'  ;
-        case 0x40 : return ' '  ; // ¡
-        case 0x41 : return 'A'  ;
-        case 0x42 : return 'B'  ;
-        case 0x43 : return 'C'  ;
-        case 0x44 : return 'D'  ;
-        case 0x45 : return 'E'  ;
-        case 0x46 : return 'F'  ;
-        case 0x47 : return 'G'  ;
-        case 0x48 : return 'H'  ;
-        case 0x49 : return 'I'  ;
-        case 0x4A : return 'J'  ;
-        case 0x4B : return 'K'  ;
-        case 0x4C : return 'L'  ;
-        case 0x4D : return 'M'  ;
-        case 0x4E : return 'N'  ;
-        case 0x4F : return 'O'  ;
-        case 0x50 : return 'P'  ;
-        case 0x51 : return 'Q'  ;
-        case 0x52 : return 'R'  ;
-        case 0x53 : return 'S'  ;
-        case 0x54 : return 'T'  ;
-        case 0x55 : return 'U'  ;
-        case 0x56 : return 'V'  ;
-        case 0x57 : return 'W'  ;
-        case 0x58 : return 'X'  ;
-        case 0x59 : return 'Y'  ;
-        case 0x5A : return 'Z'  ;
-        case 0x5B : return ' '  ; // Ä
-        case 0x5C : return ' '  ; // Ö
-        case 0x5D : return ' '  ; // Ñ
-        case 0x5E : return ' '  ; // Ü
-        case 0x5F : return ' '  ; // §
-        case 0x60 : return ' '  ; // ¿
-        case 0x61 : return 'a'  ;
-        case 0x62 : return 'b'  ;
-        case 0x63 : return 'c'  ;
-        case 0x64 : return 'd'  ;
-        case 0x65 : return 'e'  ;
-        case 0x66 : return 'f'  ;
-        case 0x67 : return 'g'  ;
-        case 0x68 : return 'h'  ;
-        case 0x69 : return 'i'  ;
-        case 0x6A : return 'j'  ;
-        case 0x6B : return 'k'  ;
-        case 0x6C : return 'l'  ;
-        case 0x6D : return 'm'  ;
-        case 0x6E : return 'n'  ;
-        case 0x6F : return 'o'  ;
-        case 0x70 : return 'p'  ;
-        case 0x71 : return 'q'  ;
-        case 0x72 : return 'r'  ;
-        case 0x73 : return 's'  ;
-        case 0x74 : return 't'  ;
-        case 0x75 : return 'u'  ;
-        case 0x76 : return 'v'  ;
-        case 0x77 : return 'w'  ;
-        case 0x78 : return 'x'  ;
-        case 0x79 : return 'y'  ;
-        case 0x7A : return 'z'  ;
-        case 0x7B : return ' '  ; // ä
-        case 0x7C : return ' '  ; // ö
-        case 0x7D : return ' '  ; // ñ
-        case 0x7E : return ' '  ; // ü
-        case 0x7F : return ' '  ; // à
-
-        default   : return ' '  ;
+// Decode SMS PDU encoded as UCS-2 and convert it to ASCII
+//    encoded     -- string to be decoded, 4 HEX digits for each character
+//    result      -- array where result is to be placed
+//    result_size -- size of result array
+void decode_ucs2(const char encoded[], char result[], const int result_size) {
+    int i;      // Index counter of encoded character array
+    int cr_ch;  // Current character in result array
+
+    for (i = 0, cr_ch = 0; cr_ch < result_size - 1; i += 4) {
+        // Stop if whole character is not there
+        if (encoded[i] == '\0' || encoded[i + 1] == '\0' || encoded[i + 2] == '\0' || encoded[i + 3] == '\0')
+            break;
+
+        result[cr_ch++] = unicode_to_ascii(
+            (unsigned int)ch_to_int(encoded[i]) << 12 | ch_to_int(encoded[i + 1]) << 8 |
+            ch_to_int(encoded[i + 2]) << 4 | ch_to_int(encoded[i + 3])
+        );
     }
+    // End result character array
+    result[cr_ch] = '\0';
 }
 
 /********************************************************************
@@ -293,24 +269,31 @@ char gsm_to_ascii(char gsm_ch) {
 builder::builder() {
     number[0] = '\0';
     message[0] = '\0';
+    message_ram = "";
+    message_flash = NULL;
+    message_made = NULL;
+    message_length = 0;
+    ucs2 = 0;
+    part = 0;
+    reference = 0;
 }
 
 void builder::set_number(const char num[]) {
     int i;
-    for (i = 0; num[i] != '\0' && i < 160; i++) {
+    for (i = 0; num[i] != '\0' && i < 19; i++) {
         number[i] = num[i];
     }
     number[i] = '\0';
 }
 
 void builder::set_number(const __FlashStringHelper *num) {
-    unsigned int address = (unsigned int)num;     // Get address in flash
+    uintptr_t address = (uintptr_t)num;           // Get address in flash
     unsigned int i = 0;                           // Character counter
 
     while (1) {
         // Check for buffer overflow
-        if (i >= 160) {
-            message[i] = '\0';
+        if (i >= 19) {
+            number[i] = '\0';
             break;
         }
         // Get current character from flash
@@ -324,41 +307,118 @@ void builder::set_number(const __FlashStringHelper *num) {
     }
 }
 
-void builder::set_message(const char msg[]) {
-    int i;
-    for (i = 0; msg[i] != '\0' && i < 160; i++) {
-        message[i] = msg[i];
+uint8_t builder::read_byte(int position) {
+    if (message_made != NULL)
+        return message_made->read_byte(position);
+    if (message_flash != NULL)
+        return pgm_read_byte_near((uintptr_t)message_flash + position);
+    return message_ram[position];
+}
+
+unsigned int builder::read_char(int &position) {
+    unsigned int code;  // Code of character
+    int extra;          // Number of bytes after first byte of UTF-8 sequence
+    uint8_t ch;         // Current byte
+
+    ch = read_byte(position++);
+    if (ch < 0x80)
+        return ch;
+    // Find length of UTF-8 sequence, characters longer than 16 bits can't be sent as UCS-2
+    if ((ch & 0xE0) == 0xC0) {
+        code = ch & 0x1F;
+        extra = 1;
+    } else if ((ch & 0xF0) == 0xE0) {
+        code = ch & 0x0F;
+        extra = 2;
+    } else {
+        return '?';
+    }
+    while (extra-- > 0) {
+        ch = read_byte(position);
+        // If sequence is broken this byte is read again as next character
+        if ((ch & 0xC0) != 0x80)
+            return '?';
+        code = code << 6 | (ch & 0x3F);
+        ++position;
     }
-    message[i] = '\0';
+    return code;
+}
+
+void builder::set_message(const char msg[]) {
+    message_ram = msg;
+    message_flash = NULL;
+    message_made = NULL;
+    set_message_info();
 }
 
 void builder::set_message(const __FlashStringHelper *msg) {
-    unsigned int address = (unsigned int)msg;     // Get address in flash
-    unsigned int i = 0;                           // Character counter
+    message_ram = NULL;
+    message_flash = msg;
+    message_made = NULL;
+    set_message_info();
+}
 
-    while (1) {
-        // Check for buffer overflow
-        if (i >= 160) {
-            message[i] = '\0';
-            break;
-        }
-        // Get current character from flash
-        char ch = pgm_read_byte_near(address + i);
-        // Add read character to message array
-        message[i] = ch;
-        // If this is last character it's done
-        if (ch == '\0') break;
-        // Else go to next character
-        ++i;
+void builder::set_message(message_source &msg) {
+    message_ram = NULL;
+    message_flash = NULL;
+    message_made = &msg;
+    set_message_info();
+}
+
+void builder::set_message_info() {
+    int position = 0;       // Position of current byte in message
+    int non_ascii = 0;      // 1 if message has characters which are not ASCII
+    unsigned int code;      // Current character
+
+    // Count characters of message
+    message_length = 0;
+    while ((code = read_char(position)) != '\0') {
+        if (code >= 0x80)
+            non_ascii = 1;
+        ++message_length;
     }
+
+    ucs2 = 0;
+    #if BUILDER_UCS2
+        if (non_ascii) {
+            int gsm_parts = get_part_count();
+            // UCS-2 keeps diacritics but takes more space, use it only if it fits in the same number of messages
+            ucs2 = 1;
+            if (get_part_count() > gsm_parts)
+                ucs2 = 0;
+        }
+    #endif
+}
+
+int builder::get_part_count() {
+    int single_length = ucs2 ? SMS_UCS2_SINGLE_LENGTH : SMS_SINGLE_LENGTH;
+    int part_length = ucs2 ? SMS_UCS2_PART_LENGTH : SMS_PART_LENGTH;
+
+    if (message_length <= single_length)
+        return 1;
+    return (message_length + part_length - 1) / part_length;
+}
+
+void builder::set_part(int part_number, uint8_t ref) {
+    part = part_number;
+    reference = ref;
 }
 
 void builder::calculate() {
-    int i = 0;    // Index counter of encoded array
-    int j;        // Array index multiple uses
-    int length;   // String length multiple uses
-    char temp;    // Temp variable for character switching
-    int max_length;
+    int i = 0;          // Index counter of encoded array
+    int j;              // Array index multiple uses
+    int length;         // String length multiple uses
+    char temp;          // Temp variable for character switching
+    int parts;          // Number of parts of whole message
+    int position = 0;   // Position in whole message
+    int udl_index;      // Index of message length in encoded array
+    unsigned int code;  // Current character of message
+
+    // Skip characters of previous parts
+    parts = get_part_count();
+    length = ucs2 ? SMS_UCS2_PART_LENGTH : SMS_PART_LENGTH;
+    for (j = 0; parts > 1 && j < part * length; j++)
+        read_char(position);
     
     // Get length of phone number
     length = strlength(number);
@@ -377,8 +437,8 @@ void builder::calculate() {
     // Set 1st octet to 0x00 - SMSC stored in phone is used
     encoded[i++] = '0';
     encoded[i++] = '0';
-    // Set 2nd octet to 0x11 - SMS-SUBMIT message
-    encoded[i++] = '1';
+    // Set 2nd octet to 0x11 - SMS-SUBMIT message, or 0x51 if message starts with User Data Header
+    encoded[i++] = (parts > 1) ? '5' : '1';
     encoded[i++] = '1';
     // Set 3rd octet to 0x00 - allow phone to set reference number
     encoded[i++] = '0';
@@ -395,25 +455,57 @@ void builder::calculate() {
     // Set TP-PID protocol identifier
     encoded[i++] = '0';
     encoded[i++] = '0';
-    // Set Data coding scheme to 7-bit alphabet
-    encoded[i++] = '0';
+    // Set Data coding scheme to 7-bit alphabet or UCS-2
     encoded[i++] = '0';
+    encoded[i++] = ucs2 ? '8' : '0';
     // Set TP-Validity-Period to 4 days
     encoded[i++] = 'A';
     encoded[i++] = 'A';
-    // Calculate max length of message that can fit in buffer
-    encoded[i] = '\0';
-    max_length = ((BUILDER_BUFFER - strlength(encoded)) / 2 / 7 * 8) + ((BUILDER_BUFFER - strlength(encoded)) / 2 % 7);
-    // If message could be larger than max length, shrink message
-    if (max_length < 170) {
-        message[max_length - 8] = '\0';
+    // Leave space for length of message, it's known once message is encoded
+    udl_index = i;
+    i += 2;
+    // User Data Header: 5 octets of concatenation information element with 8-bit reference
+    if (parts > 1) {
+        encoded[i++] = '0';
+        encoded[i++] = '5';
+        encoded[i++] = '0';
+        encoded[i++] = '0';
+        encoded[i++] = '0';
+        encoded[i++] = '3';
+        encoded[i++] = int_to_ch(reference >> 4);
+        encoded[i++] = int_to_ch(reference & 0x0F);
+        encoded[i++] = int_to_ch(parts >> 4);
+        encoded[i++] = int_to_ch(parts & 0x0F);
+        encoded[i++] = int_to_ch((part + 1) >> 4);
+        encoded[i++] = int_to_ch((part + 1) & 0x0F);
+    }
+
+    if (ucs2) {
+        // Each character takes 2 octets
+        length = (parts > 1) ? SMS_UCS2_PART_LENGTH : SMS_UCS2_SINGLE_LENGTH;
+        for (j = 0; j < length && (code = read_char(position)) != '\0'; j++) {
+            encoded[i++] = int_to_ch((code >> 12) & 0x0F);
+            encoded[i++] = int_to_ch((code >> 8) & 0x0F);
+            encoded[i++] = int_to_ch((code >> 4) & 0x0F);
+            encoded[i++] = int_to_ch(code & 0x0F);
+        }
+        encoded[i] = '\0';
+        // Length of message is number of octets, header included
+        length = (i - udl_index - 2) / 2;
+    } else {
+        // Copy characters of current part, characters which are not ASCII are converted to ASCII
+        length = (parts > 1) ? SMS_PART_LENGTH : SMS_SINGLE_LENGTH;
+        for (j = 0; j < length && (code = read_char(position)) != '\0'; j++)
+            message[j] = unicode_to_ascii(code);
+        message[j] = '\0';
+        // Encode message, after 6 octets of header first character starts after 1 fill bit
+        encode(message, (parts > 1) ? 1 : 0, encoded + i);
+        // Length of message is number of septets, header and fill bit take 7 septets
+        length = j + ((parts > 1) ? 7 : 0);
     }
     // Set Length of message
-    length = strlength(message);
-    encoded[i++] = int_to_ch(length >> 4);
-    encoded[i++] = int_to_ch(length & ~(~0 << 4));
-    // Encode message
-    encode(message, encoded + i);
+    encoded[udl_index] = int_to_ch(length >> 4);
+    encoded[udl_index + 1] = int_to_ch(length & ~(~0 << 4));
 }
 
 const char * builder::get_pdu() {
@@ -482,8 +574,10 @@ void parser::set_pdu(const char encoded[]) {
 
     if (data_coding_scheme == 0x00) {           // If its 7-bit encoded
         decode(encoded + i, message);           // Decode message
+    } else if (data_coding_scheme == 0x08) {    // If its UCS-2 encoded
+        decode_ucs2(encoded + i, message, 170); // Decode message, diacritics are removed
     } else {
-        for (j = 0; encoded[i] != '\0'; j++) {  // Else copy message as it is
+        for (j = 0; encoded[i] != '\0' && j < 169; j++) {  // Else copy message as it is
             message[j] = encoded[i++];
         }
         message[j] = '\0';                      // End message array
@@ -494,6 +588,15 @@ const char * parser::get_message() {
     return message;
 }
 
+void parser::to_lower() {
+    int i;  // Index counter
+
+    for (i = 0; message[i] != '\0'; i++) {
+        if (message[i] >= 'A' && message[i] <= 'Z')
+            message[i] = message[i] - 'A' + 'a';
+    }
+}
+
 const char * parser::get_number() {
     return number;
 }
@@ -53,10 +53,41 @@ void init_sd() {
     digitalWrite(53, LOW);
 }
 
+storage_class::storage_class() {
+    settings_cache_ready = FALSE;
+    settings_cache_hits = 0;
+    settings_cache_misses = 0;
+    user_index_ready = FALSE;
+    user_index_count = 0;
+    user_compact_state = USER_COMPACT_IDLE;
+    user_compact_pos = 0;
+    user_tombstones = 0;
+    user_pos_logical = -1;
+    user_pos_physical = 0;
+    log_days_current = LOG_NO_DAY;
+    log_stage_count = 0;
+    log_flushes = 0;
+    log_flushed_records = 0;
+    last_sync = 0;
+    sd_opens = 0;
+    sd_syncs = 0;
+    clock_seconds = 0;
+    clock_millis = 0;
+    clock_last_sync = 0;
+    clock_interval = RTC_SYNC_INTERVAL * 1000UL;
+    clock_ready = FALSE;
+    clock_drift = 0;
+    clock_drift_max = 0;
+    clock_syncs = 0;
+    clock_failures = 0;
+}
+
 void storage_class::init() {
     // Initilize dependencies
     init_sd();
     init_rtc();
+    // Start software clock
+    clock_sync();
 
     // Check if data dir exist
     if (!system_control.test_error(ERROR_SD) && !SD.exists(DATA_DIR)) {
@@ -67,12 +98,11 @@ void storage_class::init() {
 
     // Check if settings file exist
     if (!system_control.test_error(ERROR_SD) && !SD.exists(SETTINGS_FILE)) {
-        File settings_file = SD.open(SETTINGS_FILE, (O_CREAT | O_READ | O_WRITE));
+        open_file(settings_file, SETTINGS_FILE);
         if (!settings_file) {
             system_control.set_error(ERROR_SD_WRITE);
             return;
         }
-        settings_file.close();
 
         set_setting(SETTING_PASSWORD, "0000");
         set_setting(SETTING_PASSWORD, FALSE);
@@ -87,241 +117,1346 @@ void storage_class::init() {
         set_setting(SETTING_LAST_LIGHT_STATE, "");
         set_setting(SETTING_LAST_LIGHT_STATE, OFF);
     }
+
+    // Load settings to RAM so they don't have to be read from SD card each time
+    if (!system_control.test_error(ERROR_SD))
+        load_settings_cache();
+    // Load interval of software clock syncs
+    if (!system_control.test_error(ERROR_SD) && get_setting(SETTING_RTC_SYNC_INTERVAL).int_value > 0)
+        clock_interval = get_setting(SETTING_RTC_SYNC_INTERVAL).int_value * 1000UL;
+    // Finish compaction of users file if it was interrupted by reset
+    if (!system_control.test_error(ERROR_SD))
+        user_compact_recover();
+    // Build index used to find users by number without scanning users file
+    if (!system_control.test_error(ERROR_SD))
+        user_index_build();
+    // Load ring log header, create log file if needed
+    if (!system_control.test_error(ERROR_SD))
+        log_init();
+}
+
+void storage_class::update() {
+    // Correct software clock from RTC
+    if (millis() - clock_last_sync >= clock_interval)
+        clock_sync();
+    // Loop is idle at this point, so staged log records can be written
+    log_flush();
+    // Remove deleted users from users file, little by little
+    user_compact_step();
+
+    if (millis() - last_sync < STORAGE_SYNC_INTERVAL) return;
+    last_sync = millis();
+
+    // Try to recover from SD card read and write errors
+    if (system_control.test_error(ERROR_SD_READ | ERROR_SD_WRITE | ERROR_SD_UNKNOWN) && !system_control.test_error(ERROR_SD_INIT))
+        reopen();
+    sync();
+}
+
+void storage_class::sync() {
+    log_flush();
+    sync_file(settings_file);
+    sync_file(user_file);
+    sync_file(log_file);
+    sync_file(days_file);
+}
+
+unsigned long storage_class::get_sd_opens() {
+    return sd_opens;
+}
+
+unsigned long storage_class::get_sd_syncs() {
+    return sd_syncs;
+}
+
+void storage_class::open_file(File &file, const char path[]) {
+    if (file) return;
+
+    file = SD.open(path, (O_READ | O_WRITE | O_CREAT));
+    ++sd_opens;
+}
+
+void storage_class::sync_file(File &file) {
+    if (!file) return;
+
+    file.flush();
+    ++sd_syncs;
+    // If any write since last sync failed close file, it will be opened again on next access
+    if (file.getWriteError()) {
+        file.clearWriteError();
+        file.close();
+        system_control.set_error(ERROR_SD_WRITE);
+    }
+}
+
+void storage_class::reopen() {
+    // Compaction is checked again after files are opened
+    user_new_file.close();
+    user_compact_state = USER_COMPACT_IDLE;
+
+    settings_file.close();
+    user_file.close();
+    log_file.close();
+    days_file.close();
+
+    open_file(settings_file, SETTINGS_FILE);
+    open_file(user_file, USERS_FILE);
+    open_file(log_file, LOG_FILE);
+    open_file(days_file, LOG_DAYS_FILE);
+    // Leave errors set until SD card is working again
+    if (!settings_file || !user_file || !log_file || !days_file)
+        return;
+
+    system_control.unset_error(ERROR_SD_READ | ERROR_SD_WRITE | ERROR_SD_UNKNOWN);
+    // Files could be changed while they were failing, so load RAM copies again
+    load_settings_cache();
+    user_compact_recover();
+    user_index_build();
+    log_init();
+}
+
+/********************************************************************
+ * Functions for software clock                                     *
+ ********************************************************************/
+
+void storage_class::clock_sync() {
+    RtcDateTime rtc_time = rtc.GetDateTime();
+    clock_last_sync = millis();
+
+    // If RTC is not connected or not working it returns garbage
+    if (!rtc_time.IsValid()) {
+        ++clock_failures;
+        system_control.set_error(ERROR_RTC_UNKNOWN);
+        return;
+    }
+    ++clock_syncs;
+
+    if (!clock_ready) {
+        clock_seconds = rtc_time.TotalSeconds();
+        clock_millis = millis();
+        clock_ready = TRUE;
+        return;
+    }
+
+    // Only whole seconds are corrected, so clock keeps ticking at the same moment within second
+    clock_drift = (long)(rtc_time.TotalSeconds() - now().TotalSeconds());
+    clock_seconds += clock_drift;
+    if (labs(clock_drift) > labs(clock_drift_max))
+        clock_drift_max = clock_drift;
+
+    // Big jump means that RTC stopped or lost time, error is removed once RTC agrees with software clock again
+    if (labs(clock_drift) > RTC_DRIFT_LIMIT)
+        system_control.set_error(ERROR_RTC_UNKNOWN);
+    else if (system_control.test_error(ERROR_RTC_UNKNOWN))
+        system_control.unset_error(ERROR_RTC_UNKNOWN);
+}
+
+RtcDateTime storage_class::now() {
+    unsigned long elapsed = millis() - clock_millis;
+
+    // Move start of clock forward so millis() overflow doesn't matter
+    if (elapsed >= 1000) {
+        clock_seconds += elapsed / 1000;
+        clock_millis += elapsed / 1000 * 1000;
+    }
+    return RtcDateTime(clock_seconds);
+}
+
+void storage_class::set_time(const RtcDateTime &time) {
+    rtc.SetDateTime(time);
+
+    clock_seconds = time.TotalSeconds();
+    clock_millis = millis();
+    clock_last_sync = millis();
+    clock_ready = TRUE;
+    clock_drift = 0;
+    // Time set by user can be trusted again
+    if (system_control.test_error(ERROR_RTC))
+        system_control.unset_error(ERROR_RTC);
+}
+
+void storage_class::set_clock_interval(int seconds) {
+    set_setting(SETTING_RTC_SYNC_INTERVAL, seconds);
+    clock_interval = (seconds > 0 ? seconds : RTC_SYNC_INTERVAL) * 1000UL;
+}
+
+int storage_class::get_clock_interval() {
+    return clock_interval / 1000;
+}
+
+long storage_class::get_clock_drift() {
+    return clock_drift;
+}
+
+long storage_class::get_clock_drift_max() {
+    return clock_drift_max;
+}
+
+unsigned long storage_class::get_clock_syncs() {
+    return clock_syncs;
+}
+
+unsigned long storage_class::get_clock_failures() {
+    return clock_failures;
 }
 
 /********************************************************************
  * Functions for system settings                                    *
  ********************************************************************/
 
-struct setting_record storage_class::get_setting(setting_ids setting_id) {
-    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
-        return setting_record {};
+void storage_class::load_settings_cache() {
+    unsigned long i;
+    struct setting_record setting;
+
+    // Settings which are not found in the file are empty
+    for (i = 0; i < SETTING_COUNT; i++) {
+        settings_cache[i] = setting_record {};
+    }
+
+    open_file(settings_file, SETTINGS_FILE);
+    if (!settings_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return;
+    }
+    settings_file.seek(0);
+
+    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
+        settings_file.read((byte*)&setting, sizeof(setting));
+
+        if (setting.id < SETTING_COUNT) {
+            settings_cache[setting.id] = setting;
+        }
+    }
+    settings_cache_ready = TRUE;
+}
+
+struct setting_record storage_class::get_setting(setting_ids setting_id) {
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return setting_record {};
+
+    // If settings are loaded to RAM there is no need to touch SD card
+    if (settings_cache_ready && setting_id < SETTING_COUNT) {
+        ++settings_cache_hits;
+        return settings_cache[setting_id];
+    }
+    ++settings_cache_misses;
+
+    unsigned long i;
+    struct setting_record setting;
+
+    open_file(settings_file, SETTINGS_FILE);
+    if (!settings_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return setting_record {};
+    }
+    settings_file.seek(0);
+
+    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
+        settings_file.read((byte*)&setting, sizeof(setting));
+
+        if (setting.id == setting_id) {
+            return setting;
+        }
+    }
+    return setting_record {};
+}
+
+void storage_class::set_setting(setting_ids setting_id, const char setting_str[]) {
+    if (system_control.test_error(ERROR_SD)) return;
+
+    unsigned long i;
+    struct setting_record setting;
+
+    open_file(settings_file, SETTINGS_FILE);
+    if (!settings_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    settings_file.seek(0);
+
+    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
+        settings_file.read((byte*)&setting, sizeof(setting));
+
+        if (setting.id == setting_id){
+            strcopy(setting_str, setting.string_value, 30);
+            settings_file.seek(i);
+            settings_file.write((byte*)&setting, sizeof(setting));
+            sync_file(settings_file);
+            // Keep RAM copy same as one on SD card
+            if (setting_id < SETTING_COUNT)
+                settings_cache[setting_id] = setting;
+            return;
+        }
+    }
+    settings_file.seek(settings_file.size());
+    setting.id = setting_id;
+    strcopy(setting_str, setting.string_value, 30);
+    settings_file.write((byte*)&setting, sizeof(setting));
+    sync_file(settings_file);
+    // Keep RAM copy same as one on SD card
+    if (setting_id < SETTING_COUNT)
+        settings_cache[setting_id] = setting;
+}
+
+void storage_class::set_setting(setting_ids setting_id, const int setting_int) {
+    if (system_control.test_error(ERROR_SD)) return;
+
+    unsigned long i;
+    struct setting_record setting;
+
+    open_file(settings_file, SETTINGS_FILE);
+    if (!settings_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    settings_file.seek(0);
+
+    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
+        settings_file.read((byte*)&setting, sizeof(setting));
+
+        if (setting.id == setting_id){
+            setting.int_value = setting_int;
+            settings_file.seek(i);
+            settings_file.write((byte*)&setting, sizeof(setting));
+            sync_file(settings_file);
+            // Keep RAM copy same as one on SD card
+            if (setting_id < SETTING_COUNT)
+                settings_cache[setting_id] = setting;
+            return;
+        }
+    }
+
+    settings_file.seek(settings_file.size());
+    setting.id = setting_id;
+    setting.int_value = setting_int;
+    settings_file.write((byte*)&setting, sizeof(setting));
+    sync_file(settings_file);
+    // Keep RAM copy same as one on SD card
+    if (setting_id < SETTING_COUNT)
+        settings_cache[setting_id] = setting;
+}
+
+unsigned long storage_class::get_settings_cache_hits() {
+    return settings_cache_hits;
+}
+
+unsigned long storage_class::get_settings_cache_misses() {
+    return settings_cache_misses;
+}
+
+/********************************************************************
+ * Functions for Logging                                            *
+ ********************************************************************/
+
+// Value of magic field in log file header
+const char LOG_MAGIC[4] = {'D', 'V', 'D', 'L'};
+
+// Action codes as they are printed, indexed by log_actions
+const char LOG_ACTIONS[LOG_ACTION_COUNT][4] PROGMEM = {
+    "???", "VMO", "VMZ", "VVO", "VVZ", "PMO", "PMZ", "PVV",
+    "SON", "SOF", "UST", "UNA", "UNE", "UPR", "UVA", "UVT",
+    "SUP"
+};
+
+// Function returns empty log record
+static log_record empty_log() {
+    return log_record {0, "", 0, 0, 0, 0, 0, 0};
+}
+
+// Function copies action code of given action from PROGMEM table
+static void log_action_code(uint8_t action, char code[4]) {
+    uint8_t i;
+
+    for (i = 0; i < 4; i++)
+        code[i] = pgm_read_byte(&LOG_ACTIONS[action][i]);
+}
+
+// Function finds action for given action code
+// Returns: one of log_actions, or LOG_ACTION_UNKNOWN if code is not known
+static uint8_t log_action(const char action[]) {
+    char code[4];   // Action code copied from PROGMEM
+    uint8_t i;
+
+    for (i = 1; i < LOG_ACTION_COUNT; i++) {
+        log_action_code(i, code);
+        if (strcompare(action, code))
+            return i;
+    }
+    return LOG_ACTION_UNKNOWN;
+}
+
+// Function converts log record to format stored in log file
+static log_packed_record log_pack(const log_record &log) {
+    log_packed_record packed;
+
+    packed.user_id = log.user_id;
+    packed.action = log_action(log.action);
+    packed.time = RtcDateTime(log.year, log.month, log.day, log.hour, log.minute, log.second).TotalSeconds();
+    return packed;
+}
+
+// Function converts record stored in log file to log record
+static log_record log_unpack(const log_packed_record &packed) {
+    log_record log;
+    RtcDateTime time(packed.time);
+
+    log.user_id = packed.user_id;
+    log_action_code(packed.action < LOG_ACTION_COUNT ? packed.action : LOG_ACTION_UNKNOWN, log.action);
+    log.second = time.Second();
+    log.minute = time.Minute();
+    log.hour = time.Hour();
+    log.day = time.Day();
+    log.month = time.Month();
+    log.year = time.Year();
+    return log;
+}
+
+// Function reads record at current position of log file, format of record
+// is given by log file header so both versions of log file can be read
+static void log_read_record(File &log_file, const log_header &info, log_record &log) {
+    if (info.version == 1) {
+        log_file.read((byte*)&log, sizeof(log_record));
+    } else {
+        log_packed_record packed;
+        log_file.read((byte*)&packed, sizeof(log_packed_record));
+        log = log_unpack(packed);
+    }
+}
+
+// Function checks if header describes valid log file of given version
+static int log_header_check(const log_header &info, uint8_t version, uint8_t record_size) {
+    return
+        info.magic[0] == LOG_MAGIC[0] && info.magic[1] == LOG_MAGIC[1] &&
+        info.magic[2] == LOG_MAGIC[2] && info.magic[3] == LOG_MAGIC[3] &&
+        info.version == version &&
+        info.record_size == record_size &&
+        info.capacity > 0 &&
+        info.head < info.capacity &&
+        info.tail < info.capacity &&
+        info.count <= info.capacity;
+}
+
+// Function returns user record for user ID which is not in users file
+static user_record reserved_user(int id) {
+    switch (id) {
+        case USER_PANEL:
+            return user_record {USER_PANEL, 1, "PANEL"};
+        case USER_SERIAL:
+            return user_record {USER_SERIAL, 1, "KONZOLA"};
+        case USER_LAST_RESEVED:
+            return user_record {USER_LAST_RESEVED, 0, "RESERVED"};
+        default:
+            return user_record {USER_DELETED, 0, "OBRISAN"};
+    }
+}
+
+int storage_class::log_header_valid() {
+    return log_header_check(log_info, LOG_VERSION, sizeof(log_packed_record));
+}
+
+void storage_class::log_write_header(File &log_file) {
+    log_file.seek(0);
+    log_file.write((byte*)&log_info, sizeof(log_header));
+}
+
+void storage_class::log_append(File &log_file, const log_record &log) {
+    log_packed_record packed = log_pack(log);
+
+    // Write record to the slot head points to
+    log_file.seek(sizeof(log_header) + log_info.head * sizeof(log_packed_record));
+    log_file.write((byte*)&packed, sizeof(log_packed_record));
+    // Move head to the next slot, if log is full oldest record is overwritten
+    log_info.head = (log_info.head + 1) % log_info.capacity;
+    if (log_info.count < log_info.capacity) {
+        ++log_info.count;
+    } else {
+        log_info.tail = log_info.head;
+    }
+}
+
+int storage_class::log_read(File &log_file, unsigned long position, log_record &log) {
+    if (position >= log_info.count)
+        return FALSE;
+
+    // Slot of record which is position records before the last one
+    unsigned long slot = (log_info.head + log_info.capacity - 1 - position) % log_info.capacity;
+
+    log_file.seek(sizeof(log_header) + slot * log_info.record_size);
+    log_read_record(log_file, log_info, log);
+    return TRUE;
+}
+
+unsigned int storage_class::log_read_page(File &log_file, unsigned long position, unsigned int count, log_page_record page[]) {
+    unsigned int i;
+
+    if (position >= log_info.count)
+        return 0;
+    if (count > log_info.count - position)
+        count = log_info.count - position;
+
+    // Slot of the oldest record on page, records from there to the newest one on page follow each other
+    // in the file unless ring wraps between them, so they are read from oldest to newest
+    unsigned long slot = (log_info.head + 2 * log_info.capacity - position - count) % log_info.capacity;
+
+    log_file.seek(sizeof(log_header) + slot * log_info.record_size);
+    for (i = count; i > 0; i--) {
+        if (slot == log_info.capacity) {
+            slot = 0;
+            log_file.seek(sizeof(log_header));
+        }
+        log_read_record(log_file, log_info, page[i - 1].log);
+        ++slot;
+    }
+    return count;
+}
+
+void storage_class::log_page_users(unsigned int count, log_page_record page[]) {
+    unsigned int i;
+    unsigned int found = 0;      // Number of records which user is found for
+    unsigned long pos;
+    user_record user;
+
+    for (i = 0; i < count; i++) {
+        page[i].user = reserved_user(page[i].log.user_id);
+        // Reserved users are never in users file
+        if (page[i].log.user_id <= USER_LAST_RESEVED)
+            ++found;
+    }
+    if (found == count) return;
+
+    open_file(user_file, USERS_FILE);
+    if (!user_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return;
+    }
+    user_file.seek(0);
+
+    // Each user is checked against all records on page, stop when users for all records are found
+    for (pos = 0; pos < user_file.size() && found < count; pos += sizeof(user_record)) {
+        user_file.read((byte*)&user, sizeof(user_record));
+        if (user.id == USER_DELETED) continue;
+
+        for (i = 0; i < count; i++) {
+            if (page[i].log.user_id == user.id) {
+                page[i].user = user;
+                ++found;
+            }
+        }
+    }
+}
+
+int storage_class::log_create() {
+    unsigned long i;
+    byte zeros[32];
+
+    // File is opened again so it's truncated
+    log_file.close();
+    log_file = SD.open(LOG_FILE, (O_READ | O_WRITE | O_CREAT | O_TRUNC));
+    ++sd_opens;
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return FALSE;
+    }
+
+    // Set header for empty log
+    for (i = 0; i < 4; i++) {
+        log_info.magic[i] = LOG_MAGIC[i];
+    }
+    log_info.version = LOG_VERSION;
+    log_info.record_size = sizeof(log_packed_record);
+    log_info.capacity = LOG_CAPACITY;
+    log_info.head = 0;
+    log_info.tail = 0;
+    log_info.count = 0;
+    log_write_header(log_file);
+
+    // Allocate space for all records now, so clusters don't have to be
+    // allocated later while system is logging actions
+    for (i = 0; i < sizeof(zeros); i++) {
+        zeros[i] = 0;
+    }
+    for (i = 0; i < LOG_CAPACITY * sizeof(log_packed_record); i += sizeof(zeros)) {
+        log_file.write(zeros, min(sizeof(zeros), LOG_CAPACITY * sizeof(log_packed_record) - i));
+    }
+
+    sync_file(log_file);
+    return TRUE;
+}
+
+void storage_class::log_migrate() {
+    unsigned long i;
+    log_record log;
+
+    File old_file = SD.open(OLD_LOG_FILE, O_READ);
+    ++sd_opens;
+    if (!old_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return;
+    }
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        old_file.close();
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    old_file.seek(0);
+
+    // Copy records from oldest to newest, if there are more records than
+    // ring log can hold only newest ones are kept
+    for (i = 0; i + sizeof(log_record) <= old_file.size(); i += sizeof(log_record)) {
+        old_file.read((byte*)&log, sizeof(log_record));
+        log_append(log_file, log);
+    }
+    log_write_header(log_file);
+
+    sync_file(log_file);
+    old_file.close();
+
+    // Remove old file only after all records are copied, if system is reset
+    // before that migration will start again on next boot
+    if (!SD.remove(OLD_LOG_FILE)) {
+        system_control.set_error(ERROR_SD_WRITE);
+    }
+}
+
+void storage_class::log_convert() {
+    unsigned long i;
+    log_header old_info;
+    log_record log;
+
+    File old_file = SD.open(LOG_V1_FILE, O_READ);
+    ++sd_opens;
+    if (!old_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return;
+    }
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        old_file.close();
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    old_file.seek(0);
+    old_file.read((byte*)&old_info, sizeof(log_header));
+
+    // Copy records from oldest to newest, damaged file is only removed
+    if (log_header_check(old_info, 1, sizeof(log_record))) {
+        for (i = old_info.count; i > 0; i--) {
+            old_file.seek(sizeof(log_header) + (old_info.head + old_info.capacity - i) % old_info.capacity * old_info.record_size);
+            log_read_record(old_file, old_info, log);
+            log_append(log_file, log);
+        }
+        log_write_header(log_file);
+    }
+
+    sync_file(log_file);
+    old_file.close();
+
+    // Remove old file only after all records are copied, if system is reset
+    // before that conversion will start again on next boot
+    if (!SD.remove(LOG_V1_FILE)) {
+        system_control.set_error(ERROR_SD_WRITE);
+    }
+}
+
+void storage_class::log_init() {
+    // Read header of existing log file
+    if (SD.exists(LOG_FILE) && !SD.exists(OLD_LOG_FILE) && !SD.exists(LOG_V1_FILE)) {
+        open_file(log_file, LOG_FILE);
+        if (!log_file) {
+            system_control.set_error(ERROR_SD_READ);
+            return;
+        }
+        log_file.seek(0);
+        log_file.read((byte*)&log_info, sizeof(log_header));
+    }
+
+    // If log file does not exist, is damaged, or migration was interrupted
+    // create new empty log file
+    if (!log_header_valid() || SD.exists(OLD_LOG_FILE) || SD.exists(LOG_V1_FILE)) {
+        if (!log_create())
+            return;
+
+        // Convert log files used by older firmware
+        if (SD.exists(OLD_LOG_FILE))
+            log_migrate();
+        if (SD.exists(LOG_V1_FILE))
+            log_convert();
+    }
+
+    // Load index used for date queries
+    log_days_init();
+}
+
+void storage_class::log_flush() {
+    int i, count;
+    log_packed_record batch[LOG_STAGE_SIZE];   // Staged records converted to format stored in log file
+    unsigned long first_run;            // Number of records which fit before end of ring
+
+    if (log_stage_count == 0) return;
+    // Staged records are dropped if they can't be written
+    if (system_control.test_error(ERROR_SD) || !log_header_valid()) {
+        log_stage_count = 0;
+        return;
+    }
+
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        log_stage_count = 0;
+        return;
+    }
+
+    // Read clock only once for whole batch, time of each record is calculated
+    // from how long ago it was staged
+    uint32_t now_s = now().TotalSeconds();
+    unsigned long now_ms = millis();
+
+    for (i = 0; i < log_stage_count; i++) {
+        batch[i].user_id = log_stage[i].user_id;
+        batch[i].action = log_stage[i].action;
+        batch[i].time = now_s - (now_ms - log_stage[i].time) / 1000;
+    }
+
+    // Write records in at most two runs, second one is needed only if ring wraps
+    first_run = min((unsigned long)log_stage_count, log_info.capacity - log_info.head);
+    log_file.seek(sizeof(log_header) + log_info.head * sizeof(log_packed_record));
+    log_file.write((byte*)batch, first_run * sizeof(log_packed_record));
+    if (first_run < (unsigned long)log_stage_count) {
+        log_file.seek(sizeof(log_header));
+        log_file.write((byte*)(batch + first_run), (log_stage_count - first_run) * sizeof(log_packed_record));
+    }
+    // Move head and tail same as log_append() would
+    log_info.head = (log_info.head + log_stage_count) % log_info.capacity;
+    if (log_info.count + log_stage_count <= log_info.capacity) {
+        log_info.count += log_stage_count;
+    } else {
+        log_info.count = log_info.capacity;
+        log_info.tail = log_info.head;
+    }
+    log_write_header(log_file);
+    sync_file(log_file);
+
+    count = log_stage_count;
+    log_stage_count = 0;
+    ++log_flushes;
+    log_flushed_records += count;
+
+    // Add records to day index
+    open_file(days_file, LOG_DAYS_FILE);
+    if (!days_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        log_days_add(days_file, log_unpack(batch[i]), log_days_info.total);
+    }
+    log_days_write_header(days_file);
+    sync_file(days_file);
+}
+
+void storage_class::log_this(int user_id, const char * log_string) {
+    if (system_control.test_error(ERROR_SD) || !log_header_valid()) return;
+
+    // Only stage record, SD card and RTC are accessed when staged records are flushed
+    log_stage[log_stage_count].user_id = user_id;
+    log_stage[log_stage_count].action = log_action(log_string);
+    log_stage[log_stage_count].time = millis();
+    ++log_stage_count;
+
+    if (log_stage_count == LOG_STAGE_SIZE)
+        log_flush();
+}
+
+unsigned long storage_class::get_log_flushes() {
+    return log_flushes;
+}
+
+unsigned long storage_class::get_log_flushed_records() {
+    return log_flushed_records;
+}
+
+void storage_class::clear_log() {
+    // Staged records are written first, so they are cleared too
+    log_flush();
+    if (system_control.test_error(ERROR_SD) || !log_header_valid()) return;
+
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    // Space for records stays allocated, only header is reset
+    log_info.head = 0;
+    log_info.tail = 0;
+    log_info.count = 0;
+    log_write_header(log_file);
+    sync_file(log_file);
+
+    // Day index of empty log is empty
+    log_days_build();
+}
+
+unsigned long storage_class::get_log_count() {
+    // Reads must see all logged records
+    log_flush();
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return 0u;
+
+    // Header is kept in RAM so there is no need to read SD card
+    return log_info.count;
+}
+
+unsigned long storage_class::get_log_count(uint8_t day, uint8_t month, uint16_t year) {
+    log_flush();
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return 0u;
+
+    log_day_record entry;
+    open_file(days_file, LOG_DAYS_FILE);
+    if (!days_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return 0u;
+    }
+
+    log_days_find(days_file, day, month, year, entry);
+    return entry.count;
+}
+
+struct log_record storage_class::get_log(unsigned long position) {
+    log_flush();
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return empty_log();
+
+    log_record log = empty_log();
+
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return log;
+    }
+
+    if (!log_read(log_file, position, log))
+        log = empty_log();
+
+    return log;
+}
+
+struct log_record storage_class::get_log(unsigned long position, uint8_t day, uint8_t month, uint16_t year) {
+    log_flush();
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return empty_log();
+    
+    log_record log = empty_log();
+    log_day_record entry;
+    open_file(days_file, LOG_DAYS_FILE);
+    if (!days_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return log;
+    }
+    // Find where records for that date are
+    if (!log_days_find(days_file, day, month, year, entry) || position >= entry.count) {
+        return log;
+    }
+
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return log;
+    }
+    // Sequence number of requested record is converted to position from the last record
+    if (!log_read(log_file, log_days_info.total - 1 - (entry.first + entry.count - 1 - position), log))
+        log = empty_log();
+
+    return log;
+}
+
+unsigned int storage_class::get_log_page(unsigned long position, unsigned int count, log_page_record page[]) {
+    log_flush();
+    user_compact_finish();
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return 0;
+
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return 0;
+    }
+
+    count = log_read_page(log_file, position, count, page);
+    log_page_users(count, page);
+    return count;
+}
+
+unsigned int storage_class::get_log_page(unsigned long position, unsigned int count, uint8_t day, uint8_t month, uint16_t year, log_page_record page[]) {
+    log_flush();
+    user_compact_finish();
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return 0;
+
+    log_day_record entry;
+    open_file(days_file, LOG_DAYS_FILE);
+    if (!days_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return 0;
+    }
+    // Find where records for that date are
+    if (!log_days_find(days_file, day, month, year, entry) || position >= entry.count)
+        return 0;
+    if (count > entry.count - position)
+        count = entry.count - position;
+
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return 0;
+    }
+    // Records of one day follow each other, so page starts at position of its newest record
+    count = log_read_page(log_file, log_days_info.total - 1 - (entry.first + entry.count - 1 - position), count, page);
+    log_page_users(count, page);
+    return count;
+}
+
+/********************************************************************
+ * Functions for log day index                                      *
+ ********************************************************************/
+
+// Value of magic field in day index header
+const char LOG_DAYS_MAGIC[4] = {'D', 'V', 'D', 'D'};
+
+// Function converts date to number of days since 1.1.2000.
+// Returns: day number, or LOG_NO_DAY if date is not valid
+static uint32_t day_number(uint8_t day, uint8_t month, uint16_t year) {
+    // Number of days before first day of each month (not leap year)
+    static const uint16_t days_before[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    uint32_t days;
+
+    if (year < 2000 || month < 1 || month > 12 || day < 1 || day > 31)
+        return LOG_NO_DAY;
+
+    // Days in whole years, every 4th year since 2000 is leap year (good enough until 2100)
+    days = (uint32_t)(year - 2000) * 365 + (year - 2000 + 3) / 4;
+    // Days in whole months of this year
+    days += days_before[month - 1];
+    if (month > 2 && year % 4 == 0)
+        ++days;
+
+    return days + day - 1;
+}
+
+void storage_class::log_days_write_header(File &days_file) {
+    days_file.seek(0);
+    days_file.write((byte*)&log_days_info, sizeof(log_day_header));
+}
+
+void storage_class::log_days_add(File &days_file, const log_record &log, uint32_t sequence) {
+    uint32_t number = day_number(log.day, log.month, log.year);  // Day number of log record
+    unsigned long position;                                      // Position of entry in day index file
+
+    log_days_info.total = sequence + 1;
+
+    // Records with invalid date are not indexed
+    if (number == LOG_NO_DAY) return;
+    // First indexed record sets first day in the index
+    if (log_days_info.base_day == LOG_NO_DAY)
+        log_days_info.base_day = number;
+    // Records before first day in the index can't be indexed
+    if (number < log_days_info.base_day) return;
+
+    position = sizeof(log_day_header) + (number - log_days_info.base_day) * sizeof(log_day_record);
+
+    // If this is not the day which was logged last, load entry for this day
+    if (number != log_days_current) {
+        log_days_last = log_day_record {0, 0};
+        if (position + sizeof(log_day_record) <= days_file.size()) {
+            days_file.seek(position);
+            days_file.read((byte*)&log_days_last, sizeof(log_day_record));
+        }
+        log_days_current = number;
+    }
+    // Records of one day must follow each other, if they don't (clock was
+    // moved back) entry starts again from this record
+    if (log_days_last.count == 0 || log_days_last.first + log_days_last.count != sequence) {
+        log_days_last.first = sequence;
+        log_days_last.count = 0;
+    }
+    ++log_days_last.count;
+
+    // Fill days without any records with empty entries
+    if (position > days_file.size()) {
+        log_day_record empty_day = {0, 0};
+
+        days_file.seek(days_file.size());
+        while (days_file.size() < position) {
+            days_file.write((byte*)&empty_day, sizeof(log_day_record));
+        }
+    }
+    days_file.seek(position);
+    days_file.write((byte*)&log_days_last, sizeof(log_day_record));
+}
+
+void storage_class::log_days_build() {
+    unsigned long i;
+    log_record log;
+
+    // File is opened again so it's truncated
+    days_file.close();
+    days_file = SD.open(LOG_DAYS_FILE, (O_READ | O_WRITE | O_CREAT | O_TRUNC));
+    ++sd_opens;
+    if (!days_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
+    }
+    open_file(log_file, LOG_FILE);
+    if (!log_file) {
+        system_control.set_error(ERROR_SD_READ);
+        return;
+    }
+
+    // Start with empty index
+    for (i = 0; i < 4; i++) {
+        log_days_info.magic[i] = LOG_DAYS_MAGIC[i];
+    }
+    log_days_info.base_day = LOG_NO_DAY;
+    log_days_info.total = 0;
+    log_days_current = LOG_NO_DAY;
+    log_days_write_header(days_file);
+
+    // Add records from oldest to newest
+    for (i = log_info.count; i > 0; i--) {
+        log_read(log_file, i - 1, log);
+        log_days_add(days_file, log, log_info.count - i);
+    }
+    log_days_write_header(days_file);
+
+    sync_file(days_file);
+}
+
+void storage_class::log_days_init() {
+    log_days_current = LOG_NO_DAY;
+
+    if (SD.exists(LOG_DAYS_FILE)) {
+        open_file(days_file, LOG_DAYS_FILE);
+        if (!days_file) {
+            system_control.set_error(ERROR_SD_READ);
+            return;
+        }
+        days_file.seek(0);
+        days_file.read((byte*)&log_days_info, sizeof(log_day_header));
+
+        // Use existing index only if it describes records which are in log file
+        if (
+            log_days_info.magic[0] == LOG_DAYS_MAGIC[0] && log_days_info.magic[1] == LOG_DAYS_MAGIC[1] &&
+            log_days_info.magic[2] == LOG_DAYS_MAGIC[2] && log_days_info.magic[3] == LOG_DAYS_MAGIC[3] &&
+            log_days_info.total >= log_info.count &&
+            log_days_info.total % log_info.capacity == log_info.head
+        ) {
+            return;
+        }
+    }
+    log_days_build();
+}
+
+int storage_class::log_days_find(File &days_file, uint8_t day, uint8_t month, uint16_t year, log_day_record &entry) {
+    uint32_t number = day_number(day, month, year);   // Day number of requested date
+    uint32_t oldest;                                  // Sequence number of oldest record in log file
+    unsigned long position;                           // Position of entry in day index file
+
+    entry = log_day_record {0, 0};
+
+    if (number == LOG_NO_DAY || log_days_info.base_day == LOG_NO_DAY || number < log_days_info.base_day)
+        return FALSE;
+
+    // Entry for last logged day is already in RAM
+    if (number == log_days_current) {
+        entry = log_days_last;
+    } else {
+        position = sizeof(log_day_header) + (number - log_days_info.base_day) * sizeof(log_day_record);
+        if (position + sizeof(log_day_record) > days_file.size())
+            return FALSE;
+
+        days_file.seek(position);
+        days_file.read((byte*)&entry, sizeof(log_day_record));
+    }
+
+    // Skip records which are already overwritten in log file
+    oldest = log_days_info.total - log_info.count;
+    if (entry.first < oldest) {
+        if (entry.first + entry.count <= oldest) {
+            entry = log_day_record {0, 0};
+        } else {
+            entry.count -= oldest - entry.first;
+            entry.first = oldest;
+        }
+    }
+    return entry.count > 0;
+}
+
+/********************************************************************
+ * Functions for user number index                                  *
+ ********************************************************************/
+
+// Values of special user index slots
+#define USER_INDEX_EMPTY    0x0000
+#define USER_INDEX_DELETED  0xFFFF
+// Bits of user index slot holding user position + 1, rest of bits hold hash tag
+#define USER_INDEX_POS_MASK 0x0FFF
+
+uint16_t storage_class::user_index_hash(const char number[]) {
+    int i;                  // Index counter
+    uint16_t hash = 5381;   // Calculated hash
+
+    // Skip everything that is not a digit (npr. + or spaces)
+    for (i = 0; number[i] != '\0'; i++) {
+        if (is_digit(number[i]))
+            hash = hash * 33 + (number[i] - '0');
+    }
+    return hash;
+}
 
+void storage_class::user_index_build() {
     unsigned long i;
-    struct setting_record setting;
+    user_record user;
 
-    File settings_file = SD.open(SETTINGS_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!settings_file) {
+    // Start with empty index
+    for (i = 0; i < USER_INDEX_SIZE; i++) {
+        user_index[i] = USER_INDEX_EMPTY;
+    }
+    user_index_count = 0;
+    user_index_ready = FALSE;
+    user_tombstones = 0;
+    user_pos_logical = -1;
+
+    open_file(user_file, USERS_FILE);
+    if (!user_file) {
         system_control.set_error(ERROR_SD_READ);
-        return setting_record {};
+        return;
     }
-    settings_file.seek(0);
+    // If there are too many users leave index disabled, file is still read to count tombstones
+    user_index_ready = user_file.size() / sizeof(user_record) <= USER_INDEX_MAX_USERS;
+    user_file.seek(0);
 
-    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
-        settings_file.read((byte*)&setting, sizeof(setting));
+    for (i = 0; i < user_file.size(); i += sizeof(user_record)) {
+        user_file.read((byte*)&user, sizeof(user_record));
 
-        if (setting.id == setting_id) {
-            settings_file.close();
-            return setting;
-        }
+        if (user.id == USER_DELETED)
+            ++user_tombstones;
+        else
+            user_index_insert(user.number, i / sizeof(user_record));
     }
-    settings_file.close();
-    return setting_record {};
 }
 
-void storage_class::set_setting(setting_ids setting_id, const char setting_str[]) {
-    if (system_control.test_error(ERROR_SD)) return;
-
-    unsigned long i;
-    struct setting_record setting;
+void storage_class::user_index_insert(const char number[], unsigned int position) {
+    if (!user_index_ready) return;
 
-    File settings_file = SD.open(SETTINGS_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!settings_file) {
-        system_control.set_error(ERROR_SD_WRITE);
+    // If index is full, or position doesn't fit in slot, disable it, lookups will fall back to file scan
+    // Position + 1 equal to USER_INDEX_POS_MASK could make slot look like USER_INDEX_DELETED
+    if (user_index_count >= USER_INDEX_MAX_USERS || position + 1 >= USER_INDEX_POS_MASK) {
+        user_index_ready = FALSE;
         return;
     }
-    settings_file.seek(0);
 
-    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
-        settings_file.read((byte*)&setting, sizeof(setting));
+    unsigned int i;                                     // Probe counter
+    uint16_t hash = user_index_hash(number);            // Hash of the number
+    unsigned int slot = hash % USER_INDEX_SIZE;         // Slot where search starts
 
-        if (setting.id == setting_id){
-            strcopy(setting_str, setting.string_value, 30);
-            settings_file.seek(i);
-            settings_file.write((byte*)&setting, sizeof(setting));
-            settings_file.close();
+    // Find first free slot after the one hash points to
+    for (i = 0; i < USER_INDEX_SIZE; i++) {
+        if (user_index[slot] == USER_INDEX_EMPTY || user_index[slot] == USER_INDEX_DELETED) {
+            user_index[slot] = (hash & ~USER_INDEX_POS_MASK) | (position + 1);
+            ++user_index_count;
             return;
         }
+        slot = (slot + 1) % USER_INDEX_SIZE;
     }
-    settings_file.seek(settings_file.size());
-    setting.id = setting_id;
-    strcopy(setting_str, setting.string_value, 30);
-    settings_file.write((byte*)&setting, sizeof(setting));
-    settings_file.close();
+    // There is no free slot, this should never happen
+    user_index_ready = FALSE;
 }
 
-void storage_class::set_setting(setting_ids setting_id, const int setting_int) {
-    if (system_control.test_error(ERROR_SD)) return;
+void storage_class::user_index_remove(const char number[], unsigned int position) {
+    if (!user_index_ready) return;
 
-    unsigned long i;
-    struct setting_record setting;
+    unsigned int i;                                              // Probe counter
+    unsigned int slot = user_index_hash(number) % USER_INDEX_SIZE; // Slot where search starts
 
-    File settings_file = SD.open(SETTINGS_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!settings_file) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
+    for (i = 0; i < USER_INDEX_SIZE && user_index[slot] != USER_INDEX_EMPTY; i++) {
+        if (user_index[slot] != USER_INDEX_DELETED && (user_index[slot] & USER_INDEX_POS_MASK) == position + 1) {
+            user_index[slot] = USER_INDEX_DELETED;
+            --user_index_count;
+            return;
+        }
+        slot = (slot + 1) % USER_INDEX_SIZE;
     }
-    settings_file.seek(0);
+}
 
-    for (i = 0; i < settings_file.size(); i += sizeof(setting)) {
-        settings_file.read((byte*)&setting, sizeof(setting));
+long storage_class::user_index_find(File &user_file, const char number[], user_record &user) {
+    unsigned int i;                                     // Probe counter
+    uint16_t hash = user_index_hash(number);            // Hash of the number
+    unsigned int slot = hash % USER_INDEX_SIZE;         // Slot where search starts
 
-        if (setting.id == setting_id){
-            setting.int_value = setting_int;
-            settings_file.seek(i);
-            settings_file.write((byte*)&setting, sizeof(setting));
-            settings_file.close();
-            return;
+    for (i = 0; i < USER_INDEX_SIZE && user_index[slot] != USER_INDEX_EMPTY; i++) {
+        // Read record from SD card only if hash tag matches
+        if (user_index[slot] != USER_INDEX_DELETED && ((user_index[slot] ^ hash) & ~USER_INDEX_POS_MASK) == 0) {
+            long position = (long)(user_index[slot] & USER_INDEX_POS_MASK) - 1;
+
+            user_file.seek(position * sizeof(user_record));
+            user_file.read((byte*)&user, sizeof(user_record));
+
+            if (strcompare(number, user.number))
+                return position;
         }
+        slot = (slot + 1) % USER_INDEX_SIZE;
     }
-
-    settings_file.seek(settings_file.size());
-    setting.id = setting_id;
-    setting.int_value = setting_int;
-    settings_file.write((byte*)&setting, sizeof(setting));
-    settings_file.close();
+    return -1;
 }
 
 /********************************************************************
- * Functions for Logging                                            *
+ * Functions for users file compaction                              *
  ********************************************************************/
 
-void storage_class::log_this(int user_id, const char * log_string) {
-    if (system_control.test_error(ERROR_SD)) return;
+// There is no rename on SD card, so users which are not deleted are first copied to
+// USERS_NEW_FILE and USER_COMPACT_MARK record is added to its end, after that new file
+// is copied over users file and removed. If system is reset while users are copied
+// to new file it's discarded, if it's reset while new file is copied back copying
+// starts again on next boot.
 
-    struct log_record log;
-    File log_file = SD.open(LOG_FILE, (O_READ | O_WRITE | O_CREAT | O_APPEND));
-    if (!log_file) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
-    }
-    log.user_id = user_id;
-    strcopy(log_string, log.action, 4);
-    
-    RtcDateTime now = rtc.GetDateTime();
-    log.second = now.Second();
-    log.minute = now.Minute();
-    log.hour = now.Hour();
-    log.day = now.Day();
-    log.month = now.Month();
-    log.year = now.Year();
-
-    log_file.write((byte*)&log, sizeof(log));
-    log_file.close();
-}
+void storage_class::user_compact_step() {
+    unsigned int i;
+    user_record user;
 
-void storage_class::clear_log() {
     if (system_control.test_error(ERROR_SD)) return;
 
-    if (!SD.remove(LOG_FILE)) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
-    }
-    File log_file = SD.open(LOG_FILE, O_CREAT | O_WRITE);
-    if (!log_file) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
-    }
-    log_file.close();
-}
-
-unsigned long storage_class::get_log_count() {
-    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
-        return 0u;
+    switch (user_compact_state) {
+        case USER_COMPACT_IDLE: {
+            // Start only if enough of users file is wasted on tombstones
+            if (user_tombstones < USER_COMPACT_MIN) return;
+            open_file(user_file, USERS_FILE);
+            if (!user_file) return;
+            if ((unsigned long)user_tombstones * 100 < user_file.size() / sizeof(user_record) * USER_COMPACT_RATIO)
+                return;
+
+            user_new_file = SD.open(USERS_NEW_FILE, (O_READ | O_WRITE | O_CREAT | O_TRUNC));
+            ++sd_opens;
+            if (!user_new_file) {
+                system_control.set_error(ERROR_SD_WRITE);
+                return;
+            }
+            user_compact_pos = 0;
+            user_compact_state = USER_COMPACT_COPY;
+            break;
+        }
+        case USER_COMPACT_COPY:
+            // Copy one slice of users which are not deleted
+            user_file.seek(user_compact_pos * sizeof(user_record));
+            for (i = 0; i < USER_COMPACT_SLICE && user_compact_pos * sizeof(user_record) < user_file.size(); i++) {
+                user_file.read((byte*)&user, sizeof(user_record));
+                if (user.id != USER_DELETED)
+                    user_new_file.write((byte*)&user, sizeof(user_record));
+                ++user_compact_pos;
+            }
+            if (user_compact_pos * sizeof(user_record) < user_file.size())
+                break;
 
-    unsigned long file_size;
-    File log_file = SD.open(LOG_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!log_file) {
-        system_control.set_error(ERROR_SD_READ);
-        return 0u;
-    }
-    file_size = log_file.size();
-    log_file.close();
+            // Mark new file as complete, from now on it replaces users file
+            user = user_record {USER_COMPACT_MARK, 0, ""};
+            user_new_file.write((byte*)&user, sizeof(user_record));
+            sync_file(user_new_file);
+            if (!user_new_file) {
+                user_compact_state = USER_COMPACT_IDLE;
+                return;
+            }
 
-    return file_size / sizeof(log_record);
-}
+            // Truncate users file so new file can be copied over it
+            user_file.close();
+            user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT | O_TRUNC));
+            ++sd_opens;
+            if (!user_file) {
+                system_control.set_error(ERROR_SD_WRITE);
+                return;
+            }
+            user_compact_pos = 0;
+            user_compact_state = USER_COMPACT_REPLACE;
+            break;
+        case USER_COMPACT_REPLACE:
+            // Copy one slice of new file, mark at the end is not copied
+            user_new_file.seek(user_compact_pos * sizeof(user_record));
+            user_file.seek(user_compact_pos * sizeof(user_record));
+            for (i = 0; i < USER_COMPACT_SLICE && (user_compact_pos + 1) * sizeof(user_record) < user_new_file.size(); i++) {
+                user_new_file.read((byte*)&user, sizeof(user_record));
+                user_file.write((byte*)&user, sizeof(user_record));
+                ++user_compact_pos;
+            }
+            if ((user_compact_pos + 1) * sizeof(user_record) < user_new_file.size())
+                break;
 
-unsigned long storage_class::get_log_count(uint8_t day, uint8_t month, uint16_t year) {
-    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
-        return 0u;
+            sync_file(user_file);
+            if (!user_file) return;
 
-    int counter = 0;
-    unsigned long i;
-    struct log_record log;
-    File log_file = SD.open(LOG_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!log_file) {
-        system_control.set_error(ERROR_SD_READ);
-        return 0u;
+            user_new_file.close();
+            if (!SD.remove(USERS_NEW_FILE)) {
+                system_control.set_error(ERROR_SD_WRITE);
+            }
+            user_compact_state = USER_COMPACT_IDLE;
+            // Positions of users changed so index has to be built again
+            user_index_build();
+            break;
     }
-    log_file.seek(0);
+}
 
-    for (i = 0; i < log_file.size(); i += sizeof(log_record)) {
-        log_file.read((byte*)&log, sizeof(log_record));
+void storage_class::user_compact_finish() {
+    while (user_compact_state == USER_COMPACT_REPLACE && !system_control.test_error(ERROR_SD)) {
+        user_compact_step();
+    }
+}
 
-        if (log.day == day && log.month == month && log.year == year) {
-            ++counter;
+void storage_class::user_compact_abort() {
+    // Users file is not changed until new file is complete, so it's safe to drop it
+    if (user_compact_state == USER_COMPACT_COPY) {
+        user_new_file.close();
+        if (!SD.remove(USERS_NEW_FILE)) {
+            system_control.set_error(ERROR_SD_WRITE);
         }
+        user_compact_state = USER_COMPACT_IDLE;
     }
-    log_file.close();
-    return counter;
+    user_compact_finish();
 }
 
-struct log_record storage_class::get_log(unsigned long position) {
-    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
-        return log_record {0, "", 0, 0, 0, 0, 0, 0};
+void storage_class::user_compact_recover() {
+    user_record user;
 
-    log_record log = {
-        0, "", 0, 0, 0, 0, 0, 0
-    };
+    if (!SD.exists(USERS_NEW_FILE)) return;
 
-    File log_file = SD.open(LOG_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!log_file) {
+    user_new_file = SD.open(USERS_NEW_FILE, (O_READ | O_WRITE));
+    ++sd_opens;
+    if (!user_new_file) {
         system_control.set_error(ERROR_SD_READ);
-        return log;
+        return;
     }
-
-    if (log_file.size() == 0) {
-        log_file.close();
-        return log;
+    // Read last record of new file
+    user.id = USER_DELETED;
+    if (user_new_file.size() >= sizeof(user_record)) {
+        user_new_file.seek(user_new_file.size() - sizeof(user_record));
+        user_new_file.read((byte*)&user, sizeof(user_record));
     }
-    log_file.seek(
-        log_file.size() - sizeof(log_record) - (sizeof(log_record) * position)
-    );
-
-    log_file.read((byte*)&log, sizeof(log_record));
-    log_file.close();
-    return log;
-}
 
-struct log_record storage_class::get_log(unsigned long position, uint8_t day, uint8_t month, uint16_t year) {
-    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
-        return log_record {0, "", 0, 0, 0, 0, 0, 0};
-    
-    unsigned long i;
-    log_record log;
-    File log_file = SD.open(LOG_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!log_file) {
-        system_control.set_error(ERROR_SD_READ);
-        return log_record {0, "", 0, 0, 0, 0, 0, 0};
+    // If new file is not complete users file was not changed yet
+    if (user.id != USER_COMPACT_MARK) {
+        user_compact_state = USER_COMPACT_COPY;
+        user_compact_abort();
+        return;
     }
 
-    for (i = log_file.size() - sizeof(log_record); i >= 0; i -= sizeof(log_record)) {
-        log_file.seek(i);
-        log_file.read((byte*)&log, sizeof(log_record));
-
-        if (log.day == day && log.month == month && log.year == year) {
-            log_file.seek(i - sizeof(log_record) * position);
-            log_file.read((byte*)&log, sizeof(log_record));
-            log_file.close();
-            return log;
-        }
+    // Copy new file over users file again
+    user_file.close();
+    user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT | O_TRUNC));
+    ++sd_opens;
+    if (!user_file) {
+        system_control.set_error(ERROR_SD_WRITE);
+        return;
     }
-
-    log_record no_log = {
-        0, "", 0, 0, 0, 0, 0, 0
-    };
-    log_file.close();
-    return no_log;
+    user_compact_pos = 0;
+    user_compact_state = USER_COMPACT_REPLACE;
+    user_compact_finish();
 }
 
 /********************************************************************
@@ -330,16 +1465,16 @@ struct log_record storage_class::get_log(unsigned long position, uint8_t day, ui
 
 int storage_class::add_user(const char number[]) {
     if (system_control.test_error(ERROR_SD)) return 0;
+    user_compact_abort();
 
     // Create variables
-    File user_file;       // File variable
     user_record user;     // Record for new user
     unsigned long i;      // Counter to count bytes while reading file
 
     // Get id for new user from settings file
     user.id = get_setting(SETTING_NEXT_USER_ID).int_value;
     // Open users file
-    user_file = SD.open(USERS_FILE, (O_READ | O_CREAT | O_WRITE));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return 0;
@@ -352,41 +1487,53 @@ int storage_class::add_user(const char number[]) {
     if (user_file.size() < sizeof(user_record)) {
         user_file.seek(0);
         user_file.write((byte*)&user, sizeof(user_record));
+        user_index_insert(user.number, 0);
         set_setting(SETTING_NEXT_USER_ID, user.id + 1);
     } else {
-        int done_flag = 0;         // Indicator if new user already exist
+        long position = -1;        // Position of user with same number, -1 if there is none
         user_record search_user;   // Used to read users while searching
-        // Start from file beggining
-        user_file.seek(0);
 
-        for (i = 0; i < user_file.size(); i += sizeof(user_record)) {
-            user_file.read((byte*)&search_user, sizeof(user_record));
+        // Use index if it's available, else search whole file
+        if (user_index_ready) {
+            position = user_index_find(user_file, number, search_user);
+        } else {
+            // Start from file beggining
+            user_file.seek(0);
 
-            if (strcompare(number, search_user.number)) {
-                user.id = search_user.id;
-                user_file.seek(i);
-                user_file.write((byte*)&user, sizeof(user_record));
-                done_flag = 1;
-                break;
+            for (i = 0; i < user_file.size(); i += sizeof(user_record)) {
+                user_file.read((byte*)&search_user, sizeof(user_record));
+
+                if (search_user.id != USER_DELETED && strcompare(number, search_user.number)) {
+                    position = i / sizeof(user_record);
+                    break;
+                }
             }
         }
 
-        if (!done_flag) {
+        if (position != -1) {
+            user.id = search_user.id;
+            user_file.seek(position * sizeof(user_record));
             user_file.write((byte*)&user, sizeof(user_record));
+        } else {
+            position = user_file.size() / sizeof(user_record);
+            user_file.seek(user_file.size());
+            user_file.write((byte*)&user, sizeof(user_record));
+            user_index_insert(user.number, position);
             set_setting(SETTING_NEXT_USER_ID, user.id + 1);
         }
     }
 
-    user_file.close();
+    sync_file(user_file);
     return user.id;
 }
 
 void storage_class::edit_user(const int id, const char number[]) {
     if (system_control.test_error(ERROR_SD)) return;
+    user_compact_abort();
 
     unsigned long i;
     user_record user;
-    File user_file = SD.open(USERS_FILE, (O_READ | O_CREAT | O_WRITE));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
@@ -397,22 +1544,25 @@ void storage_class::edit_user(const int id, const char number[]) {
         user_file.read((byte*)&user, sizeof(user_record));
 
         if (user.id == id) {
+            user_index_remove(user.number, i / sizeof(user_record));
             user_file.seek(i);
             strcopy(number, user.number, 16);
             user_file.write((byte*)&user, sizeof(user_record));
+            user_index_insert(user.number, i / sizeof(user_record));
             break;
         }
     }
 
-    user_file.close();
+    sync_file(user_file);
 }
 
 void storage_class::dis_user(const int id) {
     if (system_control.test_error(ERROR_SD)) return;
+    user_compact_abort();
 
     unsigned long i;
     user_record user;
-    File user_file = SD.open(USERS_FILE, (O_READ | O_CREAT | O_WRITE));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
@@ -430,15 +1580,16 @@ void storage_class::dis_user(const int id) {
         }
     }
 
-    user_file.close();
+    sync_file(user_file);
 }
 
 void storage_class::enb_user(const int id) {
     if (system_control.test_error(ERROR_SD)) return;
+    user_compact_abort();
 
     unsigned long i;
     user_record user;
-    File user_file = SD.open(USERS_FILE, (O_READ | O_CREAT | O_WRITE));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
@@ -456,48 +1607,55 @@ void storage_class::enb_user(const int id) {
         }
     }
 
-    user_file.close();
+    sync_file(user_file);
 }
 
 int storage_class::get_user_count() {
     if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
         return 0;
+    user_compact_finish();
 
     unsigned long size;
-    File user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_READ);
         return 0;
     }
 
     size = user_file.size();
-    user_file.close();
 
-    return size / sizeof(user_record);
+    // Deleted users are not counted
+    return size / sizeof(user_record) - user_tombstones;
 }
 
 void storage_class::clear_user_file() {
     if (system_control.test_error(ERROR_SD)) return;
+    user_compact_abort();
 
+    // File can't be removed while it's open
+    user_file.close();
     if (!SD.remove(USERS_FILE)) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
     }
-    File user_file = SD.open(USERS_FILE, O_CREAT | O_WRITE);
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
     }
-    user_file.close();
+    sync_file(user_file);
+    // Users file is empty so index should be empty too
+    user_index_build();
 }
 
 struct user_record storage_class::get_user_by_id(const int id) {
     if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
         return user_record {USER_DELETED, 0, "OBRISAN"};
+    user_compact_finish();
     
     unsigned long i;
     user_record user;
-    File user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_READ);
         return user_record {USER_DELETED, 0, "OBRISAN"};
@@ -507,45 +1665,41 @@ struct user_record storage_class::get_user_by_id(const int id) {
     for (i = 0; i < user_file.size(); i += sizeof(user_record)) {
         user_file.read((byte*)&user, sizeof(user_record));
 
-        if (user.id == id) {
-            user_file.close();
+        if (user.id == id && user.id != USER_DELETED) {
             return user;
         }
     }
 
-    user_file.close();
-
-    switch (id) {
-        case USER_PANEL:
-            return user_record {USER_PANEL, 1, "PANEL"};
-        case USER_SERIAL:
-            return user_record {USER_SERIAL, 1, "KONZOLA"};
-        case USER_LAST_RESEVED:
-            return user_record {USER_LAST_RESEVED, 0, "RESERVED"};
-        default:
-            return user_record {USER_DELETED, 0, "OBRISAN"};
-    }
+    return reserved_user(id);
 }
 
 struct user_record storage_class::get_user_by_num(const char number[]) {
     if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
         return user_record {0, 0, "OBRISAN"};
+    user_compact_finish();
 
     unsigned long i;
     user_record user;
-    File user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_READ);
         return user_record {USER_DELETED, 0, "OBRISAN"};
     }
-    
+
+    // If index is available at most one record has to be read
+    if (user_index_ready) {
+        if (user_index_find(user_file, number, user) != -1) {
+            return user;
+        }
+        return user_record {0, 0, "DELETED"};
+    }
+
     user_file.seek(0);
 
     for (i = 0; i < user_file.size(); i += sizeof(user_record)) {
         user_file.read((byte*)&user, sizeof(user_record));
 
-        if (strcompare(number, user.number)) {
-            user_file.close();
+        if (user.id != USER_DELETED && strcompare(number, user.number)) {
             return user;
         }
     }
@@ -553,15 +1707,15 @@ struct user_record storage_class::get_user_by_num(const char number[]) {
     user_record no_user = {
         0, 0, "DELETED"
     };
-    user_file.close();
     return no_user;
 }
 
 struct user_record storage_class::get_user_by_pos(const int position) {
     if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
         return user_record {0, 0, "OBRISAN"};
+    user_compact_finish();
 
-    File user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_READ);
         return user_record {USER_DELETED, 0, "OBRISAN"};
@@ -570,72 +1724,222 @@ struct user_record storage_class::get_user_by_pos(const int position) {
         0, 0, "DELETED"
     };
 
-    if (position * sizeof(user_record) < user_file.size()) {
-        user_file.seek(position * sizeof(user_record));
+    // If there are no tombstones position in the file is same as position of user
+    if (user_tombstones == 0) {
+        if (position * sizeof(user_record) < user_file.size()) {
+            user_file.seek(position * sizeof(user_record));
+            user_file.read((byte*)&user, sizeof(user_record));
+        }
+        return user;
+    }
+
+    int logical = 0;    // Position of user, tombstones are not counted
+    int physical = 0;   // Position in users file
+
+    // Users are usually read one after another, so search can continue from last user found
+    if (user_pos_logical >= 0 && user_pos_logical <= position) {
+        logical = user_pos_logical;
+        physical = user_pos_physical;
+    }
+    user_file.seek(physical * sizeof(user_record));
+
+    for (; physical * sizeof(user_record) < user_file.size(); physical++) {
         user_file.read((byte*)&user, sizeof(user_record));
+
+        if (user.id == USER_DELETED)
+            continue;
+        if (logical == position) {
+            user_pos_logical = logical;
+            user_pos_physical = physical;
+            return user;
+        }
+        ++logical;
     }
 
-    user_file.close();
-    return user;
+    return user_record {0, 0, "DELETED"};
 }
 
 void storage_class::delete_user(int id) {
     if (system_control.test_error(ERROR_SD)) return;
+    user_compact_abort();
 
-    File user_file, temp_file;
     unsigned long i;
     user_record user;
 
-    user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT));
+    open_file(user_file, USERS_FILE);
     if (!user_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
     }
-    temp_file = SD.open("TEMP.BIN", (O_READ | O_WRITE | O_CREAT));
-    if (!temp_file) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
-    }
     user_file.seek(0);
-    temp_file.seek(0);
 
     for (i = 0; i < user_file.size(); i += sizeof(user_record)) {
         user_file.read((byte*)&user, sizeof(user_record));
 
-        if (user.id != id) {
-            temp_file.write((byte*)&user, sizeof(user_record));
+        if (user.id == id && user.id != USER_DELETED) {
+            user_index_remove(user.number, i / sizeof(user_record));
+            // Overwrite user with tombstone, it's removed from file by compaction
+            user = user_record {USER_DELETED, 0, ""};
+            user_file.seek(i);
+            user_file.write((byte*)&user, sizeof(user_record));
+            sync_file(user_file);
+
+            ++user_tombstones;
+            user_pos_logical = -1;
+            return;
         }
     }
+}
 
-    user_file.close();
-    temp_file.close();
+/********************************************************************
+ * Functions for SMS spool                                          *
+ ********************************************************************/
 
-    if (!SD.remove(USERS_FILE)) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
-    }
+// Value of magic field in SMS spool header
+const char SMS_SPOOL_MAGIC[4] = {'D', 'V', 'D', 'S'};
+
+// Read SMS spool header from open spool file
+// Returns: 1 if header is valid, or 0 if file is new or damaged
+static int sms_spool_read_header(File &spool_file, sms_spool_header &header) {
+    spool_file.seek(0);
+    return spool_file.size() >= sizeof(sms_spool_header) &&
+        spool_file.read((byte*)&header, sizeof(sms_spool_header)) == sizeof(sms_spool_header) &&
+        header.magic[0] == SMS_SPOOL_MAGIC[0] && header.magic[1] == SMS_SPOOL_MAGIC[1] &&
+        header.magic[2] == SMS_SPOOL_MAGIC[2] && header.magic[3] == SMS_SPOOL_MAGIC[3];
+}
 
-    user_file = SD.open(USERS_FILE, (O_READ | O_WRITE | O_CREAT));
-    if (!user_file) {
+void storage_class::spool_sms(sms_spool_record &record) {
+    if (system_control.test_error(ERROR_SD)) return;
+
+    sms_spool_header header;    // Header of spool file
+    File spool_file;            // Spool file, it's opened only while message is stored
+    int i;                      // Index counter
+
+    spool_file = SD.open(SMS_SPOOL_FILE, (O_READ | O_WRITE | O_CREAT));
+    ++sd_opens;
+    if (!spool_file) {
         system_control.set_error(ERROR_SD_WRITE);
         return;
     }
-    temp_file = SD.open("TEMP.BIN", (O_READ | O_WRITE | O_CREAT));
-    if (!temp_file) {
+    // New or damaged spool file is started from the beginning
+    if (!sms_spool_read_header(spool_file, header)) {
+        for (i = 0; i < 4; i++)
+            header.magic[i] = SMS_SPOOL_MAGIC[i];
+        header.total = 0;
+    }
+
+    record.time = now().TotalSeconds();
+    spool_file.seek(sizeof(sms_spool_header) + (header.total % SMS_SPOOL_CAPACITY) * sizeof(sms_spool_record));
+    spool_file.write((byte*)&record, sizeof(sms_spool_record));
+    ++header.total;
+    spool_file.seek(0);
+    spool_file.write((byte*)&header, sizeof(sms_spool_header));
+
+    if (spool_file.getWriteError())
         system_control.set_error(ERROR_SD_WRITE);
-        return;
+    spool_file.close();
+}
+
+unsigned long storage_class::get_sms_spool_count() {
+    if (system_control.test_error(ERROR_SD)) return 0;
+
+    sms_spool_header header;    // Header of spool file
+    File spool_file;            // Spool file, it's opened only while header is read
+
+    spool_file = SD.open(SMS_SPOOL_FILE, O_READ);
+    ++sd_opens;
+    if (!spool_file)
+        return 0;
+    if (!sms_spool_read_header(spool_file, header))
+        header.total = 0;
+    spool_file.close();
+    return header.total;
+}
+
+/********************************************************************
+ * Functions for data export                                        *
+ ********************************************************************/
+
+unsigned long storage_class::dump_count(dump_kinds kind) {
+    switch (kind) {
+        case DUMP_LOGS:
+            // Dump should contain everything logged until now
+            log_flush();
+            return log_info.count;
+        case DUMP_USERS:
+            user_compact_finish();
+            open_file(user_file, USERS_FILE);
+            return user_file ? user_file.size() / sizeof(user_record) : 0;
+        case DUMP_SETTINGS:
+            return SETTING_COUNT;
     }
+    return 0;
+}
 
-    for (i = 0; i < temp_file.size(); i += sizeof(user_record)) {
-        temp_file.read((byte*)&user, sizeof(user_record));
-        user_file.write((byte*)&user, sizeof(user_record));
+unsigned long storage_class::dump_first(dump_kinds kind) {
+    // Sequence number of the oldest record in log file
+    if (kind == DUMP_LOGS)
+        return log_days_info.total - log_info.count;
+    return 0;
+}
+
+uint8_t storage_class::dump_record_size(dump_kinds kind) {
+    switch (kind) {
+        case DUMP_LOGS:
+            return log_info.record_size;
+        case DUMP_USERS:
+            return sizeof(user_record);
+        case DUMP_SETTINGS:
+            return sizeof(setting_record);
     }
-    
-    user_file.close();
-    temp_file.close();
+    return 0;
+}
 
-    if (!SD.remove("TEMP.BIN")) {
-        system_control.set_error(ERROR_SD_WRITE);
-        return;
+unsigned int storage_class::dump_read(dump_kinds kind, unsigned long position, unsigned int count, byte buffer[]) {
+    if (system_control.test_error(ERROR_SD_INIT | ERROR_SD_READ | ERROR_SD_UNKNOWN))
+        return 0;
+
+    unsigned int i;
+
+    switch (kind) {
+        case DUMP_LOGS: {
+            // Skip records which are not logged yet or are already overwritten
+            if (position >= log_days_info.total || log_days_info.total - position > log_info.count)
+                return 0;
+            open_file(log_file, LOG_FILE);
+            if (!log_file) {
+                system_control.set_error(ERROR_SD_READ);
+                return 0;
+            }
+            // Records are read until the end of ring, rest is read on next call
+            unsigned long slot = (log_info.head + log_info.capacity - (log_days_info.total - position) % log_info.capacity) % log_info.capacity;
+            count = min((unsigned long)count, min(log_days_info.total - position, log_info.capacity - slot));
+
+            log_file.seek(sizeof(log_header) + slot * log_info.record_size);
+            log_file.read(buffer, count * log_info.record_size);
+            return count;
+        }
+        case DUMP_USERS:
+            user_compact_finish();
+            open_file(user_file, USERS_FILE);
+            if (!user_file) {
+                system_control.set_error(ERROR_SD_READ);
+                return 0;
+            }
+            if (position >= user_file.size() / sizeof(user_record))
+                return 0;
+            count = min((unsigned long)count, user_file.size() / sizeof(user_record) - position);
+
+            user_file.seek(position * sizeof(user_record));
+            user_file.read(buffer, count * sizeof(user_record));
+            return count;
+        case DUMP_SETTINGS:
+            for (i = 0; i < count && position + i < SETTING_COUNT; i++) {
+                setting_record setting = get_setting((setting_ids)(position + i));
+                setting.id = (setting_ids)(position + i);
+                memcpy(buffer + i * sizeof(setting_record), &setting, sizeof(setting_record));
+            }
+            return i;
     }
+    return 0;
 }
@@ -5,6 +5,8 @@
 #include "panel.hpp"
 #include "storage.hpp"
 #include "relays.hpp"
+#include "modem.hpp"
+#include "registry.hpp"
 
 // Create system control variable
 system_class system_control;
@@ -20,7 +22,7 @@ commands::commands() {
 
 void commands::init() {
     // Start serial
-    Serial.begin(9600);
+    Serial.begin(CONSOLE_BAUD);
     // Print Welcome message on startup
     Serial.print("\r\n-------------------------------------------------");
     Serial.print("\r\n>> DVDCS Admin console <<\r\n");
@@ -74,11 +76,672 @@ char * commands::get() {
     return buffer;
 }
 
+/********************************************************************
+ * Commands which can be run from console                           *
+ ********************************************************************/
+
+// Command echo <text> -- print stuff back to console
+static void console_echo(const command_call &call) {
+    Serial.print(F("echo: "));
+    Serial.println(call.args);
+}
+
+// Command help -- print list of commands
+static void console_help(const command_call &call) {
+    Serial.println(F("-------------------------------------------------"));
+    Serial.print(F("   DVD Control System -- Ver "));
+    Serial.println(F(FIRMWARE_VERSION));
+    Serial.println(F("-------------------------------------------------"));
+    Serial.println();
+    Serial.println(F("help                         -- Print this help message"));
+    Serial.println(F("echo <text>                  -- Print text back to console (useless)"));
+    Serial.println(F("motd                         -- Print current Message Of The Day"));
+    Serial.println(F("setmotd <text>               -- Set custom motd to be displayed on home screen"));
+    Serial.println(F("clearmotd                    -- Remove custom motd if it's set"));
+    Serial.println(F("dispass                      -- Disable password autentification for everything"));
+    Serial.println(F("settings                     -- List values of all system settings"));
+    Serial.println(F("cache                        -- Show settings cache, log flush and SD file counters"));
+    Serial.println(F("users                        -- List all SMS users"));
+    Serial.println(F("errors                       -- Show values of all error flags"));
+    Serial.println(F("log <number>                 -- Print specified number of log records"));
+    Serial.println(F("log DD-MM-YYYY [number]      -- Print log records for given date"));
+    Serial.println(F("dump <logs|users|settings>   -- Send records in binary frames, baud can follow"));
+    Serial.println(F("clearusers                   -- Permanently delete all users from users file"));
+    Serial.println(F("clearlog                     -- Permanently delete all log records from log file"));
+    Serial.println(F("unseterrors                  -- Unset all error flags (DON'T DO THIS)"));
+    Serial.println(F("date                         -- Display current date and time"));
+    Serial.println(F("clock                        -- Show software clock drift and loop frequency"));
+    Serial.println(F("rtcsync <seconds>            -- Set how often software clock is synced with RTC"));
+    Serial.println(F("modem                        -- Show SMS submit counters and latency (ms)"));
+    Serial.println(F("smsmode <push|inbox>         -- Set if SMS are pushed by modem or read from SIM inbox"));
+    Serial.println(F("smslimit <burst> <s> <s>     -- Set SMS commands per sender, refill and duplicate window"));
+    Serial.println(F("setdate DD-MM-YYYY hh-mm-ss  -- Set new date and time"));
+    Serial.println(F("sensors                      -- Read state of all sensors"));
+    Serial.println();
+}
+
+// Command errors -- print error flags
+static void console_errors(const command_call &call) {
+    Serial.print(F("Error -- MODEM TURN ON     -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_TURN_ON));
+    Serial.print(F("Error -- MODEM TIMEOUT     -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_TIMEOUT));
+    Serial.print(F("Error -- MODEM SIM         -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_SIM));
+    Serial.print(F("Error -- MODEM SIGNAL      -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_SIGNAL));
+    Serial.print(F("Error -- MODEM REGISTER    -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_REGISTER));
+    Serial.print(F("Error -- MODEM SMS SEND    -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_SMS_SEND));
+    Serial.print(F("Error -- MODEM UNKNOWN     -- "));
+    Serial.println(system_control.test_error(ERROR_MODEM_UNKNOWN));
+    Serial.print(F("Error -- SD INIT           -- "));
+    Serial.println(system_control.test_error(ERROR_SD_INIT));
+    Serial.print(F("Error -- SD READ           -- "));
+    Serial.println(system_control.test_error(ERROR_SD_READ));
+    Serial.print(F("Error -- SD WRITE          -- "));
+    Serial.println(system_control.test_error(ERROR_SD_WRITE));
+    Serial.print(F("Error -- SD UNKNOWN        -- "));
+    Serial.println(system_control.test_error(ERROR_SD_UNKNOWN));
+    Serial.print(F("Error -- RTC CONFIDENCE    -- "));
+    Serial.println(system_control.test_error(ERROR_RTC_CONFIDENCE));
+    Serial.print(F("Error -- RTC UNKNOWN       -- "));
+    Serial.println(system_control.test_error(ERROR_RTC_UNKNOWN));
+    Serial.print(F("Error -- LIGHT UNKNOWN     -- "));
+    Serial.println(system_control.test_error(ERROR_LIGHT_UNKNOWN));
+}
+
+// Command settings -- print values of each setting
+static void console_settings(const command_call &call) {
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        setting_record setting;
+
+        Serial.print(F("Setting -- PASSWORD (PIN)     -- "));
+        setting = storage.get_setting(SETTING_PASSWORD);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- SIRENE AUTH        -- "));
+        setting = storage.get_setting(SETTING_SIRENE_AUTH);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- SETTINGS AUTH      -- "));
+        setting = storage.get_setting(SETTING_SETTINGS_AUTH);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- MOTD               -- "));
+        setting = storage.get_setting(SETTING_MOTD);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- NEXT USER ID       -- "));
+        setting = storage.get_setting(SETTING_NEXT_USER_ID);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+        
+        Serial.print(F("Setting -- LAST LIGHT STATE   -- "));
+        setting = storage.get_setting(SETTING_LAST_LIGHT_STATE);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- RTC SYNC INTERVAL  -- "));
+        setting = storage.get_setting(SETTING_RTC_SYNC_INTERVAL);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- SMS INBOX          -- "));
+        setting = storage.get_setting(SETTING_SMS_INBOX);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- SMS RATE BURST    -- "));
+        setting = storage.get_setting(SETTING_SMS_RATE_BURST);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- SMS RATE INTERVAL -- "));
+        setting = storage.get_setting(SETTING_SMS_RATE_INTERVAL);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+
+        Serial.print(F("Setting -- SMS DUP WINDOW    -- "));
+        setting = storage.get_setting(SETTING_SMS_DUP_WINDOW);
+        Serial.print(setting.int_value);
+        Serial.print(F(", \""));
+        Serial.print(setting.string_value);
+        Serial.println(F("\""));
+    }
+}
+
+// Command cache -- print settings cache counters
+static void console_cache(const command_call &call) {
+    Serial.print(F("Cache -- SETTINGS HITS     -- "));
+    Serial.println(storage.get_settings_cache_hits());
+    Serial.print(F("Cache -- SETTINGS MISSES   -- "));
+    Serial.println(storage.get_settings_cache_misses());
+    Serial.print(F("Cache -- LOG FLUSHES       -- "));
+    Serial.println(storage.get_log_flushes());
+    Serial.print(F("Cache -- LOG RECORDS       -- "));
+    Serial.println(storage.get_log_flushed_records());
+    Serial.print(F("Cache -- RECORDS PER FLUSH -- "));
+    if (storage.get_log_flushes() > 0)
+        Serial.println((float)storage.get_log_flushed_records() / storage.get_log_flushes());
+    else
+        Serial.println(0);
+    Serial.print(F("Cache -- SD FILE OPENS     -- "));
+    Serial.println(storage.get_sd_opens());
+    Serial.print(F("Cache -- SD FILE SYNCS     -- "));
+    Serial.println(storage.get_sd_syncs());
+}
+
+// Command dump logs|users|settings [baud] -- send records in binary frames
+static void console_dump(const command_call &call) {
+    char kind_name[10];                 // Name of data to dump
+    unsigned long baud = DUMP_BAUD;     // Baud rate used for dump
+    int kind = -1;                      // Kind of data to dump
+
+    if (sscanf(call.args, "%9s %lu", kind_name, &baud) >= 1) {
+        if (strcompare(kind_name, "logs"))
+            kind = DUMP_LOGS;
+        else if (strcompare(kind_name, "users"))
+            kind = DUMP_USERS;
+        else if (strcompare(kind_name, "settings"))
+            kind = DUMP_SETTINGS;
+    }
+
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else if (kind == -1 || (baud != 9600 && baud != 19200 && baud != 38400 && baud != 57600 && baud != 115200)) {
+        Serial.println(F("dump: Syntax of command is dump logs|users|settings [9600|19200|38400|57600|115200]"));
+    } else {
+        system_control.dump_begin(kind, baud);
+    }
+}
+
+// Command users -- print list of users
+static void console_users(const command_call &call) {
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        int user_count = storage.get_user_count();
+
+        if (user_count == 0) {
+            Serial.println(F("users: No users found in users file"));
+        } else {
+            int i;
+
+            Serial.print(F("Number of user records: "));
+            Serial.println(user_count);
+            Serial.println();
+
+            for (i = 0; i < user_count; i++) {
+                user_record user = storage.get_user_by_pos(i);
+
+                Serial.print(F("User -- "));
+                Serial.print(
+                    (user.active) ? F("Enabled  -- ") : F("Disabled -- ")
+                );
+                Serial.print(F("Number +"));
+                Serial.print(user.number);
+                Serial.print(F(" -- ID "));
+                Serial.println(user.id);
+            }
+        }
+    }
+}
+
+// Command motd -- print current motd
+static void console_motd(const command_call &call) {
+    Serial.println(F("-------------------------------------------------"));
+    Serial.print(F("   MOTD: "));
+    Serial.println(main_panel.get_motd());
+    Serial.println(F("-------------------------------------------------"));
+}
+
+// Command setmotd <text> -- set custom motd
+static void console_setmotd(const command_call &call) {
+    if (call.args[0] == '\0') {
+        Serial.println(F("setmotd: Syntax of command is setmotd <text>"));
+    } else if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        if (strlength(call.args) > 20) {
+            Serial.println(F("setmotd: Max length of motd is 20 ASCII characters"));
+        } else {
+            storage.set_setting(SETTING_MOTD, call.args);
+            main_panel.set_motd(1, call.args);
+            Serial.print(F("setmotd: Motd is set to \""));
+            Serial.print(call.args);
+            Serial.println(F("\""));
+        }
+    }
+}
+
+// Command clearmotd -- remove custom motd
+static void console_clearmotd(const command_call &call) {
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        storage.set_setting(SETTING_MOTD, "");
+        main_panel.clear_motd(1);
+        Serial.println(F("clearmotd: Custom motd is cleared, default motd will be displayed instead"));
+    }
+}
+
+// Command dispass -- Disable password for settings and sirens, so they can be accessed without one
+static void console_dispass(const command_call &call) {
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        storage.set_setting(SETTING_SIRENE_AUTH, FALSE);
+        storage.set_setting(SETTING_SETTINGS_AUTH, FALSE);
+        Serial.println(F("dispass: Authetication is disabled, you now have access to all features of DVDCS without PIN"));
+    }
+}
+
+// Command unseterrors -- Unset all error system flags
+static void console_unseterrors(const command_call &call) {
+    system_control.unset_error(ERROR);
+    Serial.println(F("unseterrors: All error flags are now set to 0, I hope you know what you're doing"));
+}
+
+// Command clearusers -- clear users file
+static void console_clearusers(const command_call &call) {
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        storage.clear_user_file();
+        Serial.println(F("clearusers: Users file has been cleared, you might also want clear log file since it's mostly useless now"));
+    }
+}
+
+// Command clearlog -- clear log file
+static void console_clearlog(const command_call &call) {
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else {
+        storage.clear_log();
+        Serial.println(F("clearlog: Log file has been cleared"));
+    }
+}
+
+// Command log <number> or log DD-MM-YYYY [number] -- display logs
+static void console_log(const command_call &call) {
+    if (call.args[0] == '\0') {
+        Serial.println(F("log: Syntax of command is log <number>"));
+    }
+    // Command log DD-MM-YYYY [number] -- display logs for given date
+    else if (strlength(call.args) >= 10 && call.args[2] == '-') {
+        if (system_control.test_error(ERROR_SD)) {
+            Serial.println(F("DVDCS: SD card error"));
+        } else {
+            uint8_t day, mon;                                       // Requested date
+            uint16_t year;
+            unsigned long num;                                      // Number of records to print
+            int args = sscanf(call.args, "%02hhu-%02hhu-%04hu %lu", &day, &mon, &year, &num);
+            // If command is correctly formated
+            if (args == 3 || args == 4) {
+                unsigned long log_count = storage.get_log_count(day, mon, year);  // Get log count for date
+                unsigned long current;                                            // Current log
+                unsigned int i, count;                                            // Record on page and number of records on page
+                log_page_record records[LOG_PAGE_SIZE];                           // Page of log records
+                char log_formated[60];                                            // String with current log information to print to console
+                // If number of records is not given print all of them
+                if (args == 3)
+                    num = log_count;
+
+                for (current = 0; current < log_count && current < num; current += count) {
+                    count = storage.get_log_page(current, min((unsigned long)LOG_PAGE_SIZE, num - current), day, mon, year, records);
+                    if (count == 0) break;
+
+                    for (i = 0; i < count; i++) {
+                        log_record &logr = records[i].log;                      // Log record
+                        // Format log
+                        sprintf(
+                            log_formated, "Log -- %02u-%02u-%04u %02u:%02u:%02u -- %s -- %20s",
+                            logr.day, logr.month, logr.year, logr.hour, logr.minute, logr.second, logr.action, records[i].user.number
+                        );
+                        // Print formated log
+                        Serial.println(log_formated);
+                    }
+                }
+                // Print log count at the end
+                Serial.println();
+                Serial.print("Log records ");
+                // If requested number is greater than log count print log count
+                if (log_count < num)
+                    Serial.print(log_count);
+                else
+                    Serial.print(num);
+                Serial.print(" / ");
+                Serial.println(log_count);
+            } else {
+                Serial.println(F("log: Syntax of command is log DD-MM-YYYY [number]"));
+            }
+        }
+    }
+    // Command log <number> -- display specified number of logs
+    else {
+        if (system_control.test_error(ERROR_SD)) {
+            Serial.println(F("DVDCS: SD card error"));
+        } else {
+            unsigned long num;                                      // Number of records to print
+            // If command is correctly formated
+            if (sscanf(call.args, "%lu", &num) == 1) {
+                unsigned long log_count = storage.get_log_count();  // Get log count
+                unsigned long current;                              // Current log
+                unsigned int i, count;                              // Record on page and number of records on page
+                log_page_record records[LOG_PAGE_SIZE];             // Page of log records
+                char log_formated[60];                              // String with current log information to print to console
+
+                for (current = 0; current < log_count && current < num; current += count) {
+                    count = storage.get_log_page(current, min((unsigned long)LOG_PAGE_SIZE, num - current), records);
+                    if (count == 0) break;
+
+                    for (i = 0; i < count; i++) {
+                        log_record &logr = records[i].log;          // Log record
+                        // Format log
+                        sprintf(
+                            log_formated, "Log -- %02u-%02u-%04u %02u:%02u:%02u -- %s -- %20s",
+                            logr.day, logr.month, logr.year, logr.hour, logr.minute, logr.second, logr.action, records[i].user.number
+                        );
+                        // Print formated log
+                        Serial.println(log_formated);
+                    }
+                }
+                // Print log count at the end
+                Serial.println();
+                Serial.print("Log records ");
+                // If requested number is greater than log count print log count
+                if (log_count < num)
+                    Serial.print(log_count);
+                else
+                    Serial.print(num);
+                Serial.print(" / ");
+                Serial.println(log_count);
+            } else {
+                Serial.println(F("log: Syntax of command is log <number>"));
+            }
+        }
+    }
+}
+
+// Command setdate DD-MM-YYYY hh-mm-ss -- set time for RTC
+static void console_setdate(const command_call &call) {
+    uint8_t mon, day, hour, min, sec;
+    uint16_t year;
+    if (sscanf(call.args, "%02hhu-%02hhu-%04hu %02hhu:%02hhu:%02hhu", &day, &mon, &year, &hour, &min, &sec) == 6) {
+        RtcDateTime time_to_set(year, mon, day, hour, min, sec);
+        storage.set_time(time_to_set);
+
+        Serial.println(F("setdate: Task completed, new time is set"));
+    } else {
+        Serial.println(F("setdate: Syntax of command is setdate DD-MM-YYYY hh-mm-ss"));
+    }
+}
+
+// Command date -- display current time
+static void console_date(const command_call &call) {
+    if (system_control.test_error(ERROR_RTC)) {
+        Serial.println(F("date: RTC error accured, unable to read time"));
+    } else {
+        char time_formated[30];
+        RtcDateTime now = storage.now();
+
+        sprintf(
+            time_formated, "%02u-%02u-%04u %02u:%02u:%02u",
+            now.Day(), now.Month(), now.Year(), now.Hour(), now.Minute(), now.Second()
+        );
+
+        Serial.print(F("date: "));
+        Serial.println(time_formated);
+    }
+}
+
+// Command clock -- display software clock and loop counters
+static void console_clock(const command_call &call) {
+    Serial.print(F("Clock -- SYNC INTERVAL     -- "));
+    Serial.println(storage.get_clock_interval());
+    Serial.print(F("Clock -- LAST DRIFT        -- "));
+    Serial.println(storage.get_clock_drift());
+    Serial.print(F("Clock -- MAX DRIFT         -- "));
+    Serial.println(storage.get_clock_drift_max());
+    Serial.print(F("Clock -- RTC SYNCS         -- "));
+    Serial.println(storage.get_clock_syncs());
+    Serial.print(F("Clock -- RTC FAILURES      -- "));
+    Serial.println(storage.get_clock_failures());
+    Serial.print(F("Clock -- LOOP FREQUENCY    -- "));
+    Serial.println(system_control.get_loop_frequency());
+}
+
+// Command rtcsync <seconds> -- set interval of software clock syncs with RTC
+static void console_rtcsync(const command_call &call) {
+    int seconds;
+
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else if (sscanf(call.args, "%d", &seconds) == 1 && seconds >= 0) {
+        storage.set_clock_interval(seconds);
+        Serial.println(F("rtcsync: Task completed, new interval is set"));
+    } else {
+        Serial.println(F("rtcsync: Syntax of command is rtcsync <seconds>, 0 for default"));
+    }
+}
+
+// Command smsmode <push|inbox> -- set how modem delivers received SMS messages
+static void console_smsmode(const command_call &call) {
+    int inbox;  // 1 if messages are read from SIM inbox
+
+    if (strcompare(call.args, "push")) {
+        inbox = FALSE;
+    } else if (strcompare(call.args, "inbox")) {
+        inbox = TRUE;
+    } else {
+        Serial.println(F("smsmode: Syntax of command is smsmode <push|inbox>"));
+        return;
+    }
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+        return;
+    }
+    storage.set_setting(SETTING_SMS_INBOX, inbox);
+    // Modem is configured again, in inbox mode messages stored so far are read after that
+    modem.run_cmd(config_modem, PRIORITY_STARTUP);
+    Serial.println(F("smsmode: Task completed, modem is configured again"));
+}
+
+// Command smslimit <burst> <interval> <window> -- set rate limiter of SMS commands
+static void console_smslimit(const command_call &call) {
+    int burst, interval, window;    // New values of settings, 0 for default
+
+    if (system_control.test_error(ERROR_SD)) {
+        Serial.println(F("DVDCS: SD card error"));
+    } else if (sscanf(call.args, "%d %d %d", &burst, &interval, &window) == 3 &&
+               burst >= 0 && burst < 256 && interval >= 0 && window >= 0 && window <= SMS_DUP_WINDOW_MAX) {
+        storage.set_setting(SETTING_SMS_RATE_BURST, burst);
+        storage.set_setting(SETTING_SMS_RATE_INTERVAL, interval);
+        storage.set_setting(SETTING_SMS_DUP_WINDOW, window);
+        Serial.println(F("smslimit: Task completed, new limits are set"));
+    } else {
+        Serial.println(F("smslimit: Syntax of command is smslimit <burst> <interval> <window>, 0 for default"));
+    }
+}
+
+// Names of modem command priority classes, in order of cmd_priorities
+static const char priority_names[CMD_PRIORITY_CLASSES][12] PROGMEM = {
+    "STARTUP", "EMERGENCY", "REPLY", "HEALTH", "MAINTENANCE"
+};
+
+// Names of modem command types, in order of cmd_types
+static const char cmd_type_names[CMD_TYPE_COUNT][8] PROGMEM = {
+    "STARTUP", "CHECK", "SMS", "DELAY", "CONFIG", "INBOX"
+};
+
+// Command modem -- display SMS submit counters and command queue statistics
+static void console_modem(const command_call &call) {
+    at_command *commands[] = { &startup_modem, &check_modem, &sms_modem, &delay_modem, &config_modem, &inbox_modem };
+    int i;  // Attempt, priority class and command counter
+
+    Serial.print(F("Modem -- SMS SENT          -- "));
+    Serial.println(sms_modem.get_sent_count());
+    Serial.print(F("Modem -- SMS QUEUED        -- "));
+    Serial.println(sms_modem.get_queued_count());
+    Serial.print(F("Modem -- QUEUE OVERFLOWS   -- "));
+    Serial.println(sms_modem.get_overflows());
+    Serial.print(F("Modem -- PROMPT TIMEOUTS   -- "));
+    Serial.println(sms_modem.get_prompt_timeouts());
+    Serial.print(F("Modem -- PROMPT WAIT AVG   -- "));
+    Serial.println(sms_modem.get_prompt_wait_avg());
+    Serial.print(F("Modem -- PROMPT WAIT MAX   -- "));
+    Serial.println(sms_modem.get_prompt_wait_max());
+    Serial.print(F("Modem -- SUBMIT TIME AVG   -- "));
+    Serial.println(sms_modem.get_submit_avg());
+    Serial.print(F("Modem -- SUBMIT TIME MAX   -- "));
+    Serial.println(sms_modem.get_submit_max());
+    Serial.print(F("Modem -- SMS QUEUE PEAK    -- "));
+    Serial.println(sms_modem.get_queue_peak());
+    Serial.print(F("Modem -- REPLY LATENCY AVG -- "));
+    Serial.println(sms_modem.get_latency_avg());
+    Serial.print(F("Modem -- REPLY LATENCY MAX -- "));
+    Serial.println(sms_modem.get_latency_max());
+    // Number of messages sent on each attempt
+    Serial.print(F("Modem -- SMS ATTEMPTS      -- "));
+    for (i = 0; i < SMS_MAX_ATTEMPTS; i++) {
+        Serial.print(i + 1);
+        Serial.print(F(": "));
+        Serial.print(sms_modem.get_attempt_count(i));
+        Serial.print(F(", "));
+    }
+    Serial.print(F("failed: "));
+    Serial.println(sms_modem.get_spooled());
+    Serial.print(F("Modem -- SMS SPOOL TOTAL   -- "));
+    Serial.println(storage.get_sms_spool_count());
+    Serial.print(F("Modem -- SMS MODE          -- "));
+    if (!system_control.test_error(ERROR_SD) && storage.get_setting(SETTING_SMS_INBOX).int_value)
+        Serial.println(F("inbox"));
+    else
+        Serial.println(F("push"));
+    Serial.print(F("Modem -- INBOX BACKLOG     -- "));
+    Serial.println(inbox_modem.get_backlog());
+    Serial.print(F("Modem -- INBOX READ        -- "));
+    Serial.println(inbox_modem.get_read_count());
+    Serial.print(F("Modem -- SMS DUPLICATES    -- "));
+    Serial.println(sms_limiter.get_duplicates());
+    Serial.print(F("Modem -- SMS RATE LIMITED  -- "));
+    Serial.println(sms_limiter.get_limited());
+    Serial.print(F("Modem -- RX OVERFLOWS      -- "));
+    Serial.println(modem_serial.get_overflows());
+    Serial.print(F("Modem -- RX RING MAX USED  -- "));
+    Serial.println(modem_serial.get_max_used());
+    Serial.print(F("Modem -- CMD QUEUE DEPTH   -- "));
+    Serial.println(modem.get_queue_depth());
+    Serial.print(F("Modem -- CMD QUEUE MAX     -- "));
+    Serial.println(modem.get_queue_max_depth());
+    Serial.print(F("Modem -- CMD COALESCED     -- "));
+    Serial.println(modem.get_queue_coalesced());
+    // Wait in queue for each priority class: executed commands, average and longest wait in ms
+    for (i = 0; i < CMD_PRIORITY_CLASSES; i++) {
+        Serial.print(F("Modem -- WAIT "));
+        Serial.print((const __FlashStringHelper *)priority_names[i]);
+        Serial.print(F(" -- "));
+        Serial.print(modem.get_wait_count(i));
+        Serial.print(F(" cmd, avg "));
+        Serial.print(modem.get_wait_avg(i));
+        Serial.print(F(" ms, max "));
+        Serial.print(modem.get_wait_max(i));
+        Serial.println(F(" ms"));
+    }
+    // Timed out and retried attempts of each command
+    for (i = 0; i < CMD_TYPE_COUNT; i++) {
+        Serial.print(F("Modem -- TIMEOUTS "));
+        Serial.print((const __FlashStringHelper *)cmd_type_names[commands[i]->get_type()]);
+        Serial.print(F(" -- "));
+        Serial.print(commands[i]->get_timeouts());
+        Serial.print(F(" timeouts, "));
+        Serial.print(commands[i]->get_retries());
+        Serial.println(F(" retries"));
+    }
+}
+
+// Command sensors -- display current state of all sensors
+static void console_sensors(const command_call &call) {
+    Serial.print("Sensor -- Door big opened    -- ");
+    Serial.println(digitalRead(BIG_DOOR_S_OPEN));
+    Serial.print("Sensor -- Door big closed    -- ");
+    Serial.println(digitalRead(BIG_DOOR_S_CLOSE));
+    Serial.print("Sensor -- Door small opened  -- ");
+    Serial.println(digitalRead(SMALL_DOOR_S_OPEN));
+    Serial.print("Sensor -- Door small closed  -- ");
+    Serial.println(digitalRead(SMALL_DOOR_S_CLOSE));
+    Serial.print("Sensor -- Light              -- ");
+    Serial.println(digitalRead(LIGHT_S));
+}
+
+// Commands which can be run from console, sorted by keyword
+static constexpr command_entry console_command_table[] PROGMEM = {
+    { "cache",       COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_cache       },
+    { "clearlog",    COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_clearlog    },
+    { "clearmotd",   COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_clearmotd   },
+    { "clearusers",  COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_clearusers  },
+    { "clock",       COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_clock       },
+    { "date",        COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_date        },
+    { "dispass",     COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_dispass     },
+    { "dump",        COMMAND_ARGS,     PERMISSION_ADMIN, "", console_dump        },
+    { "echo",        COMMAND_ANY_ARGS, PERMISSION_ADMIN, "", console_echo        },
+    { "errors",      COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_errors      },
+    { "help",        COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_help        },
+    { "log",         COMMAND_ANY_ARGS, PERMISSION_ADMIN, "", console_log         },
+    { "modem",       COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_modem       },
+    { "motd",        COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_motd        },
+    { "rtcsync",     COMMAND_ARGS,     PERMISSION_ADMIN, "", console_rtcsync     },
+    { "sensors",     COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_sensors     },
+    { "setdate",     COMMAND_ANY_ARGS, PERMISSION_ADMIN, "", console_setdate     },
+    { "setmotd",     COMMAND_ANY_ARGS, PERMISSION_ADMIN, "", console_setmotd     },
+    { "settings",    COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_settings    },
+    { "smslimit",    COMMAND_ARGS,     PERMISSION_ADMIN, "", console_smslimit    },
+    { "smsmode",     COMMAND_ARGS,     PERMISSION_ADMIN, "", console_smsmode     },
+    { "unseterrors", COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_unseterrors },
+    { "users",       COMMAND_NO_ARGS,  PERMISSION_ADMIN, "", console_users       }
+};
+static_assert(command_table_sorted(console_command_table, sizeof(console_command_table) / sizeof(command_entry), 0),
+    "console_command_table must be sorted by keyword and keywords must be unique and in lower case");
+// Registry used to find commands entered in console
+static command_registry console_commands(console_command_table, sizeof(console_command_table) / sizeof(command_entry));
+
 /********************************************************************
  * Class for interactions with system                               *
  ********************************************************************/
 system_class::system_class() {
     error_flags = 0;
+    dump_state = DUMP_IDLE;
+    loop_count = 0;
+    loop_window_start = 0;
+    loop_frequency = 0;
 }
 
 void system_class::init() {
@@ -142,6 +805,13 @@ void system_class::beep(unsigned int beep_delay, int how_many_times) {
 }
 
 void system_class::update() {
+    // Count loop() passes, update() is called once in each
+    ++loop_count;
+    if (millis() - loop_window_start >= LOOP_FREQUENCY_WINDOW) {
+        loop_frequency = loop_count * 1000 / (millis() - loop_window_start);
+        loop_count = 0;
+        loop_window_start = millis();
+    }
     // Handle current beeping
     if (beep_counter > 0 && beep_start <= millis()) {
         if ((millis() - beep_start) / BEEP_DURITATION / 2 >= (unsigned int)beep_counter) {
@@ -162,323 +832,131 @@ void system_class::update() {
             beep(temp_counter);                          // Start beep
         }
     }
+    // While dump is running console is used only for dump frames
+    if (dump_state != DUMP_IDLE) {
+        dump_update();
+        return;
+    }
     // Serial communication
     command.update();
 
     if (command.ready()) {
         Serial.println();
-        // Command echo -- print stuff back to console
-        if (strstartswith(command.get(), "echo ")) {
-            Serial.print(F("echo: "));
-            Serial.println(command.get() + 5);
-        }
-        // Command echo (no parametars) -- print nothing
-        else if (strcompare(command.get(), "echo")) {
-            Serial.println(F("echo: "));
-        }
-        // Command help -- print list of commands
-        else if (strcompare(command.get(), "help")) {
-            Serial.println(F("-------------------------------------------------"));
-            Serial.print(F("   DVD Control System -- Ver "));
-            Serial.println(F(FIRMWARE_VERSION));
-            Serial.println(F("-------------------------------------------------"));
-            Serial.println();
-            Serial.println(F("help                         -- Print this help message"));
-            Serial.println(F("echo <text>                  -- Print text back to console (useless)"));
-            Serial.println(F("motd                         -- Print current Message Of The Day"));
-            Serial.println(F("setmotd <text>               -- Set custom motd to be displayed on home screen"));
-            Serial.println(F("clearmotd                    -- Remove custom motd if it's set"));
-            Serial.println(F("dispass                      -- Disable password autentification for everything"));
-            Serial.println(F("settings                     -- List values of all system settings"));
-            Serial.println(F("users                        -- List all SMS users"));
-            Serial.println(F("errors                       -- Show values of all error flags"));
-            Serial.println(F("log <number>                 -- Print specified number of log records"));
-            Serial.println(F("clearusers                   -- Permanently delete all users from users file"));
-            Serial.println(F("clearlog                     -- Permanently delete all log records from log file"));
-            Serial.println(F("unseterrors                  -- Unset all error flags (DON'T DO THIS)"));
-            Serial.println(F("date                         -- Display current date and time"));
-            Serial.println(F("setdate DD-MM-YYYY hh-mm-ss  -- Set new date and time"));
-            Serial.println(F("sensors                      -- Read state of all sensors"));
-            Serial.println();
+        // Run command, if it's not found print command not found
+        if (!console_commands.run(command.get(), PERMISSION_ADMIN, 0, NULL) && command.get()[0] != '\0') {
+            Serial.println(F("DVDCS: Command not found"));
         }
-        // Command errors -- print error flags
-        else if (strcompare(command.get(), "errors")) {
-            Serial.print(F("Error -- MODEM TURN ON     -- "));
-            Serial.println(test_error(ERROR_MODEM_TURN_ON));
-            Serial.print(F("Error -- MODEM TIMEOUT     -- "));
-            Serial.println(test_error(ERROR_MODEM_TIMEOUT));
-            Serial.print(F("Error -- MODEM SIM         -- "));
-            Serial.println(test_error(ERROR_MODEM_SIM));
-            Serial.print(F("Error -- MODEM SIGNAL      -- "));
-            Serial.println(test_error(ERROR_MODEM_SIGNAL));
-            Serial.print(F("Error -- MODEM REGISTER    -- "));
-            Serial.println(test_error(ERROR_MODEM_REGISTER));
-            Serial.print(F("Error -- MODEM SMS SEND    -- "));
-            Serial.println(test_error(ERROR_MODEM_SMS_SEND));
-            Serial.print(F("Error -- MODEM UNKNOWN     -- "));
-            Serial.println(test_error(ERROR_MODEM_UNKNOWN));
-            Serial.print(F("Error -- SD INIT           -- "));
-            Serial.println(test_error(ERROR_SD_INIT));
-            Serial.print(F("Error -- SD READ           -- "));
-            Serial.println(test_error(ERROR_SD_READ));
-            Serial.print(F("Error -- SD WRITE          -- "));
-            Serial.println(test_error(ERROR_SD_WRITE));
-            Serial.print(F("Error -- SD UNKNOWN        -- "));
-            Serial.println(test_error(ERROR_SD_UNKNOWN));
-            Serial.print(F("Error -- RTC CONFIDENCE    -- "));
-            Serial.println(test_error(ERROR_RTC_CONFIDENCE));
-            Serial.print(F("Error -- RTC UNKNOWN       -- "));
-            Serial.println(test_error(ERROR_RTC_UNKNOWN));
-            Serial.print(F("Error -- LIGHT UNKNOWN     -- "));
-            Serial.println(test_error(ERROR_LIGHT_UNKNOWN));
+        // Settings changed by command and its logs go to SD card right away
+        storage.sync();
+        // Dump command takes over console, so prompt is not printed
+        if (dump_state != DUMP_IDLE) {
+            command.clear();
+            return;
         }
-        // Command settings -- print values of each setting
-        else if (strcompare(command.get(), "settings")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                setting_record setting;
-
-                Serial.print(F("Setting -- PASSWORD (PIN)     -- "));
-                setting = storage.get_setting(SETTING_PASSWORD);
-                Serial.print(setting.int_value);
-                Serial.print(F(", \""));
-                Serial.print(setting.string_value);
-                Serial.println(F("\""));
-
-                Serial.print(F("Setting -- SIRENE AUTH        -- "));
-                setting = storage.get_setting(SETTING_SIRENE_AUTH);
-                Serial.print(setting.int_value);
-                Serial.print(F(", \""));
-                Serial.print(setting.string_value);
-                Serial.println(F("\""));
-
-                Serial.print(F("Setting -- SETTINGS AUTH      -- "));
-                setting = storage.get_setting(SETTING_SETTINGS_AUTH);
-                Serial.print(setting.int_value);
-                Serial.print(F(", \""));
-                Serial.print(setting.string_value);
-                Serial.println(F("\""));
-
-                Serial.print(F("Setting -- MOTD               -- "));
-                setting = storage.get_setting(SETTING_MOTD);
-                Serial.print(setting.int_value);
-                Serial.print(F(", \""));
-                Serial.print(setting.string_value);
-                Serial.println(F("\""));
-
-                Serial.print(F("Setting -- NEXT USER ID       -- "));
-                setting = storage.get_setting(SETTING_NEXT_USER_ID);
-                Serial.print(setting.int_value);
-                Serial.print(F(", \""));
-                Serial.print(setting.string_value);
-                Serial.println(F("\""));
-                
-                Serial.print(F("Setting -- LAST LIGHT STATE   -- "));
-                setting = storage.get_setting(SETTING_LAST_LIGHT_STATE);
-                Serial.print(setting.int_value);
-                Serial.print(F(", \""));
-                Serial.print(setting.string_value);
-                Serial.println(F("\""));
-            }
-        }
-        // Command users -- print list of users
-        else if (strcompare(command.get(), "users")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                int user_count = storage.get_user_count();
+        // If no command is entered just print prompt
+        Serial.print(F("> "));
 
-                if (user_count == 0) {
-                    Serial.println(F("users: No users found in users file"));
-                } else {
-                    int i;
+        command.clear();
+    }
+}
 
-                    Serial.print(F("Number of user records: "));
-                    Serial.println(user_count);
-                    Serial.println();
+unsigned long system_class::get_loop_frequency() {
+    return loop_frequency;
+}
 
-                    for (i = 0; i < user_count; i++) {
-                        user_record user = storage.get_user_by_pos(i);
+void system_class::dump_begin(int kind, unsigned long baud) {
+    // Count must be read first, it flushes staged log records
+    unsigned long count = storage.dump_count((dump_kinds)kind);
+
+    dump_kind = kind;
+    dump_position = storage.dump_first((dump_kinds)kind);
+    dump_end = dump_position + count;
+    dump_sent = 0;
+    dump_seq = 0;
+
+    Serial.print(F("dump: Switching to "));
+    Serial.print(baud);
+    Serial.println(F(" baud"));
+    // Wait for message to be sent before baud rate is changed
+    Serial.flush();
+    Serial.begin(baud);
+
+    dump_switch_time = millis();
+    dump_state = DUMP_SWITCH;
+}
 
-                        Serial.print(F("User -- "));
-                        Serial.print(
-                            (user.active) ? F("Enabled  -- ") : F("Disabled -- ")
-                        );
-                        Serial.print(F("Number +"));
-                        Serial.print(user.number);
-                        Serial.print(F(" -- ID "));
-                        Serial.println(user.id);
-                    }
-                }
-            }
-        }
-        // Command motd -- print current motd
-        else if (strcompare(command.get(), "motd")) {
-            Serial.println(F("-------------------------------------------------"));
-            Serial.print(F("   MOTD: "));
-            Serial.println(main_panel.get_motd());
-            Serial.println(F("-------------------------------------------------"));
-        }
-        // Command setmotd -- set custom motd
-        else if (strcompare(command.get(), "setmotd")) {
-            Serial.println(F("setmotd: Syntax of command is setmotd <text>"));
-        }
-        else if (strstartswith(command.get(), "setmotd ")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                if (strlength(command.get() + 8) > 20) {
-                    Serial.println(F("setmotd: Max length of motd is 20 ASCII characters"));
-                } else {
-                    storage.set_setting(SETTING_MOTD, command.get() + 8);
-                    main_panel.set_motd(1, command.get() + 8);
-                    Serial.print(F("setmotd: Motd is set to \""));
-                    Serial.print(command.get() + 8);
-                    Serial.println(F("\""));
-                }
-            }
-        }
-        // Command clearmotd -- remove custom motd
-        else if (strcompare(command.get(), "clearmotd")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                storage.set_setting(SETTING_MOTD, "");
-                main_panel.clear_motd(1);
-                Serial.println(F("clearmotd: Custom motd is cleared, default motd will be displayed instead"));
-            }
-        }
-        // Command dispass -- Disable password for settings and sirens, so they can be accessed without one
-        else if (strcompare(command.get(), "dispass")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                storage.set_setting(SETTING_SIRENE_AUTH, FALSE);
-                storage.set_setting(SETTING_SETTINGS_AUTH, FALSE);
-                Serial.println(F("dispass: Authetication is disabled, you now have access to all features of DVDCS without PIN"));
-            }
-        }
-        // Command unseterrors -- Unset all error system flags
-        else if (strcompare(command.get(), "unseterrors")) {
-            unset_error(ERROR);
-            Serial.println(F("unseterrors: All error flags are now set to 0, I hope you know what you're doing"));
-        }
-        // Command clearusers -- clear users file
-        else if (strcompare(command.get(), "clearusers")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                storage.clear_user_file();
-                Serial.println(F("clearusers: Users file has been cleared, you might also want clear log file since it's mostly useless now"));
-            }
-        }
-        // Command clearlog -- clear log file
-        else if (strcompare(command.get(), "clearlog")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                storage.clear_log();
-                Serial.println(F("clearlog: Log file has been cleared"));
-            }
-        }
-        // Command log <number> -- display specified number of logs
-        else if (strcompare(command.get(), "log")) {
-            Serial.println(F("log: Syntax of command is log <number>"));
-        }
-        else if (strstartswith(command.get(), "log ")) {
-            if (test_error(ERROR_SD)) {
-                Serial.println(F("DVDCS: SD card error"));
-            } else {
-                unsigned long num;                                      // Number of records to print
-                // If command is correctly formated
-                if (sscanf(command.get(), "log %lu", &num) == 1) {
-                    unsigned long log_count = storage.get_log_count();  // Get log count
-                    unsigned long current;                              // Current log
-                    char log_formated[50];                              // String with current log information to print to console
-
-                    for (current = 0; current < log_count && current < num; current++) {
-                        log_record logr = storage.get_log(current);                 // Log record
-                        user_record userr = storage.get_user_by_id(logr.user_id);   // User for current record
-                        // Format log
-                        sprintf(
-                            log_formated, "Log -- %02u-%02u-%04u %02u:%02u:%02u -- %s -- %20s",
-                            logr.day, logr.month, logr.year, logr.hour, logr.minute, logr.second, logr.action, userr.number
-                        );
-                        // Print formated log
-                        Serial.println(log_formated);
-                    }
-                    // Print log count at the end
-                    Serial.println();
-                    Serial.print("Log records ");
-                    // If requested number is greater than log count print log count
-                    if (log_count < num)
-                        Serial.print(log_count);
-                    else
-                        Serial.print(num);
-                    Serial.print(" / ");
-                    Serial.println(log_count);
-                } else {
-                    Serial.println(F("log: Syntax of command is log <number>"));
-                }
-            }
-        }
-        // Command setdate DD-MM-YYYY hh-mm-ss -- set time for RTC
-        else if (strcompare(command.get(), "setdate")) {
-            Serial.println(F("setdate: Syntax of command is setdate DD-MM-YYYY hh-mm-ss"));
-        }
-        else if (strstartswith(command.get(), "setdate ")) {
-            uint8_t mon, day, hour, min, sec;
-            uint16_t year;
-            if (sscanf(command.get(), "setdate %02hhu-%02hhu-%04u %02hhu:%02hhu:%02hhu", &day, &mon, &year, &hour, &min, &sec) == 6) {
-                Serial.println(day);
-                RtcDateTime time_to_set(year, mon, day, hour, min, sec);
-                rtc.SetDateTime(time_to_set);
+void system_class::dump_update() {
+    unsigned char payload[DUMP_CHUNK_SIZE];     // Payload of frame
+    unsigned char record_size = storage.dump_record_size((dump_kinds)dump_kind);
+
+    // Give receiver time to change baud rate, then send dump info
+    if (dump_state == DUMP_SWITCH) {
+        if (millis() - dump_switch_time < DUMP_SWITCH_DELAY)
+            return;
+
+        unsigned long count = dump_end - dump_position;
+        payload[0] = dump_kind;
+        payload[1] = record_size;
+        payload[2] = count;
+        payload[3] = count >> 8;
+        payload[4] = count >> 16;
+        payload[5] = count >> 24;
+        payload[6] = DUMP_VERSION;
+        dump_frame(DUMP_FRAME_START, payload, 7);
+
+        dump_state = DUMP_SEND;
+        return;
+    }
 
-                Serial.println(F("setdate: Task completed, new time is set"));
-            } else {
-                Serial.println(F("setdate: Syntax of command is setdate DD-MM-YYYY hh-mm-ss"));
-            }
-        }
-        // Command date -- display current time
-        else if (strcompare(command.get(), "date")) {
-            if (test_error(ERROR_RTC)) {
-                Serial.println(F("date: RTC error accured, unable to read time"));
-            } else {
-                char time_formated[30];
-                RtcDateTime now = rtc.GetDateTime();
+    // Send as many whole records as fit in one frame
+    unsigned int count = 0;
+    if (dump_position < dump_end && record_size > 0) {
+        count = min((unsigned long)(DUMP_CHUNK_SIZE / record_size), dump_end - dump_position);
+        count = storage.dump_read((dump_kinds)dump_kind, dump_position, count, payload);
+    }
 
-                sprintf(
-                    time_formated, "%02u-%02u-%04u %02u:%02u:%02u",
-                    now.Day(), now.Month(), now.Year(), now.Hour(), now.Minute(), now.Second()
-                );
+    if (count > 0) {
+        dump_frame(DUMP_FRAME_DATA, payload, count * record_size);
+        dump_position += count;
+        dump_sent += count;
+        return;
+    }
 
-                Serial.print(F("date: "));
-                Serial.println(time_formated);
-            }
-        }
-        // Command sensors -- display current state of all sensors
-        else if (strcompare(command.get(), "sensors")) {
-            Serial.print("Sensor -- Door big opened    -- ");
-            Serial.println(digitalRead(BIG_DOOR_S_OPEN));
-            Serial.print("Sensor -- Door big closed    -- ");
-            Serial.println(digitalRead(BIG_DOOR_S_CLOSE));
-            Serial.print("Sensor -- Door small opened  -- ");
-            Serial.println(digitalRead(SMALL_DOOR_S_OPEN));
-            Serial.print("Sensor -- Door small closed  -- ");
-            Serial.println(digitalRead(SMALL_DOOR_S_CLOSE));
-            Serial.print("Sensor -- Light              -- ");
-            Serial.println(digitalRead(LIGHT_S));
-        }
-        // If command is not found, print command not found
-        else if (command.get()[0] != '\0') {
-            Serial.println(F("DVDCS: Command not found"));
-        }
-        // If no command is entered just print prompt
-        Serial.print(F("> "));
+    // All records are sent or they can't be read anymore, receiver compares count from START frame
+    payload[0] = dump_sent;
+    payload[1] = dump_sent >> 8;
+    payload[2] = dump_sent >> 16;
+    payload[3] = dump_sent >> 24;
+    dump_frame(DUMP_FRAME_END, payload, 4);
+
+    // Return to console baud rate
+    Serial.flush();
+    Serial.begin(CONSOLE_BAUD);
+    // Drop anything received during dump
+    while (Serial.available() > 0)
+        Serial.read();
+    dump_state = DUMP_IDLE;
+
+    Serial.println();
+    Serial.print(F("dump: Records sent "));
+    Serial.println(dump_sent);
+    Serial.print(F("> "));
+}
 
-        command.clear();
-    }
+void system_class::dump_frame(unsigned char type, const unsigned char payload[], unsigned char length) {
+    unsigned char header[3] = {type, dump_seq, length};
+    unsigned int crc = 0xFFFF;
+
+    crc = crc16(crc, header, 3);
+    crc = crc16(crc, payload, length);
+
+    Serial.write(DUMP_SYNC);
+    Serial.write(header, 3);
+    Serial.write(payload, length);
+    Serial.write(crc & 0xFF);
+    Serial.write(crc >> 8);
+
+    ++dump_seq;
 }
 
 void system_class::ready(int state) {
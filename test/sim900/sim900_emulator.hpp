@@ -0,0 +1,290 @@
+#ifndef _TEST_SIM900_EMULATOR_HPP_
+#define _TEST_SIM900_EMULATOR_HPP_
+
+// Scriptable SIM900 for native tests, it talks to firmware through USART3 of native HAL
+// and answers commands used by modem.cpp, responses are delayed by simulated time (hal_millis)
+
+// Include global header files
+#include <Arduino.h>
+#include <string>
+#include <vector>
+// Include local header files
+#include "native_hal.h"
+#include "sms_pdu.hpp"
+
+// Response which replaces default answer to command, empty response means modem stays silent
+#define SIM900_ERROR "\r\nERROR\r\n"
+#define SIM900_CMS_ERROR "\r\n+CMS ERROR: 500\r\n"
+#define SIM900_TIMEOUT ""
+
+class sim900_emulator {
+    public:
+        // Message submitted by firmware with AT+CMGS
+        struct submitted_sms {
+            std::string number;         // Recipient number
+            std::string pdu;            // Submitted PDU without SMSC
+            unsigned long command_at;   // hal_millis when AT+CMGS arrived
+            unsigned long ok_at;        // hal_millis when final OK is sent
+        };
+
+        int echo;                       // 1 if commands and PDUs are echoed, like after ATE1
+        unsigned long baud;             // Speed of serial line, characters to firmware take 10 bits each
+        unsigned long response_delay;   // Time from command to its response (in ms)
+        unsigned long prompt_delay;     // Time from AT+CMGS to "> " prompt (in ms)
+        unsigned long submit_delay;     // Time from PDU to +CMGS and final OK (in ms)
+        std::vector<submitted_sms> submitted;   // Messages sent by firmware
+        std::vector<std::string> commands;      // Every command received from firmware
+        unsigned long cancelled;        // Number of AT+CMGS cancelled with ESC
+
+        sim900_emulator() {
+            echo = 1;
+            baud = 9600;
+            response_delay = 20;
+            prompt_delay = 50;
+            submit_delay = 2000;
+            cancelled = 0;
+            in_pdu = 0;
+            pdu_length = 0;
+            output_sent = 0;
+            message_reference = 0;
+        }
+
+        // Next count commands starting with prefix get response instead of default answer
+        void script(const std::string &prefix, const std::string &response, int count = 1) {
+            rule new_rule = { prefix, response, count };
+            rules.push_back(new_rule);
+        }
+
+        // Send SMS to firmware as +CMT unsolicited response
+        void deliver(const std::string &number, const std::string &text) {
+            deliver_recorded(deliver_pdu(number, text));
+        }
+
+        // Send SMS-DELIVER PDU with SMSC, like one recorded from real network, as +CMT unsolicited response
+        void deliver_recorded(const std::string &pdu) {
+            unsigned int smsc_length = strtoul(pdu.substr(0, 2).c_str(), NULL, 16);
+            char header[24];
+
+            // Length in +CMT doesn't count SMSC
+            snprintf(header, sizeof(header), "\r\n+CMT: ,%u\r\n", (unsigned int)(pdu.size() / 2 - 1 - smsc_length));
+            send(header + pdu + "\r\n", 0);
+        }
+
+        // Store SMS on SIM card and notify firmware with +CMTI, it's read with AT+CMGL
+        void store(const std::string &number, const std::string &text) {
+            char notice[32];
+
+            sim_inbox.push_back(deliver_pdu(number, text));
+            snprintf(notice, sizeof(notice), "\r\n+CMTI: \"SM\",%u\r\n", (unsigned int)sim_inbox.size());
+            send(notice, 0);
+        }
+
+        // Send any text to firmware after delay
+        // Returns: hal_millis when text starts to be sent
+        unsigned long send(const std::string &text, unsigned long delay) {
+            pending new_output = { hal_millis + delay, text };
+            size_t i;
+
+            // Texts are sent in order of due time, text which already started is not interrupted
+            for (i = (output_sent > 0) ? 1 : 0; i < output.size(); i++) {
+                if ((long)(output[i].due - new_output.due) > 0)
+                    break;
+            }
+            output.insert(output.begin() + i, new_output);
+            return new_output.due;
+        }
+
+        // Get number of messages stored on SIM card which are not deleted
+        int inbox_count() {
+            int count = 0;
+            size_t i;
+
+            for (i = 0; i < sim_inbox.size(); i++)
+                count += !sim_inbox[i].empty();
+            return count;
+        }
+
+        // Receive characters sent by firmware and send responses which are due
+        void update() {
+            size_t i;
+
+            hal_modem_transmit();
+            for (i = 0; i < hal_modem_tx.size(); i++)
+                receive(hal_modem_tx[i]);
+            hal_modem_tx.clear();
+
+            // Text starts when it's due, after that characters arrive at speed of serial line
+            while (!output.empty() && (long)(hal_millis - output.front().due) >= 0) {
+                pending &front = output.front();
+                unsigned long arrived = (hal_millis - front.due) * baud / 10000 + 1;
+
+                while (output_sent < front.text.size() && output_sent < arrived)
+                    hal_modem_receive((uint8_t)front.text[output_sent++]);
+                if (output_sent < front.text.size())
+                    break;
+                output.erase(output.begin());
+                output_sent = 0;
+            }
+        }
+
+    private:
+        struct rule {
+            std::string prefix;         // Start of command
+            std::string response;       // Response sent instead of default one
+            int count;                  // Number of commands left which get this response, -1 for all
+        };
+        struct pending {
+            unsigned long due;          // hal_millis when text is sent
+            std::string text;           // Text sent to firmware
+        };
+
+        std::vector<rule> rules;
+        std::vector<pending> output;
+        std::vector<std::string> sim_inbox;     // PDUs on SIM card, deleted ones are empty
+        std::string line;               // Command being received
+        int in_pdu;                     // 1 if PDU is being received after prompt
+        unsigned int pdu_length;        // TPDU length given with AT+CMGS
+        unsigned long command_at;       // hal_millis when last AT+CMGS arrived
+        size_t output_sent;             // Number of characters of first output already sent
+        int message_reference;          // Reference returned with +CMGS
+
+        // Build SMS-DELIVER PDU for message to this modem
+        static std::string deliver_pdu(const std::string &number, const std::string &text) {
+            builder pdu_builder;
+            std::string submit;
+            unsigned int address_length, address_end;
+
+            // SMS-SUBMIT from firmware builder has the same number, coding and user data
+            pdu_builder.set_number(number.c_str());
+            pdu_builder.set_message(text.c_str());
+            pdu_builder.set_part(0, 0);
+            pdu_builder.calculate();
+            submit = pdu_builder.get_pdu();
+            address_length = strtoul(submit.substr(6, 2).c_str(), NULL, 16);
+            address_end = 10 + (address_length + 1) / 2 * 2;
+
+            return std::string("07918385090000F0") + "04" + submit.substr(6, address_end - 6) +
+                "00" + submit.substr(address_end + 2, 2) + "32106011000080" + submit.substr(address_end + 6);
+        }
+
+        // Get recipient number from SMS-SUBMIT PDU without SMSC
+        static std::string submit_number(const std::string &pdu) {
+            unsigned int length, i;
+            std::string number;
+
+            if (pdu.size() < 8)
+                return number;
+            length = strtoul(pdu.substr(4, 2).c_str(), NULL, 16);
+            // Digits are swapped in each octet
+            for (i = 0; i < length && 8 + (i ^ 1) < pdu.size(); i++)
+                number += pdu[8 + (i ^ 1)];
+            return number;
+        }
+
+        void receive(char ch) {
+            if (in_pdu) {
+                // Ctrl+Z sends message, ESC cancels it
+                if (ch == 0x1A) {
+                    submit_pdu();
+                } else if (ch == 0x1B) {
+                    in_pdu = 0;
+                    line.clear();
+                    ++cancelled;
+                } else if (ch != '\r' && ch != '\n') {
+                    line += ch;
+                }
+                return;
+            }
+            if (ch == 0x1B) {
+                ++cancelled;
+                line.clear();
+                return;
+            }
+            if (ch == '\n')
+                return;
+            if (ch != '\r') {
+                line += ch;
+                return;
+            }
+            if (!line.empty())
+                command(line);
+            line.clear();
+        }
+
+        void submit_pdu() {
+            // Firmware sends PDU with SMSC octet in front
+            std::string pdu = line.substr(line.size() >= 2 ? 2 : 0);
+            submitted_sms sms = { submit_number(pdu), pdu, command_at, 0 };
+            char response[32];
+
+            in_pdu = 0;
+            line.clear();
+            if (echo)
+                send("00" + pdu + "\r\n", 0);
+            if (apply_rule("PDU")) return;
+            // Modem rejects PDU which doesn't match length given with AT+CMGS
+            if (pdu.size() != pdu_length * 2) {
+                send(SIM900_CMS_ERROR, response_delay);
+                return;
+            }
+            snprintf(response, sizeof(response), "\r\n+CMGS: %d\r\n\r\nOK\r\n", ++message_reference % 256);
+            sms.ok_at = send(response, submit_delay);
+            submitted.push_back(sms);
+        }
+
+        // Send scripted response if command has one
+        // Returns: 1 if scripted response was used, or 0 if default one should be sent
+        int apply_rule(const std::string &cmd) {
+            size_t i;
+
+            for (i = 0; i < rules.size(); i++) {
+                if (cmd.compare(0, rules[i].prefix.size(), rules[i].prefix) != 0)
+                    continue;
+                if (!rules[i].response.empty())
+                    send(rules[i].response, response_delay);
+                if (rules[i].count > 0 && --rules[i].count == 0)
+                    rules.erase(rules.begin() + i);
+                return 1;
+            }
+            return 0;
+        }
+
+        void command(const std::string &cmd) {
+            commands.push_back(cmd);
+            if (echo)
+                send(cmd + "\r", 0);
+            if (apply_rule(cmd)) return;
+
+            if (cmd.compare(0, 8, "AT+CMGS=") == 0) {
+                command_at = hal_millis;
+                pdu_length = strtoul(cmd.c_str() + 8, NULL, 10);
+                in_pdu = 1;
+                send("\r\n> ", prompt_delay);
+            } else if (cmd == "AT+CCID;+CPIN?;+CSQ;+CREG?") {
+                send("\r\n89385011223344556677\r\n\r\n+CPIN: READY\r\n\r\n+CSQ: 20,0\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n", response_delay);
+            } else if (cmd == "AT+CMGL=4") {
+                std::string listing;
+                char header[32];
+                size_t i;
+
+                for (i = 0; i < sim_inbox.size(); i++) {
+                    if (sim_inbox[i].empty()) continue;
+                    snprintf(header, sizeof(header), "\r\n+CMGL: %u,0,,%u\r\n", (unsigned int)i + 1, (unsigned int)(sim_inbox[i].size() / 2 - 8));
+                    listing += header + sim_inbox[i];
+                }
+                send(listing + "\r\n\r\nOK\r\n", response_delay);
+            } else if (cmd.compare(0, 8, "AT+CMGD=") == 0) {
+                size_t index = strtoul(cmd.c_str() + 8, NULL, 10);
+
+                if (index >= 1 && index <= sim_inbox.size())
+                    sim_inbox[index - 1].clear();
+                send("\r\nOK\r\n", response_delay);
+            } else if (cmd.compare(0, 2, "AT") == 0) {
+                send("\r\nOK\r\n", response_delay);
+            } else {
+                send("\r\nERROR\r\n", response_delay);
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,242 @@
+// GSM 7-bit codec tests, table based codec is compared with bit by bit packer and
+// character search of switch based codec it replaced, then both are timed
+// Results are printed, run with: pio test -e native -f test_gsm_codec -v
+
+// Include global header files, chrono goes before min and max macros of Arduino.h
+#include <chrono>
+#include <Arduino.h>
+#include <unity.h>
+// Include local header files
+#include "sms_pdu.hpp"
+
+// Longest message tested, whole single SMS
+#define CODEC_MAX_LENGTH SMS_SINGLE_LENGTH
+// Random strings tested for each length and fill
+#define CODEC_STRINGS 64
+// Repetitions of each timed function
+#define CODEC_BENCH_ROUNDS 20000
+
+// Codec functions are not in header, they are used only by builder and parser
+void encode(const char ascii[], int fill_bits, char encoded[]);
+void decode(const char encoded[], char result[]);
+char ascii_to_gsm(char ascii_ch);
+char gsm_to_ascii_folded(char gsm_ch);
+
+// Pairs of GSM letter with diacritic and its base letter
+static const uint8_t folded_letters[][2] = {
+    { 0x04, 'e' }, { 0x05, 'e' }, { 0x06, 'u' }, { 0x07, 'i' }, { 0x08, 'o' }, { 0x09, 'C' },
+    { 0x0B, 'O' }, { 0x0C, 'o' }, { 0x0E, 'A' }, { 0x0F, 'a' }, { 0x1C, 'A' }, { 0x1D, 'a' },
+    { 0x1E, 's' }, { 0x1F, 'E' }, { 0x5B, 'A' }, { 0x5C, 'O' }, { 0x5D, 'N' }, { 0x5E, 'U' },
+    { 0x7B, 'a' }, { 0x7C, 'o' }, { 0x7D, 'n' }, { 0x7E, 'u' }, { 0x7F, 'a' }
+};
+
+static unsigned long random_state;
+
+static uint8_t random_char() {
+    random_state = random_state * 1103515245 + 12345;
+    // Any 7-bit character except end of string
+    return (random_state >> 16) % 127 + 1;
+}
+
+/********************************************************************
+ * Reference codec, as it was before lookup tables                  *
+ ********************************************************************/
+
+// GSM character to ASCII without folding, characters without ASCII counterpart are space
+static char reference_gsm_to_ascii(uint8_t gsm_ch) {
+    if (gsm_ch == 0x00) return '@';
+    if (gsm_ch == 0x02) return '$';
+    if (gsm_ch == 0x11) return '_';
+    // These are at the same place in both character sets
+    if (gsm_ch == '\n' || gsm_ch == '\r' || gsm_ch == 0x1B ||
+        (gsm_ch >= 0x20 && gsm_ch <= 0x7A && gsm_ch != 0x24 && gsm_ch != 0x40 && (gsm_ch < 0x5B || gsm_ch > 0x60)))
+        return gsm_ch;
+    return ' ';
+}
+
+static char reference_gsm_to_ascii_folded(uint8_t gsm_ch) {
+    size_t i;
+
+    for (i = 0; i < sizeof(folded_letters) / sizeof(folded_letters[0]); i++) {
+        if (folded_letters[i][0] == gsm_ch)
+            return folded_letters[i][1];
+    }
+    return reference_gsm_to_ascii(gsm_ch);
+}
+
+// Search of all GSM characters for the one which converts to given ASCII character
+static char reference_ascii_to_gsm(char ascii_ch) {
+    int i;
+
+    if (ascii_ch == ' ')
+        return 0x20;
+    for (i = 0; i <= 0x7F; i++) {
+        if (reference_gsm_to_ascii(i) == ascii_ch)
+            return i;
+    }
+    return 0x00;
+}
+
+// Pack characters bit by bit, bit n of septet k goes to bit fill_bits + 7 * k + n of output
+static void reference_encode(const char ascii[], int fill_bits, char encoded[]) {
+    uint8_t octets[BUILDER_BUFFER / 2];
+    int bit_count = fill_bits;
+    int i, n;
+
+    memset(octets, 0, sizeof(octets));
+    for (i = 0; ascii[i] != '\0'; i++) {
+        uint8_t septet = reference_ascii_to_gsm(ascii[i]);
+
+        for (n = 0; n < 7; n++, bit_count++) {
+            if (septet & (1 << n))
+                octets[bit_count / 8] |= 1 << (bit_count % 8);
+        }
+    }
+    for (i = 0; i < (bit_count + 7) / 8; i++)
+        sprintf(encoded + i * 2, "%02X", octets[i]);
+    encoded[i * 2] = '\0';
+}
+
+/********************************************************************
+ * Tests                                                            *
+ ********************************************************************/
+
+void setUp() {
+    random_state = 1;
+}
+
+void tearDown() {
+}
+
+void test_single_characters() {
+    int ch;
+
+    for (ch = 1; ch < 0x80; ch++)
+        TEST_ASSERT_EQUAL_HEX8_MESSAGE(reference_ascii_to_gsm(ch), ascii_to_gsm(ch), "ascii_to_gsm");
+    for (ch = 0; ch < 0x80; ch++)
+        TEST_ASSERT_EQUAL_HEX8_MESSAGE(reference_gsm_to_ascii_folded(ch), gsm_to_ascii_folded(ch), "gsm_to_ascii_folded");
+    // Bytes of UTF-8 sequences can't be encoded
+    TEST_ASSERT_EQUAL_HEX8(0x00, ascii_to_gsm((char)0xC5));
+}
+
+// Encode random strings of every length with given fill, each one is compared with
+// bit by bit packer and decoded back if there is no fill
+static void round_trip(int fill_bits) {
+    char ascii[CODEC_MAX_LENGTH + 1];
+    char expected[BUILDER_BUFFER];
+    char encoded[BUILDER_BUFFER];
+    char decoded[CODEC_MAX_LENGTH + 2];
+    int length, k, i;
+
+    for (length = 0; length <= CODEC_MAX_LENGTH; length++) {
+        for (k = 0; k < CODEC_STRINGS; k++) {
+            for (i = 0; i < length; i++)
+                ascii[i] = random_char();
+            ascii[length] = '\0';
+
+            reference_encode(ascii, fill_bits, expected);
+            encode(ascii, fill_bits, encoded);
+            TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, encoded, ascii);
+            if (fill_bits != 0)
+                continue;
+
+            decode(encoded, decoded);
+            for (i = 0; i < length; i++)
+                TEST_ASSERT_EQUAL_HEX8_MESSAGE(reference_gsm_to_ascii_folded(reference_ascii_to_gsm(ascii[i])), decoded[i], ascii);
+            // When last octet has 7 unused bits they are decoded as one more @
+            if (length % 8 == 7)
+                TEST_ASSERT_EQUAL_HEX8('@', decoded[i++]);
+            TEST_ASSERT_EQUAL_HEX8('\0', decoded[i]);
+        }
+    }
+}
+
+// Without fill whole blocks of 8 characters go through block kernel, rest through slow path
+void test_round_trip_block() {
+    round_trip(0);
+}
+
+// Fill bit after User Data Header keeps every character on slow path
+void test_round_trip_fill_bit() {
+    round_trip(1);
+}
+
+/********************************************************************
+ * Micro-benchmark                                                  *
+ ********************************************************************/
+
+// Keeps results alive, so timed calls are not removed by compiler
+static volatile unsigned int bench_sink;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print_bench(const char name[], double table_ns, double reference_ns, int calls) {
+    printf("  %-20s %8.1f ns   reference %8.1f ns   %5.1fx\n",
+        name, table_ns / calls, reference_ns / calls, reference_ns / table_ns);
+}
+
+void test_bench() {
+    char ascii[CODEC_MAX_LENGTH + 1];
+    char encoded[BUILDER_BUFFER];
+    std::chrono::steady_clock::time_point start;
+    double table_ns, reference_ns;
+    int round, i;
+
+    for (i = 0; i < CODEC_MAX_LENGTH; i++)
+        ascii[i] = random_char();
+    ascii[CODEC_MAX_LENGTH] = '\0';
+
+    printf("GSM 7-bit codec, time per call (%d rounds)\n", CODEC_BENCH_ROUNDS);
+    start = std::chrono::steady_clock::now();
+    for (round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        encode(ascii, 0, encoded);
+        bench_sink += encoded[round % (CODEC_MAX_LENGTH * 7 / 4)];
+    }
+    table_ns = elapsed_ns(start);
+    start = std::chrono::steady_clock::now();
+    for (round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        reference_encode(ascii, 0, encoded);
+        bench_sink += encoded[round % (CODEC_MAX_LENGTH * 7 / 4)];
+    }
+    reference_ns = elapsed_ns(start);
+    print_bench("encode 160 chars", table_ns, reference_ns, CODEC_BENCH_ROUNDS);
+
+    start = std::chrono::steady_clock::now();
+    for (round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        for (i = 0; i < CODEC_MAX_LENGTH; i++)
+            bench_sink += ascii_to_gsm(ascii[i]);
+    }
+    table_ns = elapsed_ns(start);
+    start = std::chrono::steady_clock::now();
+    for (round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        for (i = 0; i < CODEC_MAX_LENGTH; i++)
+            bench_sink += reference_ascii_to_gsm(ascii[i]);
+    }
+    reference_ns = elapsed_ns(start);
+    print_bench("ascii_to_gsm", table_ns, reference_ns, CODEC_BENCH_ROUNDS * CODEC_MAX_LENGTH);
+
+    start = std::chrono::steady_clock::now();
+    for (round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        for (i = 0; i < CODEC_MAX_LENGTH; i++)
+            bench_sink += gsm_to_ascii_folded(ascii[i]);
+    }
+    table_ns = elapsed_ns(start);
+    start = std::chrono::steady_clock::now();
+    for (round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        for (i = 0; i < CODEC_MAX_LENGTH; i++)
+            bench_sink += reference_gsm_to_ascii_folded(ascii[i]);
+    }
+    reference_ns = elapsed_ns(start);
+    print_bench("gsm_to_ascii_folded", table_ns, reference_ns, CODEC_BENCH_ROUNDS * CODEC_MAX_LENGTH);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_characters);
+    RUN_TEST(test_round_trip_block);
+    RUN_TEST(test_round_trip_fill_bit);
+    RUN_TEST(test_bench);
+    return UNITY_END();
+}
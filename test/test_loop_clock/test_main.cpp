@@ -0,0 +1,107 @@
+// Loop frequency and software clock measurement, firmware runs its setup() and loop() on
+// native HAL against SIM900 emulator. Loop counter of system_control must match simulated
+// loop time, and home page must not read RTC on each loop() pass
+// Results are printed, run with: pio test -e native -f test_loop_clock -v
+
+// Include global header files, chrono goes before min and max macros of Arduino.h
+#include <chrono>
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+// Include local header files
+#include "native_hal.h"
+#include "sim900_emulator.hpp"
+#include "storage.hpp"
+#include "system.hpp"
+
+// Loop passes measured for RTC reads, two minutes at 1 ms per loop()
+#define CLOCK_LOOPS 120000UL
+// Loop passes timed on host
+#define CLOCK_HOST_LOOPS 20000UL
+
+void setup();
+void loop();
+
+static sim900_emulator sim900;
+static uint32_t rtc_start;      // RTC time when hal_millis was 0
+
+// Run given number of loop() passes, each one takes loop_time ms
+static void run_loops(unsigned long count, unsigned long loop_time) {
+    unsigned long i;
+
+    for (i = 0; i < count; i++) {
+        sim900.update();
+        loop();
+        hal_millis += loop_time;
+        // RTC keeps time on its own
+        hal_rtc_seconds = rtc_start + hal_millis / 1000;
+    }
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// Counter reports loop passes per second of last window, for any loop time
+void test_loop_frequency() {
+    run_loops(3 * LOOP_FREQUENCY_WINDOW, 1);
+    TEST_ASSERT_EQUAL(1000, system_control.get_loop_frequency());
+    run_loops(3 * LOOP_FREQUENCY_WINDOW / 4, 4);
+    TEST_ASSERT_EQUAL(250, system_control.get_loop_frequency());
+    run_loops(3 * LOOP_FREQUENCY_WINDOW / 40, 40);
+    TEST_ASSERT_EQUAL(25, system_control.get_loop_frequency());
+}
+
+// Console command clock shows loop frequency
+void test_clock_command() {
+    std::string expected = "LOOP FREQUENCY    -- 25\r\n";
+
+    hal_serial_out.clear();
+    hal_serial_in = "clock\r";
+    run_loops(1, 40);
+    TEST_ASSERT_TRUE_MESSAGE(hal_serial_out.find(expected) != std::string::npos, hal_serial_out.c_str());
+}
+
+// RTC is read only on software clock syncs, not by home page on every pass
+void test_rtc_reads() {
+    unsigned long reads = hal_rtc_reads;
+    unsigned long syncs = storage.get_clock_syncs();
+
+    run_loops(CLOCK_LOOPS, 1);
+    reads = hal_rtc_reads - reads;
+    syncs = storage.get_clock_syncs() - syncs;
+    printf("%lu loop passes in %lu s: %lu RTC reads, %lu clock syncs, loop frequency %lu\n",
+        CLOCK_LOOPS, CLOCK_LOOPS / 1000, reads, syncs, system_control.get_loop_frequency());
+    TEST_ASSERT_EQUAL(syncs, reads);
+    TEST_ASSERT_LESS_OR_EQUAL(CLOCK_LOOPS / 1000 / RTC_SYNC_INTERVAL + 1, reads);
+    TEST_ASSERT_FALSE(system_control.test_error(ERROR_RTC_UNKNOWN));
+}
+
+// Time of one loop() pass on host, hardware figure is shown by console command clock
+void test_host_loop_time() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed_us;
+
+    run_loops(CLOCK_HOST_LOOPS, 1);
+    elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("host: %.2f us per loop() pass, %.0f passes per second\n",
+        elapsed_us / CLOCK_HOST_LOOPS, CLOCK_HOST_LOOPS * 1e6 / elapsed_us);
+}
+
+int main(int argc, char **argv) {
+    hal_reset();
+    hal_sd_format();
+    rtc_start = RtcDateTime(2024, 4, 13, 12, 50, 0).TotalSeconds();
+    hal_rtc_seconds = rtc_start;
+    setup();
+    run_loops(2500, 2);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_loop_frequency);
+    RUN_TEST(test_clock_command);
+    RUN_TEST(test_rtc_reads);
+    RUN_TEST(test_host_loop_time);
+    return UNITY_END();
+}
@@ -0,0 +1,230 @@
+// Stress test of modem receive ring, recorded SIM900 traffic is replayed at 9600 baud
+// through USART3 interrupt while main loop stalls like it does in SD scans and LCD redraws
+// Lines must come out whole and in order, lost lines must be counted as overflows
+// Results are printed, run with: pio test -e native -f test_modem_rx_replay -v
+
+// Include global header files
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+// Include local header files
+#include "native_hal.h"
+#include "modem_serial.hpp"
+#include "sms_pdu.hpp"
+
+// Characters received in one second at 9600 baud, 10 bits each
+#define REPLAY_CHARS_PER_SECOND 960
+// Times recording is replayed in each test
+#define REPLAY_ROUNDS 20
+
+// Result of one replay
+struct replay_result {
+    unsigned long lines;        // Lines expected
+    unsigned long read;         // Lines read by main loop
+    unsigned long lost;         // Lines which were not read
+    unsigned long overflows;    // Overflows counted by modem serial
+};
+
+static unsigned long random_state;
+
+static unsigned long random_number(unsigned long limit) {
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 8) % limit;
+}
+
+// Concatenated SMS part as it comes after +CMT, longest line modem sends
+static std::string long_pdu() {
+    builder pdu_builder;
+    std::string text;
+    std::string pdu;
+
+    while (text.size() < SMS_PART_LENGTH * 2)
+        text += "Alarm aktiviran, sirena ukljucena. ";
+    pdu_builder.set_number("385911234567");
+    pdu_builder.set_message(text.c_str());
+    pdu_builder.set_part(0, 0xA7);
+    pdu_builder.calculate();
+    pdu = pdu_builder.get_pdu();
+    // SMSC and deliver header replace SMSC and submit header of builder
+    return "07918385090000F0440C91839511325476000042403121053180" + pdu.substr(28);
+}
+
+// Traffic recorded from SIM900: power up noise, startup, check, incoming calls and
+// messages, and SMS sent with prompt
+static std::string recording() {
+    return std::string("\xFF\xF8\x00\xE0", 4) + "\r\nRDY\r\n\r\n+CFUN: 1\r\n\r\n+CPIN: READY\r\n\r\nCall Ready\r\n"
+        "AT\r\r\nOK\r\n"
+        "AT+CMGF=0;+CNMI=2,2,0,0,0\r\r\nOK\r\n"
+        "AT+CCID;+CPIN?;+CSQ;+CREG?\r\r\n89385011223344556677\r\n\r\n+CPIN: READY\r\n\r\n+CSQ: 17,0\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n"
+        "\r\n+CMT: ,159\r\n" + long_pdu() + "\r\n"
+        "\r\n+CMT: ,22\r\n07918385090000F0040C9183951132547600084240312105318006016100" "6F006E\r\n"
+        "AT+CMGS=20\r\r\n> 0011000C918395113254760008AA060160006F006E\x1A\r\n\r\n+CMGS: 12\r\n\r\nOK\r\n"
+        "\r\nRING\r\n\r\nRING\r\n\r\nNO CARRIER\r\n"
+        // Line noise inside line
+        "\r\n+CSQ: 1\xB7" "5,0\r\n"
+        "\r\n+CMTI: \"SM\",3\r\n";
+}
+
+// Split recording into lines the same way modem serial should
+static std::vector<std::string> expected_lines(const std::string &traffic) {
+    std::vector<std::string> lines;
+    std::string line;
+    size_t i;
+
+    for (i = 0; i < traffic.size(); i++) {
+        uint8_t ch = traffic[i];
+
+        if (ch == '\n' || ch == '\0' || ch >= 0x80)
+            continue;
+        if (ch == '\r') {
+            if (!line.empty())
+                lines.push_back(line);
+            line.clear();
+            continue;
+        }
+        line += ch;
+        if (line == "> ") {
+            lines.push_back(line);
+            line.clear();
+        }
+    }
+    return lines;
+}
+
+// Replay traffic one character at a time at serial speed, main loop reads all complete
+// lines and then stalls for random time up to max_stall ms
+static replay_result replay(const std::string &traffic, unsigned long max_stall) {
+    std::vector<std::string> lines = expected_lines(traffic);
+    replay_result result = { lines.size(), 0, 0, modem_serial.get_overflows() };
+    unsigned long busy_until = 0;   // Time when main loop stops stalling, in received characters
+    size_t next = 0;                // Next expected line
+    size_t i;
+
+    for (i = 0; i <= traffic.size(); i++) {
+        const char *line;
+
+        if (i < traffic.size())
+            hal_modem_receive((uint8_t)traffic[i]);
+        // Main loop doesn't run while it's stalled, except at the end so ring is emptied
+        if (i < busy_until && i < traffic.size())
+            continue;
+        while ((line = modem_serial.read_line()) != NULL) {
+            // Line must be one of next expected lines, lines in between are lost
+            while (next < lines.size() && lines[next] != line)
+                ++next;
+            TEST_ASSERT_TRUE_MESSAGE(next < lines.size(), line);
+            ++next;
+            ++result.read;
+            modem_serial.release_line();
+        }
+        busy_until = i + random_number(max_stall + 1) * REPLAY_CHARS_PER_SECOND / 1000;
+    }
+    result.lost = result.lines - result.read;
+    result.overflows = modem_serial.get_overflows() - result.overflows;
+    return result;
+}
+
+static replay_result replay_rounds(const char name[], unsigned long max_stall) {
+    replay_result total = { 0, 0, 0, 0 };
+    std::string traffic = recording();
+    int round;
+
+    for (round = 0; round < REPLAY_ROUNDS; round++) {
+        replay_result result = replay(traffic, max_stall);
+
+        total.lines += result.lines;
+        total.read += result.read;
+        total.lost += result.lost;
+        total.overflows += result.overflows;
+    }
+    printf("%s: stalls up to %lu ms, %d replays of %u bytes\n", name, max_stall, REPLAY_ROUNDS, (unsigned int)traffic.size());
+    printf("  lines %lu, read %lu, lost %lu, overflows %lu, peak ring %u/%d bytes\n",
+        total.lines, total.read, total.lost, total.overflows, modem_serial.get_max_used(), MODEM_RX_RING_SIZE);
+    return total;
+}
+
+void setUp() {
+    random_state = 1;
+    modem_serial.clear();
+}
+
+void tearDown() {
+}
+
+// Ring holds 530 ms of traffic, but longest PDU must stay in one piece after lines which
+// are not read yet, so stalls up to 200 ms lose nothing
+void test_short_stalls() {
+    replay_result result = replay_rounds("short stalls", 200);
+
+    TEST_ASSERT_EQUAL(0, result.lost);
+    TEST_ASSERT_EQUAL(0, result.overflows);
+    TEST_ASSERT_TRUE(modem_serial.get_max_used() <= MODEM_RX_RING_SIZE);
+}
+
+// Long stalls overflow ring, lines which arrive are still whole and every loss is counted,
+// dropped prompt takes PDU echo after it too, so that's two lines for one overflow
+void test_long_stalls() {
+    replay_result result = replay_rounds("long stalls", 2000);
+
+    TEST_ASSERT_TRUE(result.overflows > 0);
+    TEST_ASSERT_TRUE(result.lost >= result.overflows);
+    TEST_ASSERT_TRUE(result.read > 0);
+}
+
+// Line is not passed to main loop until it ends, however it's split between stalls
+void test_split_line() {
+    std::string pdu = long_pdu();
+    size_t i;
+
+    for (i = 0; i < pdu.size(); i += 37) {
+        hal_modem_receive(pdu.substr(i, 37));
+        TEST_ASSERT_NULL(modem_serial.read_line());
+    }
+    hal_modem_receive("\r\n");
+    TEST_ASSERT_EQUAL_STRING(pdu.c_str(), modem_serial.read_line());
+    modem_serial.release_line();
+    TEST_ASSERT_NULL(modem_serial.read_line());
+}
+
+// Characters with highest bit set are dropped, rest of line is kept
+void test_non_ascii_dropped() {
+    hal_modem_receive(std::string("\xFF\xF8\x00", 3) + "\r\nRDY\r\n+CSQ: 1\xB7" "5,0\r\n\x80\x81\r\n");
+    TEST_ASSERT_EQUAL_STRING("RDY", modem_serial.read_line());
+    modem_serial.release_line();
+    TEST_ASSERT_EQUAL_STRING("+CSQ: 15,0", modem_serial.read_line());
+    modem_serial.release_line();
+    TEST_ASSERT_NULL(modem_serial.read_line());
+}
+
+// More lines than ring can index are dropped from the newest one
+void test_line_count_overflow() {
+    unsigned long overflows = modem_serial.get_overflows();
+    char line[16];
+    int i;
+
+    for (i = 0; i < MODEM_RX_LINES + 8; i++) {
+        snprintf(line, sizeof(line), "RING%d", i);
+        hal_modem_receive(std::string(line) + "\r\n");
+    }
+    TEST_ASSERT_EQUAL(8, modem_serial.get_overflows() - overflows);
+    for (i = 0; i < MODEM_RX_LINES; i++) {
+        snprintf(line, sizeof(line), "RING%d", i);
+        TEST_ASSERT_EQUAL_STRING(line, modem_serial.read_line());
+        modem_serial.release_line();
+    }
+    TEST_ASSERT_NULL(modem_serial.read_line());
+}
+
+int main(int argc, char **argv) {
+    hal_reset();
+    modem_serial.begin(9600);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_short_stalls);
+    RUN_TEST(test_long_stalls);
+    RUN_TEST(test_split_line);
+    RUN_TEST(test_non_ascii_dropped);
+    RUN_TEST(test_line_count_overflow);
+    return UNITY_END();
+}
@@ -0,0 +1,146 @@
+// SD card operations of storage calls, files stay open so no call may open a file after
+// they are opened at startup. Each operation is counted by native SD (hal_sd)
+// Results are printed, run with: pio test -e native -f test_storage_bench -v
+
+// Include global header files
+#include <Arduino.h>
+#include <unity.h>
+// Include local header files
+#include "native_hal.h"
+#include "storage.hpp"
+#include "system.hpp"
+
+// Calls of each operation, SD operations are averaged over them
+#define BENCH_CALLS 10
+// Users added before benchmark
+#define BENCH_USERS 40
+// Logs written before benchmark
+#define BENCH_LOGS 200
+
+void setup();
+
+// Operation which is measured, i is number of call
+typedef void (*bench_operation)(int i);
+
+static void op_get_user_by_num(int i) {
+    char number[24];
+
+    snprintf(number, sizeof(number), "3859112340%02d", (i * 7) % BENCH_USERS);
+    TEST_ASSERT_TRUE(storage.get_user_by_num(number).id > 0);
+}
+
+static void op_get_user_by_pos(int i) {
+    TEST_ASSERT_TRUE(storage.get_user_by_pos((i * 7) % BENCH_USERS).id > 0);
+}
+
+static void op_get_log(int i) {
+    storage.get_log((i * 17) % BENCH_LOGS);
+}
+
+static void op_get_log_page(int i) {
+    log_page_record page[LOG_PAGE_SIZE];
+
+    TEST_ASSERT_EQUAL(LOG_PAGE_SIZE, storage.get_log_page(i * LOG_PAGE_SIZE, LOG_PAGE_SIZE, page));
+}
+
+static void op_log_this(int i) {
+    storage.log_this(i + 1, "son");
+    storage.sync();
+}
+
+static void op_set_setting(int i) {
+    storage.set_setting(SETTING_SIRENE_AUTH, i % 2);
+}
+
+static void op_get_setting(int i) {
+    storage.get_setting(SETTING_SIRENE_AUTH);
+}
+
+static void op_dis_user(int i) {
+    storage.dis_user(i + 1);
+}
+
+// Run operation and print mean SD operations per call, returns files opened
+static unsigned long bench(const char name[], bench_operation operation) {
+    int i;
+
+    hal_sd = hal_sd_counters();
+    for (i = 0; i < BENCH_CALLS; i++)
+        operation(i);
+    TEST_ASSERT_FALSE(system_control.test_error(ERROR_SD));
+
+    printf("  %-18s %6.1f %6.1f %6.1f %6.1f %6.1f\n", name,
+        (double)hal_sd.opens / BENCH_CALLS, (double)hal_sd.reads / BENCH_CALLS,
+        (double)hal_sd.writes / BENCH_CALLS, (double)hal_sd.seeks / BENCH_CALLS,
+        (double)hal_sd.flushes / BENCH_CALLS);
+    return hal_sd.opens;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_no_opens() {
+    printf("Mean SD operations per call (%d calls, %d users, %d logs)\n", BENCH_CALLS, BENCH_USERS, BENCH_LOGS);
+    printf("  %-18s %6s %6s %6s %6s %6s\n", "operation", "opens", "reads", "writes", "seeks", "flush");
+    TEST_ASSERT_EQUAL(0, bench("get_user_by_num", op_get_user_by_num));
+    TEST_ASSERT_EQUAL(0, bench("get_user_by_pos", op_get_user_by_pos));
+    TEST_ASSERT_EQUAL(0, bench("get_log", op_get_log));
+    TEST_ASSERT_EQUAL(0, bench("get_log_page", op_get_log_page));
+    TEST_ASSERT_EQUAL(0, bench("log_this + sync", op_log_this));
+    TEST_ASSERT_EQUAL(0, bench("set_setting", op_set_setting));
+    TEST_ASSERT_EQUAL(0, bench("get_setting", op_get_setting));
+    TEST_ASSERT_EQUAL(0, bench("dis_user", op_dis_user));
+}
+
+// Reads don't write anything, cached setting doesn't touch SD card at all
+void test_reads_dont_write() {
+    hal_sd = hal_sd_counters();
+    op_get_user_by_num(1);
+    op_get_user_by_pos(1);
+    op_get_log(1);
+    op_get_log_page(1);
+    TEST_ASSERT_EQUAL(0, hal_sd.writes);
+    TEST_ASSERT_EQUAL(0, hal_sd.flushes);
+
+    hal_sd = hal_sd_counters();
+    op_get_setting(1);
+    TEST_ASSERT_EQUAL(0, hal_sd.reads + hal_sd.writes + hal_sd.seeks + hal_sd.flushes);
+}
+
+// Staged logs are written by sync, not by log_this
+void test_log_staged_until_sync() {
+    unsigned long count = storage.get_log_count();
+
+    hal_sd = hal_sd_counters();
+    storage.log_this(1, "son");
+    TEST_ASSERT_EQUAL(0, hal_sd.writes);
+    storage.sync();
+    TEST_ASSERT_TRUE(hal_sd.writes > 0);
+    TEST_ASSERT_EQUAL(count + 1, storage.get_log_count());
+}
+
+int main(int argc, char **argv) {
+    char number[24];
+    int i;
+
+    hal_reset();
+    hal_sd_format();
+    hal_rtc_seconds = RtcDateTime(2024, 4, 13, 12, 50, 0).TotalSeconds();
+    setup();
+    for (i = 0; i < BENCH_USERS; i++) {
+        snprintf(number, sizeof(number), "3859112340%02d", i);
+        storage.add_user(number);
+    }
+    for (i = 0; i < BENCH_LOGS; i++)
+        storage.log_this(i % BENCH_USERS + 1, "vmo");
+    storage.sync();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_no_opens);
+    RUN_TEST(test_reads_dont_write);
+    RUN_TEST(test_log_staged_until_sync);
+    return UNITY_END();
+}
@@ -0,0 +1,247 @@
+// End-to-end SMS throughput benchmark, firmware runs its setup() and loop() on native HAL
+// against SIM900 emulator. Each command is followed from +CMT to relay write and to +CMGS OK
+// of its reply. Results are printed, run with: pio test -e native -f test_throughput -v
+
+// Include global header files
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+// Include local header files
+#include "native_hal.h"
+#include "sim900_emulator.hpp"
+#include "storage.hpp"
+#include "modem.hpp"
+#include "modem_serial.hpp"
+#include "relays.hpp"
+
+// Simulated time taken by one loop() (in ms)
+#define BENCH_LOOP_TIME 2
+// Time given to modem startup before first command (in ms)
+#define BENCH_WARMUP 5000
+// Time after last command in which replies must arrive (in ms)
+#define BENCH_DRAIN 120000
+
+void setup();
+void loop();
+
+// Command sent by one user and what happened to it
+struct bench_command {
+    std::string number;         // Sender
+    unsigned long cmt_at;       // hal_millis when +CMT was sent
+    unsigned long relay_at;     // hal_millis when light relay was written, 0 if it wasn't
+    unsigned long reply_at;     // hal_millis when final OK of reply was sent, 0 if there was no reply
+};
+
+// Latency statistics of one measured path
+struct bench_latency {
+    unsigned long count;
+    unsigned long total;
+    unsigned long max;
+};
+
+static sim900_emulator sim900;
+static std::vector<bench_command> commands;
+static size_t relay_waiting;    // First command which still waits for relay write
+static int sender_count;        // Number of users added by all benchmarks
+
+// Light sensor follows light relay, and relay write is assigned to oldest command waiting for it
+static void light_wiring(uint8_t pin, uint8_t value) {
+    if (pin != LIGHT_PIN) return;
+    hal_pins[LIGHT_S] = value;
+    if (relay_waiting < commands.size()) {
+        commands[relay_waiting].relay_at = hal_millis;
+        ++relay_waiting;
+    }
+}
+
+static void run(unsigned long ms) {
+    unsigned long end = hal_millis + ms;
+
+    while ((long)(hal_millis - end) < 0) {
+        sim900.update();
+        loop();
+        hal_millis += BENCH_LOOP_TIME;
+    }
+}
+
+static void add_latency(bench_latency &latency, unsigned long start, unsigned long end) {
+    ++latency.count;
+    latency.total += end - start;
+    if (end - start > latency.max)
+        latency.max = end - start;
+}
+
+// Result of one benchmark
+struct bench_result {
+    int no_relay;               // Commands which didn't write relay
+    int no_reply;               // Commands which got no reply
+    unsigned long overflows;    // Replies dropped because SMS buffer was full
+};
+
+// Send count commands from senders new users, one every interval ms, and wait for replies
+static bench_result bench(const char name[], int senders, int count, unsigned long interval) {
+    std::vector<std::string> numbers;
+    bench_latency relay_latency = { 0, 0, 0 };
+    bench_latency reply_latency = { 0, 0, 0 };
+    size_t submitted_start = sim900.submitted.size();
+    bench_result result = { 0, 0, sms_modem.get_overflows() };
+    int i;
+    size_t j;
+
+    commands.clear();
+    relay_waiting = 0;
+    for (i = 0; i < senders; i++) {
+        char number[16];
+
+        snprintf(number, sizeof(number), "3859100%05d", sender_count++ % 100000);
+        numbers.push_back(number);
+        storage.add_user(number);
+    }
+    // Light is switched on and off by each command, so each one writes relay and gets reply
+    for (i = 0; i < count; i++) {
+        bench_command command = { numbers[i % senders], hal_millis, 0, 0 };
+
+        commands.push_back(command);
+        sim900.deliver(command.number, relay.get_light() == ON ? "sof" : "son");
+        run(interval);
+    }
+    run(BENCH_DRAIN);
+
+    // Replies to the same number are sent in the order commands arrived
+    for (j = submitted_start; j < sim900.submitted.size(); j++) {
+        size_t k;
+
+        for (k = 0; k < commands.size(); k++) {
+            if (commands[k].reply_at == 0 && commands[k].number == sim900.submitted[j].number) {
+                commands[k].reply_at = sim900.submitted[j].ok_at;
+                break;
+            }
+        }
+    }
+    for (j = 0; j < commands.size(); j++) {
+        if (commands[j].relay_at != 0)
+            add_latency(relay_latency, commands[j].cmt_at, commands[j].relay_at);
+        if (commands[j].reply_at != 0)
+            add_latency(reply_latency, commands[j].cmt_at, commands[j].reply_at);
+        result.no_relay += commands[j].relay_at == 0;
+        result.no_reply += commands[j].reply_at == 0;
+    }
+    result.overflows = sms_modem.get_overflows() - result.overflows;
+
+    printf("%s: %d commands from %d senders every %lu ms\n", name, count, senders, interval);
+    printf("  +CMT -> relay write:  avg %lu ms, max %lu ms (%lu commands)\n",
+        relay_latency.count ? relay_latency.total / relay_latency.count : 0, relay_latency.max, relay_latency.count);
+    printf("  +CMT -> +CMGS OK:     avg %lu ms, max %lu ms (%lu replies)\n",
+        reply_latency.count ? reply_latency.total / reply_latency.count : 0, reply_latency.max, reply_latency.count);
+    printf("  dropped: %d relay writes, %d replies (%lu SMS buffer overflows)\n",
+        result.no_relay, result.no_reply, result.overflows);
+    printf("  peak SMS queue %d/%d, peak rx ring %u/%d bytes\n",
+        sms_modem.get_queue_peak(), SMS_BUFFER_SIZE, modem_serial.get_max_used(), MODEM_RX_RING_SIZE);
+    return result;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// Commands arrive slower than SMS can be sent, nothing may be lost
+void test_steady_load() {
+    bench_result result = bench("steady", 12, 60, 2500);
+
+    TEST_ASSERT_EQUAL(0, result.no_relay);
+    TEST_ASSERT_EQUAL(0, result.no_reply);
+    TEST_ASSERT_EQUAL(0, result.overflows);
+}
+
+// Whole crew answers call-out at once, more replies are queued than SMS buffer holds
+// every command must still be executed and every lost reply must be counted as overflow
+void test_burst_load() {
+    bench_result result = bench("burst", 24, 24, 200);
+
+    TEST_ASSERT_EQUAL(0, result.no_relay);
+    TEST_ASSERT_EQUAL(result.overflows, result.no_reply);
+    TEST_ASSERT_TRUE(sms_modem.get_queue_peak() <= SMS_BUFFER_SIZE);
+}
+
+// Modem refuses some messages and doesn't answer one, replies are sent again after backoff
+// Number of senders is odd, so next command of the same sender is not dropped as duplicate
+void test_modem_faults() {
+    sim900.script("AT+CMGS=", SIM900_ERROR, 2);
+    sim900.script("PDU", SIM900_CMS_ERROR, 1);
+    sim900.script("PDU", SIM900_TIMEOUT, 1);
+    bench_result result = bench("faults", 5, 12, 2500);
+
+    TEST_ASSERT_EQUAL(0, result.no_relay);
+    TEST_ASSERT_EQUAL(0, result.no_reply);
+    TEST_ASSERT_EQUAL(0, sms_modem.get_spooled());
+}
+
+// Siren is started while replies to earlier commands wait in SMS queue, acknowledgement
+// of siren is sent right after message which is being sent, before all waiting replies
+void test_siren_ack_first() {
+    const int backlog = 10;                             // Commands before siren command
+    size_t submitted_start = sim900.submitted.size();
+    std::string siren_number;
+    unsigned long siren_at;                             // hal_millis when siren command was sent
+    size_t ack = 0;                                     // Index of acknowledgement in submitted
+    int before = 0;                                     // Waiting replies sent before acknowledgement
+    int after = 0;                                      // Waiting replies sent after acknowledgement
+    size_t j;
+    int i;
+
+    for (i = 0; i <= backlog; i++) {
+        char number[16];
+
+        snprintf(number, sizeof(number), "3859100%05d", sender_count++ % 100000);
+        storage.add_user(number);
+        if (i == backlog) {
+            siren_number = number;
+            break;
+        }
+        // Status reply is kept in text pool, others are in flash
+        sim900.deliver(number, i == 0 ? "status" : relay.get_light() == ON ? "sof" : "son");
+        run(200);
+    }
+    siren_at = hal_millis;
+    sim900.deliver(siren_number, "uva");
+    run(1000);
+    TEST_ASSERT_EQUAL(SIREN_VATROGASNA, relay.get_siren());
+    run(BENCH_DRAIN);
+
+    for (j = submitted_start; j < sim900.submitted.size(); j++) {
+        if (sim900.submitted[j].number == siren_number)
+            ack = j;
+    }
+    TEST_ASSERT_TRUE(ack != 0);
+    for (j = submitted_start; j < sim900.submitted.size(); j++) {
+        if (j == ack || sim900.submitted[j].command_at < siren_at) continue;
+        if (j < ack)
+            ++before;
+        else
+            ++after;
+    }
+    printf("siren: %d replies waiting, acknowledgement sent %lu ms after +CMT, %d replies before it, %d after\n",
+        before + after, sim900.submitted[ack].ok_at - siren_at, before, after);
+    TEST_ASSERT_EQUAL(0, before);
+    TEST_ASSERT_TRUE(after >= backlog / 2);
+    TEST_ASSERT_EQUAL(submitted_start + backlog + 1, sim900.submitted.size());
+}
+
+int main(int argc, char **argv) {
+    // Firmware is started once, tests continue one after another like on real device
+    hal_reset();
+    hal_sd_format();
+    hal_rtc_seconds = RtcDateTime(2024, 3, 15, 12, 0, 0).TotalSeconds();
+    hal_pin_written = light_wiring;
+    setup();
+    run(BENCH_WARMUP);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_load);
+    RUN_TEST(test_burst_load);
+    RUN_TEST(test_modem_faults);
+    RUN_TEST(test_siren_ack_first);
+    return UNITY_END();
+}
@@ -0,0 +1,183 @@
+// Corpus of SMS PDUs with Croatian diacritics, as phones send them. Parser must fold
+// UCS-2 (DCS 0x08) messages to ASCII, so commands typed with diacritics still match, and
+// builder must send replies as UCS-2 only when that doesn't take more messages
+
+// Include global header files
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+// Include local header files
+#include "native_hal.h"
+#include "sim900_emulator.hpp"
+#include "storage.hpp"
+#include "relays.hpp"
+#include "sms_pdu.hpp"
+
+// Simulated time taken by one loop() (in ms)
+#define CORPUS_LOOP_TIME 2
+
+void setup();
+void loop();
+
+// SMS-DELIVER PDU and what parser must get from it
+struct corpus_pdu {
+    const char *pdu;        // Whole PDU with SMSC, as it comes after +CMT
+    const char *number;     // Sender number
+    const char *message;    // Message after to_lower()
+};
+
+// Sender is +385 91 1234567 unless noted, all are sent on 13.04.2024 12:50:13 +02
+static const corpus_pdu corpus[] = {
+    // "Šon", UCS-2, status report indication set
+    { "07918385090000F0240C9183951132547600084240312105318006" "0160006F006E",
+      "385911234567", "son" },
+    // "šon", UCS-2
+    { "07918385090000F0040C9183951132547600084240312105318006" "0161006F006E",
+      "385911234567", "son" },
+    // "Vmo", UCS-2, phone switched to Unicode after earlier message
+    { "07918385090000F0040C9183951132547600084240312105318006" "0056006D006F",
+      "385911234567", "vmo" },
+    // "Vmo", GSM 7-bit
+    { "07918385090000F0040C9183951132547600004240312105318003" "D6F61B",
+      "385911234567", "vmo" },
+    // "Upali svjetlo: čćšžđ ČĆŠŽĐ", UCS-2
+    { "07918385090000F0040C9183951132547600084240312105318034"
+      "005500700061006C0069002000730076006A00650074006C006F003A0020010D01070161017E01110020010C01060160017D0110",
+      "385911234567", "upali svjetlo: ccszd ccszd" },
+    // "Cijena 5€", UCS-2 from national number 091 1234567, euro sign has no ASCII base
+    { "07918385090000F0040A8190113254760008424031210531801200430069006A0065006E00610020003520AC",
+      "0911234567", "cijena 5?" }
+};
+
+static sim900_emulator sim900;
+
+// Light sensor follows light relay
+static void light_wiring(uint8_t pin, uint8_t value) {
+    if (pin == LIGHT_PIN)
+        hal_pins[LIGHT_S] = value;
+}
+
+static void run(unsigned long ms) {
+    unsigned long end = hal_millis + ms;
+
+    while ((long)(hal_millis - end) < 0) {
+        sim900.update();
+        loop();
+        hal_millis += CORPUS_LOOP_TIME;
+    }
+}
+
+// Build reply for 385911234567 and check its encoding
+static void check_builder(const std::string &message, int parts, int ucs2) {
+    builder pdu_builder;
+    std::string coding;
+
+    pdu_builder.set_number("385911234567");
+    pdu_builder.set_message(message.c_str());
+    TEST_ASSERT_EQUAL_MESSAGE(parts, pdu_builder.get_part_count(), message.c_str());
+    pdu_builder.set_part(0, 1);
+    pdu_builder.calculate();
+    // Data coding scheme follows SMSC, first octet, reference, number and protocol identifier
+    coding = std::string(pdu_builder.get_pdu()).substr(24, 2);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(ucs2 ? "08" : "00", coding.c_str(), message.c_str());
+}
+
+// Message of given length, every tenth character is š
+static std::string with_diacritics(int length) {
+    std::string message;
+    int i;
+
+    for (i = 0; i < length; i++)
+        message += (i % 10 == 0) ? "\xC5\xA1" : "x";
+    return message;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_parser_corpus() {
+    size_t i;
+
+    for (i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+        parser pdu_parser;
+
+        pdu_parser.set_pdu(corpus[i].pdu);
+        pdu_parser.to_lower();
+        TEST_ASSERT_EQUAL_STRING(corpus[i].number, pdu_parser.get_number());
+        TEST_ASSERT_EQUAL_STRING(corpus[i].message, pdu_parser.get_message());
+    }
+}
+
+// Reply with diacritics which fits in one message goes as UCS-2
+void test_builder_ucs2() {
+    builder pdu_builder;
+
+    pdu_builder.set_number("385911234567");
+    pdu_builder.set_message("\xC5\xA0on");
+    pdu_builder.calculate();
+    TEST_ASSERT_EQUAL_STRING("0011000C918395113254760008AA060160006F006E", pdu_builder.get_pdu());
+    TEST_ASSERT_EQUAL(20, pdu_builder.get_tpdu_length());
+
+    check_builder(with_diacritics(SMS_UCS2_SINGLE_LENGTH), 1, 1);
+}
+
+// UCS-2 is rejected when it would take more messages, diacritics are folded to GSM 7-bit
+void test_builder_rejects_ucs2() {
+    builder pdu_builder;
+    std::string message = "\xC5\xA1" + std::string(100, 'a');
+    std::string first;
+
+    check_builder(with_diacritics(SMS_UCS2_SINGLE_LENGTH + 1), 1, 0);
+    check_builder(with_diacritics(SMS_SINGLE_LENGTH), 1, 0);
+    check_builder(with_diacritics(SMS_SINGLE_LENGTH + 1), 2, 0);
+    check_builder(with_diacritics(SMS_PART_LENGTH * 2), 2, 0);
+
+    pdu_builder.set_number("385911234567");
+    pdu_builder.set_message(message.c_str());
+    pdu_builder.calculate();
+    TEST_ASSERT_EQUAL(1, pdu_builder.get_part_count());
+    // š is sent as s, first octet of user data holds it and lowest bit of next a
+    first = std::string(pdu_builder.get_pdu()).substr(30, 2);
+    TEST_ASSERT_EQUAL_STRING("F3", first.c_str());
+}
+
+// Commands typed with diacritics run like ones without them
+void test_commands_match() {
+    size_t replies = sim900.submitted.size();
+
+    storage.add_user("385911234567");
+    storage.add_user("385917654321");
+    TEST_ASSERT_EQUAL(OFF, relay.get_light());
+
+    // "šon" from first user
+    sim900.deliver_recorded(corpus[1].pdu);
+    run(3000);
+    TEST_ASSERT_EQUAL(ON, relay.get_light());
+    TEST_ASSERT_EQUAL(replies + 1, sim900.submitted.size());
+    TEST_ASSERT_EQUAL_STRING("385911234567", sim900.submitted.back().number.c_str());
+
+    // "Vmo" from second user, sent as UCS-2
+    sim900.deliver_recorded("07918385090000F0040C9183957156341200084240312105318006" "0056006D006F");
+    run(3000);
+    TEST_ASSERT_EQUAL(replies + 2, sim900.submitted.size());
+    TEST_ASSERT_EQUAL_STRING("385917654321", sim900.submitted.back().number.c_str());
+}
+
+int main(int argc, char **argv) {
+    hal_reset();
+    hal_sd_format();
+    hal_rtc_seconds = RtcDateTime(2024, 4, 13, 12, 50, 0).TotalSeconds();
+    hal_pin_written = light_wiring;
+    setup();
+    run(5000);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_parser_corpus);
+    RUN_TEST(test_builder_ucs2);
+    RUN_TEST(test_builder_rejects_ucs2);
+    RUN_TEST(test_commands_match);
+    return UNITY_END();
+}